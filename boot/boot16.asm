@@ -50,12 +50,22 @@ mov ah, 0x42
 int 0x13
 jc disk_error
 
-; --- load kernel sectors to 0x10000 ---
+; --- load kernel sectors to 0x10000 (KERNEL_CHUNK sectors per read) ---
+KERNEL_SECTORS equ 384      ; keep in sync with boot32.asm, kexec.h and makefile
+KERNEL_CHUNK   equ 64
+
+mov cx, KERNEL_SECTORS / KERNEL_CHUNK
+.load_kernel:
+push cx
 mov si, dap_kernel
 mov dl, [boot_drive]
 mov ah, 0x42
 int 0x13
+pop cx
 jc disk_error
+add word [dap_kernel + 6], KERNEL_CHUNK * 512 / 16  ; next segment
+add dword [dap_kernel + 8], KERNEL_CHUNK            ; next LBA
+loop .load_kernel
 
 ; --- success! ---
 mov si, msg_success
@@ -100,7 +110,7 @@ dap_stage2:
 dap_kernel:
     db 0x10
     db 0
-    dw 100
+    dw KERNEL_CHUNK
     dw 0x0000
     dw 0x1000
     dq 33
@@ -119,7 +119,7 @@ start32:
     ; COPY KERNEL from 0x10000 to 0x100000 (1MB)
     mov esi, 0x10000        ; source
     mov edi, 0x100000       ; destination
-    mov ecx, 51200          ; 100 sectors * 512 bytes = 51200 bytes
+    mov ecx, 196608         ; 384 sectors * 512 bytes = 196608 bytes
     rep movsb               ; copy byte by byte
 
     ; Check if CPU supports long mode
@@ -0,0 +1,26 @@
+// kernel/boot_info.h - Boot information block handed to the kernel at 0x9000
+
+#ifndef BOOT_INFO_H
+#define BOOT_INFO_H
+
+#include <stdint.h>
+
+#define BOOT_INFO_ADDR 0x9000
+
+// Set in warm_magic when the kernel was entered through kexec, not the BIOS
+#define BOOT_INFO_WARM_MAGIC 0x4345584B  // "KEXC"
+
+// Layout written by boot16.asm (E801 results), extended by kexec
+typedef struct {
+    uint16_t mem_1mb_16mb;      // KB between 1MB and 16MB
+    uint16_t reserved0;
+    uint16_t mem_above_16mb;    // 64KB blocks above 16MB
+    uint16_t reserved1;
+    uint32_t warm_magic;        // BOOT_INFO_WARM_MAGIC after a warm restart
+    uint32_t warm_boots;        // Warm restarts since the last cold boot
+    uint64_t kexec_tsc;         // TSC value when the old kernel jumped away
+} __attribute__((packed)) boot_info_t;
+
+#define BOOT_INFO ((volatile boot_info_t *)BOOT_INFO_ADDR)
+
+#endif // BOOT_INFO_H
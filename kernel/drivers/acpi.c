@@ -0,0 +1,137 @@
+// kernel/drivers/acpi.c - ACPI table discovery (RSDP -> RSDT/XSDT -> tables)
+
+#include "acpi.h"
+#include "../memory/paging.h"
+#include "../lib/string.h"
+#include "../initcall.h"
+
+// Root System Description Pointer
+typedef struct {
+    char signature[8];          // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;           // 0 = ACPI 1.0 (RSDT only), 2+ = XSDT too
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+#define ACPI_MAX_TABLES 32
+
+static acpi_sdt_header_t *tables[ACPI_MAX_TABLES];
+static int table_count = 0;
+
+// Sum of all bytes must be 0
+static bool acpi_checksum_ok(const void *data, uint32_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+// Scan a memory range for the RSDP (16 byte aligned)
+static acpi_rsdp_t *acpi_scan_rsdp(uint64_t start, uint64_t end)
+{
+    for (uint64_t addr = start; addr < end; addr += 16) {
+        acpi_rsdp_t *rsdp = (acpi_rsdp_t *)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 &&
+            acpi_checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+// Find the RSDP in the EBDA or the BIOS area
+static acpi_rsdp_t *acpi_find_rsdp(void)
+{
+    // First KB of the EBDA, segment stored at 0x40E
+    uint64_t ebda = (uint64_t)(*(volatile uint16_t *)0x40E) << 4;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        acpi_rsdp_t *rsdp = acpi_scan_rsdp(ebda, ebda + 1024);
+        if (rsdp) {
+            return rsdp;
+        }
+    }
+    
+    return acpi_scan_rsdp(0xE0000, 0x100000);
+}
+
+// Map a table and check it, returns NULL if it's broken
+static acpi_sdt_header_t *acpi_map_table(uint64_t addr)
+{
+    // Map the header first to learn the length
+    if (!paging_map_identity(addr, sizeof(acpi_sdt_header_t), 0)) {
+        return NULL;
+    }
+    
+    acpi_sdt_header_t *header = (acpi_sdt_header_t *)addr;
+    if (!paging_map_identity(addr, header->length, 0)) {
+        return NULL;
+    }
+    
+    if (!acpi_checksum_ok(header, header->length)) {
+        return NULL;
+    }
+    return header;
+}
+
+// Initialize ACPI
+void acpi_init(void)
+{
+    table_count = 0;
+    
+    acpi_rsdp_t *rsdp = acpi_find_rsdp();
+    if (rsdp == NULL) {
+        return;
+    }
+    
+    bool use_xsdt = rsdp->revision >= 2 && rsdp->xsdt_address != 0;
+    uint64_t root_addr = use_xsdt ? rsdp->xsdt_address : rsdp->rsdt_address;
+    
+    acpi_sdt_header_t *root = acpi_map_table(root_addr);
+    if (root == NULL) {
+        return;
+    }
+    
+    // Entries follow the header: 64-bit pointers in the XSDT, 32-bit in the RSDT
+    int entry_size = use_xsdt ? 8 : 4;
+    int entries = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t *entry = (uint8_t *)root + sizeof(acpi_sdt_header_t);
+    
+    for (int i = 0; i < entries && table_count < ACPI_MAX_TABLES; i++) {
+        uint64_t addr;
+        if (use_xsdt) {
+            addr = *(uint64_t *)(entry + i * 8);
+        } else {
+            addr = *(uint32_t *)(entry + i * 4);
+        }
+        
+        acpi_sdt_header_t *table = acpi_map_table(addr);
+        if (table) {
+            tables[table_count++] = table;
+        }
+    }
+}
+INITCALL(INITCALL_EARLY, acpi_init, NULL);
+
+bool acpi_available(void)
+{
+    return table_count > 0;
+}
+
+// Find a table by signature
+acpi_sdt_header_t *acpi_find_table(const char *signature)
+{
+    for (int i = 0; i < table_count; i++) {
+        if (memcmp(tables[i]->signature, signature, 4) == 0) {
+            return tables[i];
+        }
+    }
+    return NULL;
+}
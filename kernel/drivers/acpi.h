@@ -0,0 +1,40 @@
+// kernel/drivers/acpi.h - ACPI table discovery
+
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Common header of every system description table
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// Generic address structure (HPET, FADT, ...)
+typedef struct {
+    uint8_t address_space;      // 0 = memory, 1 = I/O
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __attribute__((packed)) acpi_gas_t;
+
+// Find the RSDP and map every table it lists
+void acpi_init(void);
+
+// Whether ACPI tables were found
+bool acpi_available(void);
+
+// Find a table by its 4 character signature ("APIC", "HPET", "MCFG", ...)
+acpi_sdt_header_t *acpi_find_table(const char *signature);
+
+#endif // ACPI_H
@@ -0,0 +1,224 @@
+// kernel/drivers/ata.c - ATA PIO disk driver (primary bus, LBA28)
+
+#include "ata.h"
+#include "../lib/io.h"
+#include "../initcall.h"
+#include "timer.h"
+#include "pci.h"
+
+// Primary bus I/O ports
+#define ATA_PRIMARY_IO    0x1F0
+#define ATA_PRIMARY_CTRL  0x3F6
+
+#define ATA_REG_DATA      (ATA_PRIMARY_IO + 0)
+#define ATA_REG_ERROR     (ATA_PRIMARY_IO + 1)
+#define ATA_REG_SECCOUNT  (ATA_PRIMARY_IO + 2)
+#define ATA_REG_LBA_LO    (ATA_PRIMARY_IO + 3)
+#define ATA_REG_LBA_MID   (ATA_PRIMARY_IO + 4)
+#define ATA_REG_LBA_HI    (ATA_PRIMARY_IO + 5)
+#define ATA_REG_DRIVE     (ATA_PRIMARY_IO + 6)
+#define ATA_REG_STATUS    (ATA_PRIMARY_IO + 7)
+#define ATA_REG_COMMAND   (ATA_PRIMARY_IO + 7)
+
+// Status bits
+#define ATA_SR_BSY  0x80
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_DF   0x20
+#define ATA_SR_DRQ  0x08
+#define ATA_SR_ERR  0x01
+
+// Commands
+#define ATA_CMD_READ_SECTORS 0x20
+#define ATA_CMD_IDENTIFY     0xEC
+
+// Device control: nIEN = don't raise IRQ14, we poll
+#define ATA_CTRL_NIEN 0x02
+
+// Give up on a busy drive after this many status reads
+#define ATA_TIMEOUT 1000000
+
+// Give up on IDENTIFY after this long
+#define ATA_PROBE_TIMEOUT_MS 500
+
+// IDENTIFY results
+static bool drive_found = false;
+static char drive_model[41];
+static uint32_t drive_sectors = 0;
+
+// Probe state machine
+static int probe_state = 0;
+static uint64_t probe_start_ms = 0;
+
+// 400ns delay: each alternate status read takes ~100ns
+static void ata_delay(void)
+{
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_PRIMARY_CTRL);
+    }
+}
+
+// Wait until BSY clears and DRQ sets (data ready)
+static bool ata_wait_drq(void)
+{
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
+        uint8_t status = inb(ATA_REG_STATUS);
+        if (status & ATA_SR_BSY) {
+            continue;
+        }
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return false;
+        }
+        if (status & ATA_SR_DRQ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check for a drive on the primary master
+bool ata_present(void)
+{
+    outb(ATA_REG_DRIVE, 0xE0);
+    ata_delay();
+    
+    // A floating bus reads back 0xFF
+    uint8_t status = inb(ATA_REG_STATUS);
+    return status != 0xFF && status != 0;
+}
+
+// Read sectors using LBA28 PIO
+bool ata_read_sectors(uint32_t lba, uint32_t count, void *buffer)
+{
+    if (count == 0 || count > 256) {
+        return false;
+    }
+    
+    uint16_t *buf = (uint16_t *)buffer;
+    
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+    outb(ATA_REG_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));  // Master, LBA mode
+    ata_delay();
+    
+    outb(ATA_REG_SECCOUNT, (uint8_t)count);  // 256 is sent as 0
+    outb(ATA_REG_LBA_LO, (uint8_t)(lba & 0xFF));
+    outb(ATA_REG_LBA_MID, (uint8_t)((lba >> 8) & 0xFF));
+    outb(ATA_REG_LBA_HI, (uint8_t)((lba >> 16) & 0xFF));
+    outb(ATA_REG_COMMAND, ATA_CMD_READ_SECTORS);
+    
+    for (uint32_t s = 0; s < count; s++) {
+        ata_delay();
+        if (!ata_wait_drq()) {
+            return false;
+        }
+        
+        for (int i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+            *buf++ = inw(ATA_REG_DATA);
+        }
+    }
+    
+    return true;
+}
+
+// Copy the byte-swapped, space-padded model string out of IDENTIFY data
+static void ata_copy_model(const uint16_t *identify)
+{
+    for (int i = 0; i < 20; i++) {
+        drive_model[i * 2] = (char)(identify[27 + i] >> 8);
+        drive_model[i * 2 + 1] = (char)(identify[27 + i] & 0xFF);
+    }
+    drive_model[40] = '\0';
+    
+    for (int i = 39; i >= 0 && drive_model[i] == ' '; i--) {
+        drive_model[i] = '\0';
+    }
+}
+
+// IDENTIFY the primary master without blocking: the first call issues the
+// command, later calls check whether the drive has answered yet
+int ata_probe(void)
+{
+    if (probe_state == 0) {
+        if (!ata_present()) {
+            return INITCALL_FAILED;
+        }
+        
+        outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+        outb(ATA_REG_DRIVE, 0xA0);
+        ata_delay();
+        outb(ATA_REG_SECCOUNT, 0);
+        outb(ATA_REG_LBA_LO, 0);
+        outb(ATA_REG_LBA_MID, 0);
+        outb(ATA_REG_LBA_HI, 0);
+        outb(ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+        
+        if (inb(ATA_REG_STATUS) == 0) {
+            return INITCALL_FAILED;  // No drive
+        }
+        
+        probe_start_ms = timer_get_uptime_ms();
+        probe_state = 1;
+        return INITCALL_PENDING;
+    }
+    
+    uint8_t status = inb(ATA_REG_STATUS);
+    
+    if (status & ATA_SR_BSY) {
+        if (timer_get_uptime_ms() - probe_start_ms > ATA_PROBE_TIMEOUT_MS) {
+            return INITCALL_FAILED;
+        }
+        return INITCALL_PENDING;
+    }
+    
+    // ATAPI and SATA devices abort IDENTIFY and set a signature here
+    if (inb(ATA_REG_LBA_MID) != 0 || inb(ATA_REG_LBA_HI) != 0) {
+        return INITCALL_FAILED;
+    }
+    
+    if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+        return INITCALL_FAILED;
+    }
+    
+    if (!(status & ATA_SR_DRQ)) {
+        return INITCALL_PENDING;
+    }
+    
+    uint16_t identify[256];
+    for (int i = 0; i < 256; i++) {
+        identify[i] = inw(ATA_REG_DATA);
+    }
+    
+    ata_copy_model(identify);
+    drive_sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    drive_found = true;
+    
+    return INITCALL_DONE;
+}
+ASYNC_INITCALL(INITCALL_DEVICE, ata_probe, NULL);
+
+// Claim the IDE controller if its primary channel sits at the legacy ports
+// (prog IF bit 0 clear = compatibility mode), which is all this driver speaks
+static bool ata_pci_probe(pci_device_t *dev)
+{
+    return !(dev->prog_if & 0x01);
+}
+
+static const pci_driver_t ata_pci_driver = {
+    "ata", PCI_ANY_ID, PCI_ANY_ID, 0x01, 0x01, ata_pci_probe
+};
+
+static void ata_pci_init(void)
+{
+    pci_register_driver(&ata_pci_driver);
+}
+INITCALL(INITCALL_DEVICE, ata_pci_init, "pci_init");
+
+// Get drive details
+bool ata_get_info(const char **model, uint32_t *sectors)
+{
+    if (!drive_found) {
+        return false;
+    }
+    if (model) *model = drive_model;
+    if (sectors) *sectors = drive_sectors;
+    return true;
+}
@@ -0,0 +1,23 @@
+// kernel/drivers/ata.h - ATA PIO disk driver (primary bus)
+
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ATA_SECTOR_SIZE 512
+
+// Check that a drive is attached to the primary master
+bool ata_present(void);
+
+// Asynchronous IDENTIFY probe (polled initcall)
+int ata_probe(void);
+
+// Drive details from IDENTIFY, false if the probe found nothing (yet)
+bool ata_get_info(const char **model, uint32_t *sectors);
+
+// Read count sectors (1-256) starting at lba into buffer (polling, no IRQ)
+bool ata_read_sectors(uint32_t lba, uint32_t count, void *buffer);
+
+#endif // ATA_H
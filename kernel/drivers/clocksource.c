@@ -0,0 +1,124 @@
+// kernel/drivers/clocksource.c - Free-running counters that keep time
+//
+// Time is base_ns plus the scaled counter delta since the current
+// clocksource took over, so switching sources never makes it go backwards.
+
+#include "clocksource.h"
+#include "../lib/cpu.h"
+#include <stddef.h>
+
+#define CPUID_EXT_POWER        0x80000007
+#define CPUID_INVARIANT_TSC    (1u << 8)    // 0x80000007 EDX
+#define CPUID_HYPERVISOR       (1u << 31)   // Leaf 1 ECX
+
+static clocksource_t *current = NULL;
+static uint64_t base_cycles = 0;
+static uint64_t base_ns = 0;
+
+// Scale with a 128-bit product so long uptimes don't overflow
+static inline uint64_t clocksource_scale(const clocksource_t *cs, uint64_t cycles)
+{
+    return (uint64_t)(((unsigned __int128)cycles * cs->mult) >> CLOCKSOURCE_SHIFT);
+}
+
+void clocksource_register(clocksource_t *cs)
+{
+    if (cs == NULL || cs->khz == 0 || cs->read == NULL) {
+        return;
+    }
+    cs->mult = (1000000ULL << CLOCKSOURCE_SHIFT) / cs->khz;
+    
+    if (current != NULL && cs->rating <= current->rating) {
+        return;
+    }
+    
+    // Carry the time over to the new counter
+    uint64_t flags = irq_save();
+    base_ns = clocksource_ns();
+    base_cycles = cs->read();
+    current = cs;
+    irq_restore(flags);
+}
+
+const clocksource_t *clocksource_get(void)
+{
+    return current;
+}
+
+uint64_t clocksource_cycles(void)
+{
+    return current ? current->read() : 0;
+}
+
+uint64_t clocksource_ns(void)
+{
+    if (current == NULL) {
+        return 0;
+    }
+    return clocksource_ns_at(current->read());
+}
+
+uint64_t clocksource_ns_at(uint64_t cycles)
+{
+    if (current == NULL) {
+        return 0;
+    }
+    return base_ns + clocksource_scale(current, cycles - base_cycles);
+}
+
+uint64_t clocksource_cycles_to_ns(uint64_t cycles)
+{
+    return current ? clocksource_scale(current, cycles) : 0;
+}
+
+// --- TSC ---
+
+static uint64_t tsc_read(void)
+{
+    return rdtsc();
+}
+
+static clocksource_t tsc_clocksource = {
+    "tsc", 0, tsc_read, 0, true, 0
+};
+
+bool clocksource_is_tsc(void)
+{
+    return current == &tsc_clocksource;
+}
+
+bool clocksource_tsc_invariant(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < CPUID_EXT_POWER) {
+        return false;
+    }
+    cpuid(CPUID_EXT_POWER, 0, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_INVARIANT_TSC) != 0;
+}
+
+// Invariant TSCs are perfect. Hypervisors hide the invariant bit more often
+// than not but still give guests a constant rate TSC, so that's good enough.
+// Bare metal without it may change rate with the CPU clock: counting ticks
+// is better then.
+void clocksource_tsc_init(uint64_t khz, bool calibration_stable)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    
+    int rating;
+    if (!calibration_stable) {
+        rating = CLOCKSOURCE_RATING_UNSTABLE;
+    } else if (clocksource_tsc_invariant()) {
+        rating = CLOCKSOURCE_RATING_PERFECT;
+    } else if (ecx & CPUID_HYPERVISOR) {
+        rating = CLOCKSOURCE_RATING_GOOD;
+    } else {
+        rating = CLOCKSOURCE_RATING_UNSTABLE;
+    }
+    
+    tsc_clocksource.rating = rating;
+    tsc_clocksource.khz = khz;
+    clocksource_register(&tsc_clocksource);
+}
@@ -0,0 +1,56 @@
+// kernel/drivers/clocksource.h - Free-running counters that keep time
+
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Ratings (higher wins)
+#define CLOCKSOURCE_RATING_UNSTABLE 50    // Worse than counting ticks
+#define CLOCKSOURCE_RATING_JIFFIES  100
+#define CLOCKSOURCE_RATING_HPET     200   // Steady but an MMIO read (a VM exit when virtualised)
+#define CLOCKSOURCE_RATING_GOOD     250
+#define CLOCKSOURCE_RATING_PERFECT  300
+
+typedef struct {
+    const char *name;
+    int rating;
+    uint64_t (*read)(void);
+    uint64_t khz;               // Counts per millisecond
+    bool continuous;            // Keeps counting with the tick stopped (tickless needs it)
+
+    // Filled in by clocksource_register(): ns = (cycles * mult) >> CLOCKSOURCE_SHIFT
+    uint64_t mult;
+} clocksource_t;
+
+#define CLOCKSOURCE_SHIFT 32
+
+// Offer a clocksource, it's used if it rates higher than the current one
+void clocksource_register(clocksource_t *cs);
+
+// Calibrated TSC: rated by whether it's invariant (and how the calibration went)
+void clocksource_tsc_init(uint64_t khz, bool calibration_stable);
+
+// Whether CPUID advertises an invariant TSC (constant rate, runs in deep C-states)
+bool clocksource_tsc_invariant(void);
+
+// Clocksource in use (NULL before the first registration)
+const clocksource_t *clocksource_get(void);
+
+// Raw counter of the current clocksource
+uint64_t clocksource_cycles(void);
+
+// Nanoseconds since the first clocksource was registered
+uint64_t clocksource_ns(void);
+
+// Nanoseconds since boot at a counter value read earlier
+uint64_t clocksource_ns_at(uint64_t cycles);
+
+// Whether time is currently kept by the TSC (so rdtsc can be scaled directly)
+bool clocksource_is_tsc(void);
+
+// Convert a counter delta of the current clocksource
+uint64_t clocksource_cycles_to_ns(uint64_t cycles);
+
+#endif // CLOCKSOURCE_H
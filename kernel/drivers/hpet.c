@@ -0,0 +1,187 @@
+// kernel/drivers/hpet.c - High Precision Event Timer
+//
+// The HPET is a memory mapped 64-bit counter (usually 10-25 MHz) with a few
+// comparators. Reading time is one MMIO load instead of the PIT's latch and
+// two port reads, and it keeps a steady rate whatever the CPU clock does.
+// Comparator 0 takes over ISA IRQ 0 from the PIT in legacy replacement mode,
+// which works without knowing how the board wired the other routes.
+
+#include "hpet.h"
+#include "acpi.h"
+#include "clocksource.h"
+#include "../memory/paging.h"
+#include <stddef.h>
+
+// General registers
+#define HPET_CAPABILITIES  0x000
+#define HPET_CONFIG        0x010
+#define HPET_COUNTER       0x0F0
+
+// Comparator n registers
+#define HPET_TIMER_CONFIG(n)     (0x100 + 0x20 * (n))
+#define HPET_TIMER_COMPARATOR(n) (0x108 + 0x20 * (n))
+
+// Capabilities
+#define HPET_CAP_COUNTER_64    (1ULL << 13)
+#define HPET_CAP_LEGACY_ROUTE  (1ULL << 15)
+#define HPET_CAP_PERIOD_SHIFT  32           // Femtoseconds per count
+
+// General configuration
+#define HPET_CONFIG_ENABLE     (1ULL << 0)
+#define HPET_CONFIG_LEGACY     (1ULL << 1)  // Timer 0 -> IRQ 0, timer 1 -> IRQ 8
+
+// Comparator configuration
+#define HPET_TIMER_LEVEL       (1ULL << 1)
+#define HPET_TIMER_ENABLE      (1ULL << 2)
+#define HPET_TIMER_PERIODIC    (1ULL << 3)
+#define HPET_TIMER_PERIODIC_CAP (1ULL << 4)
+#define HPET_TIMER_64BIT_CAP   (1ULL << 5)
+#define HPET_TIMER_SET_VALUE   (1ULL << 6)  // Next comparator write sets the accumulator
+#define HPET_TIMER_32BIT_MODE  (1ULL << 8)
+
+// The spec allows up to 100ns per count
+#define HPET_MAX_PERIOD_FS 100000000ULL
+
+// Shortest one-shot delay, a comparator written too close to the counter
+// may already have been passed
+#define HPET_MIN_DELTA_US 2
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t event_timer_block_id;
+    acpi_gas_t address;
+    uint8_t hpet_number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed)) hpet_table_t;
+
+static volatile uint8_t *hpet_base = NULL;
+static uint64_t hpet_khz = 0;
+static bool timer0_periodic = false;
+static bool timer0_64bit = false;
+
+static inline uint64_t hpet_read(uint32_t reg)
+{
+    return *(volatile uint64_t *)(hpet_base + reg);
+}
+
+static inline void hpet_write(uint32_t reg, uint64_t value)
+{
+    *(volatile uint64_t *)(hpet_base + reg) = value;
+}
+
+uint64_t hpet_read_counter(void)
+{
+    return hpet_read(HPET_COUNTER);
+}
+
+static clocksource_t hpet_clocksource = {
+    "hpet", CLOCKSOURCE_RATING_HPET, hpet_read_counter, 0, true, 0
+};
+
+bool hpet_init(void)
+{
+    hpet_table_t *table = (hpet_table_t *)acpi_find_table("HPET");
+    if (table == NULL || table->address.address_space != 0 || table->address.address == 0) {
+        return false;
+    }
+    if (!paging_map_mmio(table->address.address, 0x1000)) {
+        return false;
+    }
+    hpet_base = (volatile uint8_t *)table->address.address;
+    
+    // A 32-bit counter wraps within minutes, too soon to keep time with
+    uint64_t caps = hpet_read(HPET_CAPABILITIES);
+    uint64_t period_fs = caps >> HPET_CAP_PERIOD_SHIFT;
+    if (period_fs == 0 || period_fs > HPET_MAX_PERIOD_FS ||
+        !(caps & HPET_CAP_COUNTER_64) || !(caps & HPET_CAP_LEGACY_ROUTE)) {
+        hpet_base = NULL;
+        return false;
+    }
+    hpet_khz = 1000000000000ULL / period_fs;
+    
+    uint64_t timer0 = hpet_read(HPET_TIMER_CONFIG(0));
+    timer0_periodic = (timer0 & HPET_TIMER_PERIODIC_CAP) != 0;
+    timer0_64bit = (timer0 & HPET_TIMER_64BIT_CAP) != 0;
+    hpet_write(HPET_TIMER_CONFIG(0), timer0 & ~(HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC));
+    
+    // Count from wherever the firmware left it, the clocksource takes the base
+    hpet_write(HPET_CONFIG, (hpet_read(HPET_CONFIG) & ~HPET_CONFIG_LEGACY) | HPET_CONFIG_ENABLE);
+    
+    hpet_clocksource.khz = hpet_khz;
+    clocksource_register(&hpet_clocksource);
+    return true;
+}
+
+bool hpet_is_present(void)
+{
+    return hpet_base != NULL;
+}
+
+uint64_t hpet_get_khz(void)
+{
+    return hpet_khz;
+}
+
+bool hpet_can_periodic(void)
+{
+    return timer0_periodic;
+}
+
+// Comparator 0 edge triggered on IRQ 0, in the given mode
+static void hpet_timer0_config(uint64_t mode)
+{
+    hpet_write(HPET_CONFIG, hpet_read(HPET_CONFIG) | HPET_CONFIG_LEGACY);
+    
+    uint64_t config = hpet_read(HPET_TIMER_CONFIG(0));
+    config &= ~(HPET_TIMER_LEVEL | HPET_TIMER_PERIODIC | HPET_TIMER_32BIT_MODE);
+    config |= HPET_TIMER_ENABLE | mode;
+    if (!timer0_64bit) {
+        config |= HPET_TIMER_32BIT_MODE;
+    }
+    hpet_write(HPET_TIMER_CONFIG(0), config);
+}
+
+void hpet_set_periodic(uint64_t cycles)
+{
+    // The first write sets the first expiry, the second the period
+    hpet_timer0_config(HPET_TIMER_PERIODIC | HPET_TIMER_SET_VALUE);
+    hpet_write(HPET_TIMER_COMPARATOR(0), hpet_read_counter() + cycles);
+    hpet_write(HPET_TIMER_COMPARATOR(0), cycles);
+}
+
+void hpet_set_oneshot(uint64_t cycles)
+{
+    uint64_t min = hpet_khz * HPET_MIN_DELTA_US / 1000;
+    if (cycles < min) {
+        cycles = min;
+    }
+    
+    hpet_timer0_config(0);
+    
+    // The comparator only matches once, so if the counter got past it while
+    // we were writing it, try again further out
+    for (;;) {
+        uint64_t expiry = hpet_read_counter() + cycles;
+        hpet_write(HPET_TIMER_COMPARATOR(0), expiry);
+        
+        uint64_t now = hpet_read_counter();
+        bool passed = timer0_64bit ? (int64_t)(now - expiry) >= 0
+                                   : (int32_t)((uint32_t)now - (uint32_t)expiry) >= 0;
+        if (!passed) {
+            break;
+        }
+        cycles *= 2;
+    }
+}
+
+// Give IRQ 0 back to the PIT, the main counter keeps running
+void hpet_stop(void)
+{
+    if (hpet_base == NULL) {
+        return;
+    }
+    hpet_write(HPET_TIMER_CONFIG(0),
+               hpet_read(HPET_TIMER_CONFIG(0)) & ~(HPET_TIMER_ENABLE | HPET_TIMER_PERIODIC));
+    hpet_write(HPET_CONFIG, hpet_read(HPET_CONFIG) & ~HPET_CONFIG_LEGACY);
+}
@@ -0,0 +1,25 @@
+// kernel/drivers/hpet.h - High Precision Event Timer
+
+#ifndef HPET_H
+#define HPET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Find the HPET through its ACPI table, start the main counter and offer it
+// as a clocksource. Returns false if there is no usable HPET.
+bool hpet_init(void);
+
+bool hpet_is_present(void);
+
+// Main counter (one MMIO load) and its rate
+uint64_t hpet_read_counter(void);
+uint64_t hpet_get_khz(void);
+
+// Comparator 0, delivered on ISA IRQ 0 (legacy replacement route)
+bool hpet_can_periodic(void);
+void hpet_set_periodic(uint64_t cycles);
+void hpet_set_oneshot(uint64_t cycles);
+void hpet_stop(void);
+
+#endif // HPET_H
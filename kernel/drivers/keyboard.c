@@ -2,17 +2,39 @@
 
 #include "keyboard.h"
 #include "screen.h"
+#include "timer.h"
 #include "../interrupts/isr.h"
+#include "../interrupts/softirq.h"
+#include "../sched/wait.h"
 #include "../lib/io.h"
+#include "../lib/cpu.h"
 #include "../lib/string.h"
+#include "../lib/ring.h"
+#include "../initcall.h"
 
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
 
-// Circular buffer - use unsigned char for special keys
+// Characters for readers, filled by the tasklet - unsigned char for special keys
 static unsigned char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
-static volatile int buffer_start = 0;
-static volatile int buffer_end = 0;
+static ring_t key_ring;
+
+// Raw scancodes queued by the IRQ handler, translated in the keyboard tasklet
+#define SCANCODE_BUFFER_SIZE 64
+static uint8_t scancode_buffer[SCANCODE_BUFFER_SIZE];
+static ring_t scancode_ring;
+static tasklet_t keyboard_tasklet;
+
+// Threads in keyboard_getchar()
+static wait_queue_t key_waiters = WAIT_QUEUE_INIT;
+
+// Gets Ctrl+C instead of the input
+static keyboard_break_handler_t break_handler = NULL;
+
+// Output to show above the line being read (keyboard_set_output_handler)
+static bool (*output_pending)(void) = NULL;
+static void (*output_print)(void) = NULL;
+static volatile bool poked = false;
 
 // Keyboard state
 static bool shift_pressed = false;
@@ -40,40 +62,29 @@ static const char scancode_to_ascii_shift[] = {
     '*', 0, ' '
 };
 
-// Add to buffer
+// Add to buffer (a full buffer counts the key as dropped)
 static void buffer_add(unsigned char c)
 {
-    int next = (buffer_end + 1) % KEYBOARD_BUFFER_SIZE;
-    if (next != buffer_start) {
-        keyboard_buffer[buffer_end] = c;
-        buffer_end = next;
-    }
+    ring_push(&key_ring, &c);
 }
 
 // Get from buffer
 static unsigned char buffer_get(void)
 {
-    if (buffer_start == buffer_end) {
-        return 0;
-    }
-    unsigned char c = keyboard_buffer[buffer_start];
-    buffer_start = (buffer_start + 1) % KEYBOARD_BUFFER_SIZE;
+    unsigned char c = 0;
+    ring_pop(&key_ring, &c);
     return c;
 }
 
-// Keyboard interrupt handler
-static void keyboard_handler(registers_t *regs)
+// Translate one scancode into the character buffer (tasklet context)
+static void keyboard_process_scancode(uint8_t scancode)
 {
-    (void)regs;
-    
-    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
-    
     // Check for extended scancode prefix (0xE0)
     if (scancode == 0xE0) {
         extended_scancode = true;
         return;
     }
-
+    
     // Handle key release
     if (scancode & 0x80) {
         scancode &= 0x7F;
@@ -152,40 +163,105 @@ static void keyboard_handler(registers_t *regs)
         }
     }
     
+    if (ctrl_pressed && (c == 'c' || c == 'C') && break_handler) {
+        break_handler();
+        return;
+    }
+    
     if (c != 0) {
         buffer_add((unsigned char)c);
     }
 }
 
+// Keyboard tasklet: translate everything the IRQ handler queued
+static void keyboard_tasklet_fn(uint64_t data)
+{
+    (void)data;
+    
+    uint8_t scancodes[16];
+    uint32_t count;
+    while ((count = ring_pop_batch(&scancode_ring, scancodes, sizeof(scancodes))) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            keyboard_process_scancode(scancodes[i]);
+        }
+    }
+    
+    if (keyboard_available()) {
+        wake_up(&key_waiters);
+    }
+}
+
+// Keyboard interrupt handler - just grab the scancode, the tasklet does the rest.
+// Runs on the fast IRQ path: it never looks at the interrupted registers.
+static void keyboard_handler(int vector)
+{
+    (void)vector;
+    
+    uint8_t scancode = inb(KEYBOARD_DATA_PORT);
+    
+    ring_push(&scancode_ring, &scancode);
+    
+    tasklet_schedule(&keyboard_tasklet);
+}
+
 // Initialize keyboard
 void keyboard_init(void)
 {
-    buffer_start = 0;
-    buffer_end = 0;
+    ring_init(&key_ring, keyboard_buffer, KEYBOARD_BUFFER_SIZE, 1);
+    ring_init(&scancode_ring, scancode_buffer, SCANCODE_BUFFER_SIZE, 1);
     shift_pressed = false;
     caps_lock = false;
     ctrl_pressed = false;
     alt_pressed = false;
     extended_scancode = false;
     
-    irq_install_handler(1, keyboard_handler);
+    tasklet_init(&keyboard_tasklet, keyboard_tasklet_fn, 0);
+    irq_install_fast_handler(IRQ_BASE_VECTOR + 1, keyboard_handler);
 }
+INITCALL(INITCALL_CONSOLE, keyboard_init, NULL);
 
 // Check if key available
 bool keyboard_available(void)
 {
-    return buffer_start != buffer_end;
+    return !ring_empty(&key_ring);
+}
+
+void keyboard_set_break_handler(keyboard_break_handler_t handler)
+{
+    break_handler = handler;
+}
+
+void keyboard_set_output_handler(bool (*pending)(void), void (*print)(void))
+{
+    output_pending = pending;
+    output_print = print;
+}
+
+void keyboard_poke(void)
+{
+    wake_up_set(&key_waiters, &poked);
+}
+
+uint64_t keyboard_get_dropped(void)
+{
+    return key_ring.dropped + scancode_ring.dropped;
 }
 
 // Get character (blocking)
 unsigned char keyboard_getchar(void)
 {
-    while (!keyboard_available()) {
-        __asm__ volatile ("hlt");
-    }
+    wait_event(&key_waiters, keyboard_available());
     return buffer_get();
 }
 
+// keyboard_getchar(), or 0 once keyboard_poke() was called
+static unsigned char keyboard_getchar_or_poke(void)
+{
+    wait_event(&key_waiters, keyboard_available() || poked);
+    poked = false;
+    return keyboard_available() ? buffer_get() : 0;
+}
+
 // Read line with history support
 void keyboard_readline_history(char *buffer, int max_length,
                                 char history[][256], int history_max, 
@@ -200,9 +276,34 @@ void keyboard_readline_history(char *buffer, int max_length,
     int start_x, start_y;
     screen_get_cursor(&start_x, &start_y);
     
+    // Where the input starts, to redraw it under new output
+    int line_x = start_x, line_y = start_y;
+    
     while (pos < max_length - 1) {
         screen_invert_color();
-        unsigned char c = keyboard_getchar();
+        unsigned char c = keyboard_getchar_or_poke();
+        
+        if (c == 0) {
+            screen_invert_color();
+            if (!output_pending || !output_pending()) {
+                continue;
+            }
+            
+            // Clear the prompt and input, print the output from column 0
+            // (the handler ends with a new prompt) and type the input again
+            int len = line_x + (int)strlen(buffer);
+            screen_set_cursor(0, line_y);
+            for (int i = 0; i < len && i < SCREEN_WIDTH; i++) {
+                screen_putchar(' ');
+            }
+            screen_set_cursor(0, line_y);
+            output_print();
+            
+            screen_get_cursor(&line_x, &line_y);
+            screen_write(buffer);
+            screen_set_cursor(line_x + pos, line_y);
+            continue;
+        }
         
         screen_get_cursor(&start_x, &start_y);
         if (c == '\n') {
@@ -283,7 +384,7 @@ void keyboard_readline_history(char *buffer, int max_length,
         else if(c == KEY_LEFT_ARROW){
             //  if use ctrl just to start of line (0 is reserved so the line starts at x = 1).
             screen_invert_color();
-
+            
             if(ctrl_pressed){
                 pos = 0;
                 screen_set_cursor(2, start_y);
@@ -6,7 +6,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-// Keyboard buffer size
+// Keyboard buffer size (a power of two, see lib/ring.h)
 #define KEYBOARD_BUFFER_SIZE 256
 
 // Special key codes (use unsigned char/uint8_t to hold values > 127)
@@ -28,6 +28,23 @@ void keyboard_init(void);
 // Check if a key is available
 bool keyboard_available(void);
 
+// Called from the keyboard tasklet on Ctrl+C, which then isn't queued as input
+typedef void (*keyboard_break_handler_t)(void);
+void keyboard_set_break_handler(keyboard_break_handler_t handler);
+
+// Output (background jobs) to show while keyboard_readline_history() waits:
+// after keyboard_poke(), if pending() says so, the line being typed is
+// cleared, print() is called at the start of its row and the line is
+// redrawn where print() left the cursor.
+void keyboard_set_output_handler(bool (*pending)(void), void (*print)(void));
+
+// Wake keyboard_readline_history() to look at the output handler. Safe from
+// timer callbacks.
+void keyboard_poke(void);
+
+// Keys lost because a buffer was full
+uint64_t keyboard_get_dropped(void);
+
 // Get a character from the keyboard (blocking)
 // Returns unsigned char to support special keys > 127
 unsigned char keyboard_getchar(void);
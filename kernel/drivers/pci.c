@@ -0,0 +1,658 @@
+// kernel/drivers/pci.c - PCI configuration space, bus scan, BARs and MSI/MSI-X
+
+#include "pci.h"
+#include "acpi.h"
+#include "../interrupts/apic.h"
+#include "../interrupts/irqbalance.h"
+#include "../memory/paging.h"
+#include "../lib/io.h"
+#include "../lib/cpu.h"
+#include "../lib/string.h"
+#include "../initcall.h"
+
+// Legacy configuration mechanism #1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+// MSI capability layout
+#define MSI_CONTROL        0x02
+#define MSI_ADDRESS_LO     0x04
+#define MSI_ADDRESS_HI     0x08     // 64-bit capable functions only
+#define MSI_DATA_32        0x08
+#define MSI_DATA_64        0x0C
+#define MSI_CONTROL_ENABLE 0x0001
+#define MSI_CONTROL_MME    0x0070   // Multiple message enable
+#define MSI_CONTROL_64BIT  0x0080
+
+// MSI-X capability layout
+#define MSIX_CONTROL       0x02
+#define MSIX_TABLE         0x04     // Offset into the BAR, BAR index in bits 0-2
+#define MSIX_CONTROL_SIZE  0x07FF
+#define MSIX_CONTROL_MASK  0x4000   // Function mask
+#define MSIX_CONTROL_ENABLE 0x8000
+#define MSIX_ENTRY_SIZE    16
+#define MSIX_VECTOR_MASKED 0x1
+
+// Message address for the LAPIC of a given APIC ID (fixed delivery, physical mode)
+#define MSI_ADDRESS_BASE   0xFEE00000
+#define MSI_ADDRESS(apic_id) (MSI_ADDRESS_BASE | ((uint32_t)(apic_id) << 12))
+
+// ACPI MCFG table: header, 8 reserved bytes, then one entry per segment group
+typedef struct {
+    uint64_t base;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__((packed)) mcfg_entry_t;
+
+// ECAM window for segment 0 (0 = use the I/O ports)
+static uint64_t ecam_base = 0;
+static uint8_t ecam_start_bus = 0;
+static uint8_t ecam_end_bus = 0;
+
+static pci_device_t devices[PCI_MAX_DEVICES];
+static int device_count = 0;
+
+static const pci_driver_t *drivers[PCI_MAX_DRIVERS];
+static int driver_count = 0;
+
+// Where each MSI/MSI-X vector comes from, so its target can be changed later
+typedef struct {
+    pci_device_t *dev;
+    int entry;                  // MSI-X table entry, -1 for MSI
+} pci_msi_route_t;
+
+static pci_msi_route_t msi_routes[IDT_ENTRIES];
+
+// Buses already scanned (guards against badly programmed bridges)
+static uint64_t bus_scanned[256 / 64];
+
+// ECAM address of a register, 0 if the bus isn't covered
+static uint64_t pci_ecam_address(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset)
+{
+    if (ecam_base == 0 || bus < ecam_start_bus || bus > ecam_end_bus) {
+        return 0;
+    }
+    return ecam_base + ((uint64_t)(bus - ecam_start_bus) << 20) +
+           ((uint64_t)device << 15) + ((uint64_t)function << 12) + offset;
+}
+
+// Select a dword for the legacy mechanism (caller has interrupts off)
+static void pci_port_select(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset)
+{
+    uint32_t address = 0x80000000 | ((uint32_t)bus << 16) | ((uint32_t)device << 11) |
+                       ((uint32_t)function << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDRESS, address);
+}
+
+uint32_t pci_read32(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset)
+{
+    uint64_t ecam = pci_ecam_address(bus, device, function, offset);
+    if (ecam) {
+        return mmio_read32(ecam);
+    }
+    
+    // The ports only reach the first 256 bytes
+    if (offset >= 256) {
+        return 0xFFFFFFFF;
+    }
+    
+    uint64_t flags = irq_save();
+    pci_port_select(bus, device, function, offset);
+    uint32_t value = inl(PCI_CONFIG_DATA);
+    irq_restore(flags);
+    return value;
+}
+
+uint16_t pci_read16(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset)
+{
+    return (uint16_t)(pci_read32(bus, device, function, offset & ~3) >> ((offset & 2) * 8));
+}
+
+uint8_t pci_read8(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset)
+{
+    return (uint8_t)(pci_read32(bus, device, function, offset & ~3) >> ((offset & 3) * 8));
+}
+
+void pci_write32(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint32_t value)
+{
+    uint64_t ecam = pci_ecam_address(bus, device, function, offset);
+    if (ecam) {
+        mmio_write32(ecam, value);
+        return;
+    }
+    
+    if (offset >= 256) {
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    pci_port_select(bus, device, function, offset);
+    outl(PCI_CONFIG_DATA, value);
+    irq_restore(flags);
+}
+
+// 16-bit writes can't be done as read-modify-write of the dword: that would
+// write back RW1C status bits next to the command register
+void pci_write16(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint16_t value)
+{
+    uint64_t ecam = pci_ecam_address(bus, device, function, offset);
+    if (ecam) {
+        *(volatile uint16_t *)ecam = value;
+        return;
+    }
+    
+    if (offset >= 256) {
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    pci_port_select(bus, device, function, offset);
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+    irq_restore(flags);
+}
+
+bool pci_uses_ecam(void)
+{
+    return ecam_base != 0;
+}
+
+// Find the segment 0 ECAM window in the MCFG and map it
+static void pci_init_ecam(void)
+{
+    acpi_sdt_header_t *mcfg = acpi_find_table("MCFG");
+    if (mcfg == NULL) {
+        return;
+    }
+    
+    uint8_t *start = (uint8_t *)mcfg + sizeof(acpi_sdt_header_t) + 8;
+    int entries = (mcfg->length - sizeof(acpi_sdt_header_t) - 8) / sizeof(mcfg_entry_t);
+    
+    for (int i = 0; i < entries; i++) {
+        mcfg_entry_t *entry = (mcfg_entry_t *)(start + i * sizeof(mcfg_entry_t));
+        if (entry->segment != 0 || entry->end_bus < entry->start_bus) {
+            continue;
+        }
+        
+        // 1MB of config space per bus
+        uint64_t size = (uint64_t)(entry->end_bus - entry->start_bus + 1) << 20;
+        if (!paging_map_mmio(entry->base, size)) {
+            return;
+        }
+        
+        ecam_start_bus = entry->start_bus;
+        ecam_end_bus = entry->end_bus;
+        ecam_base = entry->base;
+        return;
+    }
+}
+
+// Size and decode one BAR, returns how many BAR slots it used (2 for 64-bit)
+static int pci_read_bar(pci_device_t *dev, int index)
+{
+    uint8_t b = dev->bus, d = dev->device, f = dev->function;
+    uint16_t offset = PCI_BAR0 + index * 4;
+    pci_bar_t *bar = &dev->bars[index];
+    
+    uint32_t original = pci_read32(b, d, f, offset);
+    pci_write32(b, d, f, offset, 0xFFFFFFFF);
+    uint32_t mask = pci_read32(b, d, f, offset);
+    pci_write32(b, d, f, offset, original);
+    
+    if (mask == 0 || mask == 0xFFFFFFFF) {
+        return 1;
+    }
+    
+    if (original & 0x1) {
+        bar->is_io = true;
+        bar->address = original & ~0x3U;
+        bar->size = (uint16_t)(~(mask & ~0x3U) + 1);
+        return 1;
+    }
+    
+    bar->prefetchable = (original & 0x8) != 0;
+    bar->address = original & ~0xFU;
+    uint64_t size_mask = 0xFFFFFFFF00000000ULL | (mask & ~0xFU);
+    
+    if (((original >> 1) & 0x3) == 0x2 && index + 1 < PCI_BAR_COUNT) {
+        uint32_t original_hi = pci_read32(b, d, f, offset + 4);
+        pci_write32(b, d, f, offset + 4, 0xFFFFFFFF);
+        uint32_t mask_hi = pci_read32(b, d, f, offset + 4);
+        pci_write32(b, d, f, offset + 4, original_hi);
+        
+        bar->is_64bit = true;
+        bar->address |= (uint64_t)original_hi << 32;
+        size_mask = ((uint64_t)mask_hi << 32) | (mask & ~0xFU);
+        bar->size = ~size_mask + 1;
+        return 2;
+    }
+    
+    bar->size = (uint32_t)(~size_mask + 1);
+    return 1;
+}
+
+// Walk the capability list and note MSI/MSI-X
+static void pci_read_capabilities(pci_device_t *dev)
+{
+    uint8_t b = dev->bus, d = dev->device, f = dev->function;
+    
+    if (!(pci_read16(b, d, f, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return;
+    }
+    
+    uint8_t cap = pci_read8(b, d, f, PCI_CAP_POINTER) & 0xFC;
+    for (int guard = 0; cap != 0 && guard < 48; guard++) {
+        uint8_t id = pci_read8(b, d, f, cap);
+        if (id == PCI_CAP_MSI) {
+            dev->msi_cap = cap;
+        } else if (id == PCI_CAP_MSIX) {
+            dev->msix_cap = cap;
+            dev->msix_count = (pci_read16(b, d, f, cap + MSIX_CONTROL) & MSIX_CONTROL_SIZE) + 1;
+        }
+        cap = pci_read8(b, d, f, cap + 1) & 0xFC;
+    }
+}
+
+static void pci_scan_bus(uint8_t bus);
+
+// Record one function, descend into bridges
+static void pci_scan_function(uint8_t bus, uint8_t device, uint8_t function)
+{
+    if (device_count >= PCI_MAX_DEVICES) {
+        return;
+    }
+    
+    pci_device_t *dev = &devices[device_count++];
+    memset(dev, 0, sizeof(pci_device_t));
+    
+    dev->bus = bus;
+    dev->device = device;
+    dev->function = function;
+    dev->vendor_id = pci_read16(bus, device, function, PCI_VENDOR_ID);
+    dev->device_id = pci_read16(bus, device, function, PCI_DEVICE_ID);
+    dev->revision = pci_read8(bus, device, function, PCI_REVISION);
+    dev->prog_if = pci_read8(bus, device, function, PCI_PROG_IF);
+    dev->subclass = pci_read8(bus, device, function, PCI_SUBCLASS);
+    dev->class_code = pci_read8(bus, device, function, PCI_CLASS);
+    dev->header_type = pci_read8(bus, device, function, PCI_HEADER_TYPE) & 0x7F;
+    dev->irq_line = pci_read8(bus, device, function, PCI_INTERRUPT_LINE);
+    dev->msi_vector = -1;
+    
+    // Decoding stays off while the BARs are sized
+    uint16_t command = pci_read16(bus, device, function, PCI_COMMAND);
+    pci_write16(bus, device, function, PCI_COMMAND,
+                command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+    
+    int bar_count = dev->header_type == 0 ? 6 : (dev->header_type == 1 ? 2 : 0);
+    for (int i = 0; i < bar_count; ) {
+        i += pci_read_bar(dev, i);
+    }
+    
+    pci_write16(bus, device, function, PCI_COMMAND, command);
+    
+    pci_read_capabilities(dev);
+    
+    // PCI-to-PCI bridge
+    if (dev->header_type == 1) {
+        pci_scan_bus(pci_read8(bus, device, function, PCI_SECONDARY_BUS));
+    }
+}
+
+static void pci_scan_bus(uint8_t bus)
+{
+    uint64_t bit = 1ULL << (bus % 64);
+    if (bus_scanned[bus / 64] & bit) {
+        return;
+    }
+    bus_scanned[bus / 64] |= bit;
+    
+    for (uint8_t device = 0; device < 32; device++) {
+        if (pci_read16(bus, device, 0, PCI_VENDOR_ID) == 0xFFFF) {
+            continue;
+        }
+        
+        bool multi = (pci_read8(bus, device, 0, PCI_HEADER_TYPE) & 0x80) != 0;
+        for (uint8_t function = 0; function < (multi ? 8 : 1); function++) {
+            if (pci_read16(bus, device, function, PCI_VENDOR_ID) != 0xFFFF) {
+                pci_scan_function(bus, device, function);
+            }
+        }
+    }
+}
+
+// Whether a driver's match entry fits a device
+static bool pci_driver_matches(const pci_driver_t *driver, const pci_device_t *dev)
+{
+    return (driver->vendor_id == PCI_ANY_ID || driver->vendor_id == dev->vendor_id) &&
+           (driver->device_id == PCI_ANY_ID || driver->device_id == dev->device_id) &&
+           (driver->class_code == PCI_ANY_CLASS || driver->class_code == dev->class_code) &&
+           (driver->subclass == PCI_ANY_CLASS || driver->subclass == dev->subclass);
+}
+
+// Offer an unclaimed device to a driver
+static void pci_try_driver(const pci_driver_t *driver, pci_device_t *dev)
+{
+    if (dev->driver == NULL && pci_driver_matches(driver, dev) && driver->probe(dev)) {
+        dev->driver = driver;
+    }
+}
+
+// Initialize PCI
+void pci_init(void)
+{
+    device_count = 0;
+    memset(bus_scanned, 0, sizeof(bus_scanned));
+    
+    pci_init_ecam();
+    
+    // Host bridge 0:0 with more than one function = one host controller per bus
+    if (pci_read8(0, 0, 0, PCI_HEADER_TYPE) & 0x80) {
+        for (uint8_t function = 0; function < 8; function++) {
+            if (pci_read16(0, 0, function, PCI_VENDOR_ID) != 0xFFFF) {
+                pci_scan_bus(function);
+            }
+        }
+    } else {
+        pci_scan_bus(0);
+    }
+    
+    for (int i = 0; i < driver_count; i++) {
+        for (int j = 0; j < device_count; j++) {
+            pci_try_driver(drivers[i], &devices[j]);
+        }
+    }
+}
+INITCALL(INITCALL_DEVICE, pci_init, NULL);
+
+// Register a driver
+bool pci_register_driver(const pci_driver_t *driver)
+{
+    if (driver == NULL || driver->probe == NULL || driver_count >= PCI_MAX_DRIVERS) {
+        return false;
+    }
+    
+    drivers[driver_count++] = driver;
+    
+    for (int i = 0; i < device_count; i++) {
+        pci_try_driver(driver, &devices[i]);
+    }
+    return true;
+}
+
+// Enable decoding and bus mastering
+void pci_enable_device(pci_device_t *dev)
+{
+    uint16_t command = pci_read16(dev->bus, dev->device, dev->function, PCI_COMMAND);
+    command |= PCI_COMMAND_MASTER;
+    
+    for (int i = 0; i < PCI_BAR_COUNT; i++) {
+        if (dev->bars[i].size == 0) {
+            continue;
+        }
+        command |= dev->bars[i].is_io ? PCI_COMMAND_IO : PCI_COMMAND_MEMORY;
+    }
+    
+    pci_write16(dev->bus, dev->device, dev->function, PCI_COMMAND, command);
+}
+
+// Map a BAR
+uint64_t pci_map_bar(pci_device_t *dev, int bar)
+{
+    if (bar < 0 || bar >= PCI_BAR_COUNT || dev->bars[bar].size == 0) {
+        return 0;
+    }
+    
+    pci_bar_t *b = &dev->bars[bar];
+    if (!b->is_io && !paging_map_mmio(b->address, b->size)) {
+        return 0;
+    }
+    return b->address;
+}
+
+// APIC ID to aim a message at. CPUs that don't take interrupts (yet) are
+// swapped for the running one, *cpu is updated to match.
+static uint8_t pci_msi_target(int *cpu)
+{
+    int cpu_count;
+    const apic_cpu_t *cpus = apic_get_cpus(&cpu_count);
+    
+    if (!irq_cpu_is_online(*cpu)) {
+        *cpu = apic_cpu_index(lapic_get_id());
+    }
+    if (*cpu >= 0 && *cpu < cpu_count) {
+        return cpus[*cpu].apic_id;
+    }
+    return lapic_get_id();
+}
+
+// Write an MSI-X table entry's message
+static void pci_msix_write_entry(pci_device_t *dev, int entry, uint8_t apic_id, int vector)
+{
+    uint64_t slot = dev->msix_table + entry * MSIX_ENTRY_SIZE;
+    mmio_write32(slot + 0, MSI_ADDRESS(apic_id));
+    mmio_write32(slot + 4, 0);
+    mmio_write32(slot + 8, vector);
+}
+
+// Move an MSI/MSI-X vector to another CPU (irq_retarget_t for the balancer).
+// The destination is in the low address dword, so MSI changes with one
+// write; MSI-X entries are masked around the update.
+static bool pci_msi_retarget(int vector, uint8_t apic_id)
+{
+    pci_msi_route_t *route = &msi_routes[vector];
+    pci_device_t *dev = route->dev;
+    if (dev == NULL) {
+        return false;
+    }
+    
+    if (route->entry < 0) {
+        pci_write32(dev->bus, dev->device, dev->function,
+                    dev->msi_cap + MSI_ADDRESS_LO, MSI_ADDRESS(apic_id));
+        return true;
+    }
+    
+    pci_msix_mask(dev, route->entry, true);
+    pci_msix_write_entry(dev, route->entry, apic_id, vector);
+    pci_msix_mask(dev, route->entry, false);
+    return true;
+}
+
+// Turn legacy INTx off or on
+static void pci_set_intx(pci_device_t *dev, bool enabled)
+{
+    uint16_t command = pci_read16(dev->bus, dev->device, dev->function, PCI_COMMAND);
+    if (enabled) {
+        command &= ~PCI_COMMAND_INTX_DISABLE;
+    } else {
+        command |= PCI_COMMAND_INTX_DISABLE;
+    }
+    pci_write16(dev->bus, dev->device, dev->function, PCI_COMMAND, command);
+}
+
+// Enable MSI with a single message
+int pci_enable_msi(pci_device_t *dev, irq_handler_t handler, int cpu)
+{
+    if (dev->msi_cap == 0 || dev->msi_vector >= 0 || !apic_is_enabled()) {
+        return -1;
+    }
+    
+    int vector = irq_alloc_vector();
+    if (vector < 0) {
+        return -1;
+    }
+    irq_install_vector_handler(vector, handler);
+    
+    // The message is a memory write from the device
+    pci_enable_device(dev);
+    
+    uint8_t b = dev->bus, d = dev->device, f = dev->function;
+    uint8_t cap = dev->msi_cap;
+    uint16_t control = pci_read16(b, d, f, cap + MSI_CONTROL);
+    
+    pci_write32(b, d, f, cap + MSI_ADDRESS_LO, MSI_ADDRESS(pci_msi_target(&cpu)));
+    if (control & MSI_CONTROL_64BIT) {
+        pci_write32(b, d, f, cap + MSI_ADDRESS_HI, 0);
+        pci_write16(b, d, f, cap + MSI_DATA_64, vector);
+    } else {
+        pci_write16(b, d, f, cap + MSI_DATA_32, vector);
+    }
+    
+    // One message only (MME = 0), then switch over from INTx
+    control &= ~MSI_CONTROL_MME;
+    pci_write16(b, d, f, cap + MSI_CONTROL, control | MSI_CONTROL_ENABLE);
+    pci_set_intx(dev, false);
+    
+    dev->msi_vector = vector;
+    msi_routes[vector].dev = dev;
+    msi_routes[vector].entry = -1;
+    irq_affinity_add(vector, cpu, pci_msi_retarget);
+    return vector;
+}
+
+void pci_disable_msi(pci_device_t *dev)
+{
+    if (dev->msi_cap == 0 || dev->msi_vector < 0) {
+        return;
+    }
+    
+    uint8_t cap = dev->msi_cap;
+    uint16_t control = pci_read16(dev->bus, dev->device, dev->function, cap + MSI_CONTROL);
+    pci_write16(dev->bus, dev->device, dev->function, cap + MSI_CONTROL,
+                control & ~MSI_CONTROL_ENABLE);
+    pci_set_intx(dev, true);
+    
+    irq_affinity_remove(dev->msi_vector);
+    msi_routes[dev->msi_vector].dev = NULL;
+    irq_free_vector(dev->msi_vector);
+    dev->msi_vector = -1;
+}
+
+// Map the MSI-X table and enable MSI-X
+bool pci_msix_enable(pci_device_t *dev)
+{
+    if (dev->msix_cap == 0 || !apic_is_enabled()) {
+        return false;
+    }
+    if (dev->msix_table != 0) {
+        return true;
+    }
+    
+    uint8_t b = dev->bus, d = dev->device, f = dev->function;
+    uint8_t cap = dev->msix_cap;
+    
+    uint32_t table = pci_read32(b, d, f, cap + MSIX_TABLE);
+    int bir = table & 0x7;
+    if (bir >= PCI_BAR_COUNT) {
+        return false;
+    }
+    
+    uint64_t base = pci_map_bar(dev, bir);
+    if (base == 0 || dev->bars[bir].is_io) {
+        return false;
+    }
+    pci_enable_device(dev);
+    
+    // Function mask while the table is set up, so nothing fires half-programmed
+    uint16_t control = pci_read16(b, d, f, cap + MSIX_CONTROL);
+    pci_write16(b, d, f, cap + MSIX_CONTROL, control | MSIX_CONTROL_ENABLE | MSIX_CONTROL_MASK);
+    
+    dev->msix_table = base + (table & ~0x7U);
+    for (int i = 0; i < dev->msix_count; i++) {
+        pci_msix_mask(dev, i, true);
+    }
+    
+    pci_write16(b, d, f, cap + MSIX_CONTROL, (control | MSIX_CONTROL_ENABLE) & ~MSIX_CONTROL_MASK);
+    pci_set_intx(dev, false);
+    return true;
+}
+
+// Mask/unmask an MSI-X entry
+void pci_msix_mask(pci_device_t *dev, int entry, bool masked)
+{
+    if (dev->msix_table == 0 || entry < 0 || entry >= dev->msix_count) {
+        return;
+    }
+    
+    uint64_t control = dev->msix_table + entry * MSIX_ENTRY_SIZE + 12;
+    uint32_t value = mmio_read32(control);
+    if (masked) {
+        value |= MSIX_VECTOR_MASKED;
+    } else {
+        value &= ~MSIX_VECTOR_MASKED;
+    }
+    mmio_write32(control, value);
+}
+
+// Program an MSI-X entry
+int pci_msix_set_vector(pci_device_t *dev, int entry, irq_handler_t handler, int cpu)
+{
+    if (dev->msix_table == 0 || entry < 0 || entry >= dev->msix_count) {
+        return -1;
+    }
+    
+    int vector = irq_alloc_vector();
+    if (vector < 0) {
+        return -1;
+    }
+    irq_install_vector_handler(vector, handler);
+    
+    pci_msix_mask(dev, entry, true);
+    pci_msix_write_entry(dev, entry, pci_msi_target(&cpu), vector);
+    pci_msix_mask(dev, entry, false);
+    
+    msi_routes[vector].dev = dev;
+    msi_routes[vector].entry = entry;
+    irq_affinity_add(vector, cpu, pci_msi_retarget);
+    return vector;
+}
+
+// Config space, not our own state, decides: a driver may have set up more
+// than it told us about
+void pci_quiesce(void)
+{
+    for (int i = 0; i < device_count; i++) {
+        pci_device_t *dev = &devices[i];
+        uint8_t b = dev->bus, d = dev->device, f = dev->function;
+        
+        if (dev->msi_cap) {
+            uint16_t control = pci_read16(b, d, f, dev->msi_cap + MSI_CONTROL);
+            pci_write16(b, d, f, dev->msi_cap + MSI_CONTROL, control & ~MSI_CONTROL_ENABLE);
+        }
+        if (dev->msix_cap) {
+            uint16_t control = pci_read16(b, d, f, dev->msix_cap + MSIX_CONTROL);
+            pci_write16(b, d, f, dev->msix_cap + MSIX_CONTROL,
+                        (control | MSIX_CONTROL_MASK) & ~MSIX_CONTROL_ENABLE);
+        }
+        
+        // A bridge without bus mastering would cut off whatever is behind it
+        if (dev->class_code == PCI_CLASS_BRIDGE) {
+            continue;
+        }
+        uint16_t command = pci_read16(b, d, f, PCI_COMMAND);
+        pci_write16(b, d, f, PCI_COMMAND, command & ~PCI_COMMAND_MASTER);
+    }
+}
+
+pci_device_t *pci_get_devices(int *count)
+{
+    if (count) {
+        *count = device_count;
+    }
+    return devices;
+}
+
+// Base class names
+const char *pci_class_name(uint8_t class_code)
+{
+    static const char *names[] = {
+        "legacy", "storage", "network", "display", "multimedia", "memory",
+        "bridge", "serial", "system", "input", "docking", "processor",
+        "serial bus", "wireless", "intelligent", "satellite", "crypto", "signal"
+    };
+    
+    if (class_code < sizeof(names) / sizeof(names[0])) {
+        return names[class_code];
+    }
+    return "other";
+}
@@ -0,0 +1,147 @@
+// kernel/drivers/pci.h - PCI bus enumeration, driver matching and MSI/MSI-X
+
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../interrupts/isr.h"
+
+// Configuration space registers (type 0 and 1 headers)
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION        0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_SECONDARY_BUS   0x19
+#define PCI_CAP_POINTER     0x34
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+// Command register bits
+#define PCI_COMMAND_IO           0x0001
+#define PCI_COMMAND_MEMORY       0x0002
+#define PCI_COMMAND_MASTER       0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+
+// Status register bits
+#define PCI_STATUS_CAP_LIST 0x0010
+
+// Class codes
+#define PCI_CLASS_BRIDGE 0x06
+
+// Capability IDs
+#define PCI_CAP_MSI   0x05
+#define PCI_CAP_MSIX  0x11
+
+// Wildcards for driver match tables
+#define PCI_ANY_ID    0xFFFF
+#define PCI_ANY_CLASS 0xFF
+
+// Limits
+#define PCI_MAX_DEVICES 64
+#define PCI_MAX_DRIVERS 16
+#define PCI_BAR_COUNT   6
+
+// A decoded base address register
+typedef struct {
+    uint64_t address;           // Physical address or I/O port base
+    uint64_t size;
+    bool is_io;
+    bool is_64bit;
+    bool prefetchable;
+} pci_bar_t;
+
+struct pci_driver;
+
+// A function found during the bus scan
+typedef struct {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t header_type;
+    uint8_t irq_line;           // Legacy INTx line the firmware assigned
+    pci_bar_t bars[PCI_BAR_COUNT];
+
+    // Capability offsets in config space, 0 if absent
+    uint8_t msi_cap;
+    uint8_t msix_cap;
+
+    // Interrupt state
+    int msi_vector;             // -1 unless MSI is enabled
+    uint16_t msix_count;        // Table size
+    uint64_t msix_table;        // Mapped table address, 0 until pci_msix_enable()
+
+    const struct pci_driver *driver;
+} pci_device_t;
+
+// A driver, matched on vendor/device and/or class/subclass
+typedef struct pci_driver {
+    const char *name;
+    uint16_t vendor_id;         // PCI_ANY_ID to match every vendor
+    uint16_t device_id;         // PCI_ANY_ID to match every device
+    uint8_t class_code;         // PCI_ANY_CLASS to match every class
+    uint8_t subclass;           // PCI_ANY_CLASS to match every subclass
+    bool (*probe)(pci_device_t *dev);   // Return true to claim the device
+} pci_driver_t;
+
+// Scan every bus (through ECAM when the MCFG table has one)
+void pci_init(void);
+
+// Whether configuration space goes through ECAM instead of ports 0xCF8/0xCFC
+bool pci_uses_ecam(void);
+
+// Configuration space access
+uint32_t pci_read32(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset);
+uint16_t pci_read16(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset);
+uint8_t pci_read8(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset);
+void pci_write32(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint32_t value);
+void pci_write16(uint8_t bus, uint8_t device, uint8_t function, uint16_t offset, uint16_t value);
+
+// Register a driver, it's offered every unclaimed device (now and after the scan)
+bool pci_register_driver(const pci_driver_t *driver);
+
+// Turn on memory/I/O decoding and bus mastering
+void pci_enable_device(pci_device_t *dev);
+
+// Map a memory BAR uncached and return its address (I/O BARs return the
+// port base), 0 if the BAR is empty
+uint64_t pci_map_bar(pci_device_t *dev, int bar);
+
+// Enable MSI with one message aimed at a CPU (index into apic_get_cpus(),
+// the running CPU if that one isn't online). Returns the vector or -1.
+int pci_enable_msi(pci_device_t *dev, irq_handler_t handler, int cpu);
+void pci_disable_msi(pci_device_t *dev);
+
+// Map the MSI-X table and enable MSI-X with every entry masked
+bool pci_msix_enable(pci_device_t *dev);
+
+// Give an MSI-X entry its own vector aimed at a CPU and unmask it.
+// Returns the allocated vector or -1.
+int pci_msix_set_vector(pci_device_t *dev, int entry, irq_handler_t handler, int cpu);
+
+// Mask or unmask one MSI-X entry
+void pci_msix_mask(pci_device_t *dev, int entry, bool masked);
+
+// Stop every function from raising MSI/MSI-X or doing DMA (bridges keep
+// forwarding), for handing the machine to another kernel
+void pci_quiesce(void);
+
+// Scanned devices
+pci_device_t *pci_get_devices(int *count);
+
+// Short name for a class code ("storage", "network", ...)
+const char *pci_class_name(uint8_t class_code);
+
+#endif // PCI_H
@@ -3,6 +3,10 @@
 #include "screen.h"
 #include "../lib/string.h"
 #include "../memory/heap.h"
+#include "../lib/spinlock.h"
+#include "../lib/ring.h"
+#include "../sched/thread.h"
+#include "../initcall.h"
 
 // VGA buffer
 static volatile uint16_t* vga_buffer = (uint16_t*)0xB8000;
@@ -29,6 +33,10 @@ static uint8_t line_len[BUFFER_LINES];
 // It's just easier this way, i wont be bothered optimizing this out yet
 static uint16_t current_screen[SCREEN_HEIGHT][SCREEN_WIDTH];
 
+// Cursor, colour, screen copy and scrollback. Output from different threads
+// interleaves by whole strings.
+static spinlock_t screen_lock = SPINLOCK_INIT("screen");
+
 // Create VGA attribute byte
 uint16_t vga_attribute_byte(vga_color fg, vga_color bg)
 {
@@ -47,6 +55,7 @@ void screen_init(void)
     scroll_offset = 0;
     screen_clear();
 }
+INITCALL(INITCALL_EARLY, screen_init, NULL);
 
 // Initialize scrollback (after heap)
 void screen_init_scrollback(void)
@@ -55,10 +64,12 @@ void screen_init_scrollback(void)
     memset(current_screen, 0, sizeof(current_screen));
     follow_bottom = false;
 }
+INITCALL(INITCALL_CONSOLE, screen_init_scrollback, NULL);
 
 // Clear screen
 void screen_clear(void)
 {
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
     uint16_t blank = ' ' | current_attribute;
     
     for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
@@ -78,6 +89,7 @@ void screen_clear(void)
     cursor_x = 0;
     cursor_y = 0;
     scroll_offset = 0;
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Add a line to scrollback buffer
@@ -175,8 +187,8 @@ static inline void scroll_screen(void)
     }
 }
 
-// Put character on screen
-void screen_putchar(char c)
+// Put character on screen (lock held)
+static void putchar_locked(char c)
 {
     // If scrolled up, jump to bottom on new input
     if (scroll_offset > 0) {
@@ -224,21 +236,60 @@ void screen_putchar(char c)
     }
 }
 
+// Where a background job's output goes instead of the screen (NULL: screen)
+static inline ring_t *screen_redirect(void)
+{
+    thread_t *self = thread_current();
+    return self ? self->console : NULL;
+}
+
+// Put character on screen
+void screen_putchar(char c)
+{
+    ring_t *console = screen_redirect();
+    if (console) {
+        ring_push(console, &c);
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    putchar_locked(c);
+    spin_unlock_irqrestore(&screen_lock, flags);
+}
+
 // Write string
 void screen_write(const char* str)
 {
+    ring_t *console = screen_redirect();
+    if (console) {
+        ring_push_batch(console, str, strlen(str));
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
     while (*str) {
-        screen_putchar(*str++);
+        putchar_locked(*str++);
     }
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Write string with color
 void screen_write_color(const char* str, vga_color fg, vga_color bg)
 {
+    ring_t *console = screen_redirect();
+    if (console) {
+        ring_push_batch(console, str, strlen(str));
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
     uint16_t old_attr = current_attribute;
     current_attribute = vga_attribute_byte(fg, bg);
-    screen_write(str);
+    while (*str) {
+        putchar_locked(*str++);
+    }
     current_attribute = old_attr;
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Set color
@@ -265,6 +316,7 @@ void screen_invert_color(void){
 
 // 
 void screen_clear_last_word(void){
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
     uint16_t blank = ' ' | current_attribute;
 
     int source_line = buffer_count - scroll_offset + cursor_y;
@@ -277,6 +329,7 @@ void screen_clear_last_word(void){
     }
 
     refresh_display();
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Get cursor
@@ -298,6 +351,8 @@ void screen_scroll_up(void)
 {
     if (follow_bottom) return;
     
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    
     // Maximum scroll is total lines minus screen height
     int max_scroll = buffer_count;
     
@@ -308,6 +363,7 @@ void screen_scroll_up(void)
         }
         refresh_display();
     }
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Scroll down (show newer content)
@@ -315,6 +371,8 @@ void screen_scroll_down(void)
 {
     if (follow_bottom) return;
     
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
+    
     if (scroll_offset > 0) {
         scroll_offset -= 1;  // Scroll by 1 line at a time
         if (scroll_offset < 0) {
@@ -322,15 +380,18 @@ void screen_scroll_down(void)
         }
         refresh_display();
     }
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Jump to bottom
 void screen_scroll_to_bottom(void)
 {
+    uint64_t flags = spin_lock_irqsave(&screen_lock);
     if (scroll_offset > 0) {
         scroll_offset = 0;
         refresh_display();
     }
+    spin_unlock_irqrestore(&screen_lock, flags);
 }
 
 // Check if at bottom
@@ -1,80 +1,588 @@
-// kernel/drivers/timer.c - PIT timer implementation
+// kernel/drivers/timer.c - System timer: clock event devices and tickless idle
+//
+// Uptime comes from a free-running clocksource (the TSC, calibrated against
+// the HPET or PIT channel 2), so the timer interrupt doesn't have to count time. That
+// lets the idle loop stop the periodic tick and program a one-shot interrupt
+// for the next expiry only. Without a trustworthy TSC, time is counted in
+// ticks and the tick never stops.
 
 #include "timer.h"
+#include "clocksource.h"
+#include "timerwheel.h"
+#include "hpet.h"
 #include "../interrupts/isr.h"
+#include "../interrupts/apic.h"
+#include "../interrupts/irqsoff.h"
+#include "../interrupts/softirq.h"
+#include "../sched/thread.h"
+#include "../sched/wait.h"
+#include "../sched/idle.h"
+#include "../vdso.h"
+#include "../smp.h"
 #include "../lib/io.h"
+#include "../lib/cpu.h"
 #include "../lib/string.h"
+#include "../initcall.h"
 
 // PIT I/O ports
 #define PIT_CHANNEL_0  0x40
 #define PIT_CHANNEL_1  0x41
 #define PIT_CHANNEL_2  0x42
 #define PIT_COMMAND    0x43
+#define PIT_GATE       0x61   // Bit 0 = channel 2 gate, bit 1 = speaker, bit 5 = channel 2 output
 
 // PIT frequency
 #define PIT_BASE_FREQUENCY 1193182  // Hz
 
-// Global tick counter
+// Calibration window and how long to wait for the PIT before giving up
+#define CALIBRATE_MS      10
+#define CALIBRATE_TIMEOUT 100000000
+
+// Two calibration runs further apart than this (in 1/1000) mean the TSC
+// doesn't tick at a steady rate
+#define CALIBRATE_TOLERANCE 10
+
+#define IA32_TSC_DEADLINE_MSR 0x6E0
+#define CPUID_TSC_DEADLINE    (1u << 24)   // Leaf 1, ECX
+
+// Divide the LAPIC timer input clock by 16
+#define LAPIC_TIMER_DIVIDE_16 0x3
+
+// Timer interrupts taken
 static volatile uint64_t system_ticks = 0;
 
+// Calibration results
+static uint64_t tsc_khz = 0;
+static bool tsc_stable = false;
+static uint32_t lapic_ticks_per_ms = 0;
+
+static const clockevent_t *clockevent = NULL;
+static bool tickless = true;
+static bool tick_stopped = false;
+
+// TSC-deadline periodic emulation
+static uint64_t deadline_period = 0;
+static uint64_t next_deadline = 0;
+
+// --- PIT ---
+
+static bool pit_available(void)
+{
+    return true;
+}
+
+static void timer_handler(registers_t *regs);
+
+static void pit_set_periodic(void)
+{
+    // Channel 0, lobyte/hibyte, mode 3 (square wave), binary
+    uint32_t divisor = PIT_BASE_FREQUENCY / TIMER_FREQUENCY;
+    outb(PIT_COMMAND, 0x36);
+    outb(PIT_CHANNEL_0, (uint8_t)(divisor & 0xFF));
+    outb(PIT_CHANNEL_0, (uint8_t)((divisor >> 8) & 0xFF));
+    irq_install_handler(0, timer_handler);
+}
+
+static void pit_stop(void)
+{
+    irq_uninstall_handler(0);
+}
+
+static const clockevent_t pit_clockevent = {
+    "pit", pit_available, pit_set_periodic, NULL, pit_stop, NULL
+};
+
+// --- Local APIC timer ---
+
+static bool lapic_timer_available(void)
+{
+    return apic_is_enabled() && lapic_ticks_per_ms > 0 && tsc_khz > 0;
+}
+
+static void lapic_timer_set_periodic(void)
+{
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, lapic_ticks_per_ms * 1000 / TIMER_FREQUENCY);
+}
+
+static void lapic_timer_set_oneshot(uint64_t delay_ns)
+{
+    uint64_t count = delay_ns * lapic_ticks_per_ms / 1000000;
+    if (count == 0) {
+        count = 1;
+    } else if (count > 0xFFFFFFFF) {
+        count = 0xFFFFFFFF;
+    }
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, (uint32_t)count);
+}
+
+static void lapic_timer_stop(void)
+{
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+bool timer_start_local_tick(int vector, uint32_t period_ms)
+{
+    if (!apic_is_enabled() || lapic_ticks_per_ms == 0) {
+        return false;
+    }
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | vector);
+    lapic_write(LAPIC_TIMER_INIT, lapic_ticks_per_ms * period_ms);
+    return true;
+}
+
+void timer_stop_local_tick(void)
+{
+    if (apic_is_enabled()) {
+        lapic_timer_stop();
+    }
+}
+
+static const clockevent_t lapic_clockevent = {
+    "lapic", lapic_timer_available, lapic_timer_set_periodic,
+    lapic_timer_set_oneshot, lapic_timer_stop, NULL
+};
+
+// --- TSC-deadline mode of the local APIC timer ---
+
+static bool tsc_deadline_available(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    return apic_is_enabled() && tsc_khz > 0 && tsc_stable && (ecx & CPUID_TSC_DEADLINE);
+}
+
+// Periodic mode is emulated: every interrupt arms the next deadline
+static void tsc_deadline_set_periodic(void)
+{
+    deadline_period = tsc_khz * 1000 / TIMER_FREQUENCY;
+    next_deadline = rdtsc() + deadline_period;
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | LAPIC_TIMER_VECTOR);
+    wrmsr(IA32_TSC_DEADLINE_MSR, next_deadline);
+}
+
+static void tsc_deadline_set_oneshot(uint64_t delay_ns)
+{
+    deadline_period = 0;
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_TSC_DEADLINE | LAPIC_TIMER_VECTOR);
+    wrmsr(IA32_TSC_DEADLINE_MSR, rdtsc() + delay_ns * tsc_khz / 1000000 + 1);
+}
+
+static void tsc_deadline_stop(void)
+{
+    deadline_period = 0;
+    wrmsr(IA32_TSC_DEADLINE_MSR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+}
+
+static void tsc_deadline_event(void)
+{
+    if (deadline_period == 0) {
+        return;
+    }
+    
+    // Stay on the original grid, unless we fell a whole period behind
+    uint64_t now = rdtsc();
+    next_deadline += deadline_period;
+    if (next_deadline <= now) {
+        next_deadline = now + deadline_period;
+    }
+    wrmsr(IA32_TSC_DEADLINE_MSR, next_deadline);
+}
+
+static const clockevent_t tsc_deadline_clockevent = {
+    "tsc-deadline", tsc_deadline_available, tsc_deadline_set_periodic,
+    tsc_deadline_set_oneshot, tsc_deadline_stop, tsc_deadline_event
+};
+
+// --- HPET comparator 0, on IRQ 0 in place of the PIT ---
+
+static bool hpet_clockevent_available(void)
+{
+    return hpet_is_present() && hpet_can_periodic();
+}
+
+static void hpet_clockevent_set_periodic(void)
+{
+    irq_install_handler(0, timer_handler);
+    hpet_set_periodic(hpet_get_khz() * 1000 / TIMER_FREQUENCY);
+}
+
+static void hpet_clockevent_set_oneshot(uint64_t delay_ns)
+{
+    hpet_set_oneshot(delay_ns * hpet_get_khz() / 1000000);
+}
+
+static void hpet_clockevent_stop(void)
+{
+    hpet_stop();
+    irq_uninstall_handler(0);
+}
+
+static const clockevent_t hpet_clockevent = {
+    "hpet", hpet_clockevent_available, hpet_clockevent_set_periodic,
+    hpet_clockevent_set_oneshot, hpet_clockevent_stop, NULL
+};
+
+// Best first
+static const clockevent_t *clockevents[] = {
+    &tsc_deadline_clockevent,
+    &lapic_clockevent,
+    &hpet_clockevent,
+    &pit_clockevent,
+};
+
+#define CLOCKEVENT_COUNT (sizeof(clockevents) / sizeof(clockevents[0]))
+
+// --- Tick counting clocksource, for when the TSC can't be trusted ---
+
+static uint64_t jiffies_read(void)
+{
+    return system_ticks;
+}
+
+static clocksource_t jiffies_clocksource = {
+    "jiffies", CLOCKSOURCE_RATING_JIFFIES, jiffies_read,
+    TIMER_FREQUENCY / 1000, false, 0
+};
+
+// --- Core ---
+
 // Timer interrupt handler
 static void timer_handler(registers_t *regs)
 {
     (void)regs;
     system_ticks++;
+    
+    if (clockevent && clockevent->event) {
+        clockevent->event();
+    }
+    
+    // Woken from tickless idle: restart the tick here, the idle thread may
+    // be switched away from before it gets to do it
+    if (tick_stopped) {
+        clockevent->set_periodic();
+        tick_stopped = false;
+    }
+    
+    vdso_update();
+    timer_wheel_tick(timer_get_uptime_ms());
+    thread_tick();
 }
 
-// Initialize the PIT
-void timer_init(void)
+// Wait CALIBRATE_MS on PIT channel 2, false if the PIT never answered
+static bool timer_calibrate_wait_pit(void)
 {
-    // Calculate divisor for desired frequency
-    uint32_t divisor = PIT_BASE_FREQUENCY / TIMER_FREQUENCY;
+    // Gate on, speaker off; channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    uint16_t count = PIT_BASE_FREQUENCY * CALIBRATE_MS / 1000;
+    uint8_t gate = inb(PIT_GATE);
+    outb(PIT_GATE, (gate & ~0x02) | 0x01);
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL_2, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL_2, (uint8_t)(count >> 8));
     
-    // Send command byte (channel 0, access mode lobyte/hibyte, mode 2)
-    // Mode 2 = rate generator
-    // 00 = channel 0
-    // 11 = lobyte/hibyte access mode
-    // 010 = mode 2 (rate generator)
-    // 0 = 16-bit binary
-    outb(PIT_COMMAND, 0x36);
+    int spins = 0;
+    while (!(inb(PIT_GATE) & 0x20) && spins < CALIBRATE_TIMEOUT) {
+        spins++;
+    }
     
-    // Send frequency divisor
-    outb(PIT_CHANNEL_0, (uint8_t)(divisor & 0xFF));         // Low byte
-    outb(PIT_CHANNEL_0, (uint8_t)((divisor >> 8) & 0xFF));  // High byte
+    outb(PIT_GATE, gate);
+    return spins < CALIBRATE_TIMEOUT;
+}
+
+// Wait CALIBRATE_MS on the HPET main counter, much finer than the PIT
+static void timer_calibrate_wait_hpet(void)
+{
+    uint64_t start = hpet_read_counter();
+    uint64_t count = hpet_get_khz() * CALIBRATE_MS;
+    while (hpet_read_counter() - start < count) {
+        __asm__ volatile ("pause");
+    }
+}
+
+// Count TSC and LAPIC timer ticks over CALIBRATE_MS of the HPET (or PIT
+// channel 2), returns TSC kHz (0 if there was nothing to measure against)
+static uint64_t timer_calibrate_once(void)
+{
+    uint64_t flags = irq_save();
     
-    // Install timer interrupt handler (IRQ0)
-    irq_install_handler(0, timer_handler);
+    if (apic_is_enabled()) {
+        lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    }
     
+    uint64_t start = rdtsc();
+    bool ok = true;
+    if (hpet_is_present()) {
+        timer_calibrate_wait_hpet();
+    } else {
+        ok = timer_calibrate_wait_pit();
+    }
+    uint64_t end = rdtsc();
+    
+    if (apic_is_enabled()) {
+        lapic_ticks_per_ms = (0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT)) / CALIBRATE_MS;
+        lapic_write(LAPIC_TIMER_INIT, 0);
+    }
+    
+    irq_restore(flags);
+    
+    if (!ok) {
+        lapic_ticks_per_ms = 0;  // No PIT to measure against
+        return 0;
+    }
+    return (end - start) / CALIBRATE_MS;
+}
+
+// Calibrate twice, the TSC only counts as stable if both runs agree
+static void timer_calibrate(void)
+{
+    uint64_t first = timer_calibrate_once();
+    tsc_khz = timer_calibrate_once();
+    
+    uint64_t diff = first > tsc_khz ? first - tsc_khz : tsc_khz - first;
+    tsc_stable = tsc_khz > 0 && diff * 1000 <= tsc_khz * CALIBRATE_TOLERANCE;
+}
+
+// Initialize the timer
+void timer_init(void)
+{
+    hpet_init();
+    timer_calibrate();
     system_ticks = 0;
+    timer_wheel_init();
+    
+    clocksource_register(&jiffies_clocksource);
+    if (tsc_khz > 0) {
+        clocksource_tsc_init(tsc_khz, tsc_stable);
+    }
+    
+    for (unsigned i = 0; i < CLOCKEVENT_COUNT; i++) {
+        if (clockevents[i]->available()) {
+            clockevent = clockevents[i];
+            break;
+        }
+    }
+    
+    if (apic_is_enabled()) {
+        irq_install_vector_handler(LAPIC_TIMER_VECTOR, timer_handler);
+    }
+    clockevent->set_periodic();
 }
+INITCALL(INITCALL_CORE, timer_init, "interrupts_enable");
 
-// Get total ticks since boot
-uint64_t timer_get_ticks(void)
+// Switch clock event devices, the tick keeps running on the new one
+bool timer_set_clockevent(const char *name)
+{
+    for (unsigned i = 0; i < CLOCKEVENT_COUNT; i++) {
+        if (strcmp(clockevents[i]->name, name) != 0 || !clockevents[i]->available()) {
+            continue;
+        }
+        
+        uint64_t flags = irq_save();
+        if (clockevent) {
+            clockevent->stop();
+        }
+        clockevent = clockevents[i];
+        tick_stopped = false;
+        clockevent->set_periodic();
+        irq_restore(flags);
+        return true;
+    }
+    return false;
+}
+
+// Usable clock event devices, best first
+int timer_get_clockevents(const char **names, int max)
+{
+    int count = 0;
+    for (unsigned i = 0; i < CLOCKEVENT_COUNT && count < max; i++) {
+        if (clockevents[i]->available()) {
+            names[count++] = clockevents[i]->name;
+        }
+    }
+    return count;
+}
+
+void timer_shutdown(void)
+{
+    if (clockevent) {
+        clockevent->stop();
+    }
+}
+
+// Tickless idle
+void timer_idle(void)
+{
+    // Halting would waste the CPU another thread could use
+    if (!softirq_running() && (thread_ready_count() > 0 || thread_pull())) {
+        irqsoff_end();
+        __asm__ volatile ("sti");
+        thread_yield();
+        return;
+    }
+    
+    // The other CPUs' ticks only end time slices, their idle threads stop
+    // them (thread_idle_tick_stop())
+    bool stop = timer_is_tickless() && smp_processor_id() == smp_boot_cpu();
+    
+    if (stop) {
+        // Sleep until the next software timer is due
+        uint64_t now = timer_get_ns();
+        uint64_t delay = (uint64_t)TIMER_MAX_IDLE_MS * 1000000;
+        uint64_t expiry = timer_wheel_next_expiry();
+        if (expiry < now / 1000000 + TIMER_MAX_IDLE_MS) {
+            expiry *= 1000000;
+            delay = expiry > now ? expiry - now : 0;
+        }
+        
+        clockevent->set_oneshot(delay);
+        tick_stopped = true;
+    }
+    
+    irqsoff_end();
+    cpu_idle();
+    __asm__ volatile ("sti");
+    
+    if (stop) {
+        uint64_t flags = irq_save();
+        if (tick_stopped) {
+            clockevent->set_periodic();
+            tick_stopped = false;
+        }
+        irq_restore(flags);
+    }
+}
+
+void timer_set_tickless(bool enabled)
+{
+    tickless = enabled;
+}
+
+// Needs a one-shot device and a clocksource that counts while the tick is off
+bool timer_is_tickless(void)
+{
+    const clocksource_t *cs = clocksource_get();
+    return tickless && clockevent && clockevent->set_oneshot && cs && cs->continuous;
+}
+
+const char *timer_get_clockevent(void)
+{
+    return clockevent ? clockevent->name : "none";
+}
+
+uint64_t timer_get_tsc_khz(void)
+{
+    return tsc_khz;
+}
+
+uint64_t timer_get_interrupts(void)
 {
     return system_ticks;
 }
 
+uint64_t timer_get_ns(void)
+{
+    return clocksource_ns();
+}
+
+uint64_t timer_get_cycles(void)
+{
+    return clocksource_cycles();
+}
+
+uint64_t timer_cycles_to_ns(uint64_t cycles)
+{
+    return clocksource_cycles_to_ns(cycles);
+}
+
+const char *timer_get_clocksource(void)
+{
+    const clocksource_t *cs = clocksource_get();
+    return cs ? cs->name : "none";
+}
+
+// Get 1ms ticks since boot
+uint64_t timer_get_ticks(void)
+{
+    return timer_get_uptime_ms();
+}
+
 // Get uptime in milliseconds
 uint64_t timer_get_uptime_ms(void)
 {
-    return system_ticks;  // Since we're running at 1000 Hz, ticks = ms
+    return clocksource_ns() / 1000000;
 }
 
 // Get uptime in seconds
 uint64_t timer_get_uptime_seconds(void)
 {
-    return system_ticks / 1000;
+    return timer_get_uptime_ms() / 1000;
 }
 
-// Sleep for specified milliseconds
-void timer_sleep_ms(uint32_t ms)
+typedef struct {
+    wait_queue_t queue;
+    volatile bool expired;
+} timer_sleeper_t;
+
+// The sleeper's timer ran out. The sleeper may be on another CPU and gone
+// as soon as it sees the flag, so it waits for the queue to be let go of.
+static void timer_sleep_wakeup(void *arg)
 {
-    uint64_t start = system_ticks;
-    uint64_t target = start + ms;
+    timer_sleeper_t *sleeper = arg;
+    wake_up_set(&sleeper->queue, &sleeper->expired);
+}
+
+// Block until the uptime reaches target. An interruptible sleep ends early
+// (returning false) once the thread is interrupted.
+static bool timer_sleep_until(uint64_t target, bool interruptible)
+{
+    timer_sleeper_t sleeper;
+    wait_queue_init(&sleeper.queue);
     
-    while (system_ticks < target) {
-        __asm__ volatile ("hlt");  // Wait for interrupt
+    while (timer_get_uptime_ms() < target) {
+        if (interruptible && thread_interrupted()) {
+            return false;
+        }
+        
+        sleeper.expired = false;
+        timer_handle_t wakeup = timer_add_slack(target, 0, timer_sleep_wakeup, &sleeper);
+        if (wakeup == 0) {
+            // No timer left to wake us: halt and look again after the next interrupt
+            uint64_t flags = irq_save();
+            timer_idle();
+            irq_restore(flags);
+            continue;
+        }
+        
+        if (interruptible) {
+            wait_event_interruptible(&sleeper.queue, sleeper.expired);
+            
+            // Interrupted: the callback never runs unless it's already on its way
+            if (!sleeper.expired && timer_cancel(wakeup)) {
+                return false;
+            }
+        }
+        wait_event(&sleeper.queue, sleeper.expired);
+        wait_queue_sync(&sleeper.queue);
     }
+    return true;
+}
+
+// Sleep for specified milliseconds
+void timer_sleep_ms(uint32_t ms)
+{
+    timer_sleep_until(timer_get_uptime_ms() + ms, false);
+}
+
+bool timer_sleep_ms_interruptible(uint32_t ms)
+{
+    return timer_sleep_until(timer_get_uptime_ms() + ms, true);
 }
 
 // Sleep for specified seconds
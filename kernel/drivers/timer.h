@@ -1,32 +1,98 @@
-// kernel/drivers/timer.h - PIT timer driver
+// kernel/drivers/timer.h - System timer (PIT, HPET, local APIC and TSC-deadline) and timekeeping
 
 #ifndef TIMER_H
 #define TIMER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // Timer configuration
-#define TIMER_FREQUENCY 1000  // 1000 Hz = 1ms per tick
+#define TIMER_FREQUENCY 1000  // 1000 Hz = 1ms per tick while the tick runs
 
-// Initialize the PIT timer
+// Longest the tick stays off in one idle period
+#define TIMER_MAX_IDLE_MS 1000
+
+// A device that raises the timer interrupt
+typedef struct {
+    const char *name;
+    bool (*available)(void);
+    void (*set_periodic)(void);             // TIMER_FREQUENCY ticks
+    void (*set_oneshot)(uint64_t delay_ns); // NULL if the device can't do one-shot
+    void (*stop)(void);
+    void (*event)(void);                    // Called on each interrupt (or NULL)
+} clockevent_t;
+
+// Calibrate the TSC, pick the best clock event device and start the tick
 void timer_init(void);
 
+// Stop the timer interrupt (before handing the machine to another kernel)
+void timer_shutdown(void);
+
+// Called with interrupts disabled once the caller found nothing to do.
+// Yields to a ready thread if there is one (pulling one over from a busier
+// CPU if need be), else halts. On the boot CPU the tick stops until the next
+// expiry (tickless idle). Returns with interrupts enabled and the tick
+// running again.
+void timer_idle(void);
+
+// Periodic interrupt on vector every period_ms from the calling CPU's local
+// APIC timer, for CPUs other than the one keeping time. False without a
+// calibrated local APIC timer.
+bool timer_start_local_tick(int vector, uint32_t period_ms);
+void timer_stop_local_tick(void);
+
+// Tickless idle on/off (stays off on devices without one-shot mode)
+void timer_set_tickless(bool enabled);
+bool timer_is_tickless(void);
+
+// Clock event device in use
+const char *timer_get_clockevent(void);
+
+// Move the tick to another device ("tsc-deadline", "lapic", "hpet", "pit"),
+// false if it doesn't exist here
+bool timer_set_clockevent(const char *name);
+
+// Names of the usable devices, best first
+int timer_get_clockevents(const char **names, int max);
+
+// TSC frequency in kHz, 0 if calibration failed
+uint64_t timer_get_tsc_khz(void);
+
+// Clocksource in use ("tsc", "jiffies", ...)
+const char *timer_get_clocksource(void);
+
+// Nanoseconds since boot
+uint64_t timer_get_ns(void);
+
+// Raw clocksource counter, for timing short sections cheaply. Turn the
+// difference of two reads into time with timer_cycles_to_ns().
+uint64_t timer_get_cycles(void);
+uint64_t timer_cycles_to_ns(uint64_t cycles);
+
+// Timer interrupts taken since boot (wakeups)
+uint64_t timer_get_interrupts(void);
+
 // Get system uptime in milliseconds
 uint64_t timer_get_uptime_ms(void);
 
 // Get system uptime in seconds
 uint64_t timer_get_uptime_seconds(void);
 
-// Sleep for specified milliseconds (blocking)
+// Sleep for specified milliseconds. The calling thread blocks on a wait
+// queue that a software timer wakes, other threads run in the meantime.
 void timer_sleep_ms(uint32_t ms);
 
+// Same, but stops early if the thread is interrupted (Ctrl+C). Returns
+// false in that case.
+bool timer_sleep_ms_interruptible(uint32_t ms);
+
 // Sleep for specified seconds (blocking)
 void timer_sleep(uint32_t seconds);
 
-// Get ticks since boot
+// Get 1ms ticks since boot (same as the uptime in milliseconds)
 uint64_t timer_get_ticks(void);
 
 // Format uptime as string (output: "1h 23m 45s")
 void timer_format_uptime(char *buffer, int max_length);
 
-#endif // TIMER_H
\ No newline at end of file
+#endif // TIMER_H
@@ -0,0 +1,380 @@
+// kernel/drivers/timerwheel.c - Software timers on a hierarchical timing wheel
+//
+// Level 0 has one slot per millisecond for the next 64ms, every level above
+// covers 64 times the span of the one below. Adding a timer hashes its expiry
+// to a slot and cancelling unlinks it, both O(1). When the wheel reaches the
+// start of a higher level slot, that slot is cascaded: its timers are added
+// again and land a level lower. The timer interrupt only compares the uptime
+// with the next expiry; callbacks run from the timer softirq. Threads on
+// any CPU add and cancel timers, so the wheel has a lock of its own.
+
+#include "timerwheel.h"
+#include "timer.h"
+#include "../interrupts/softirq.h"
+#include "../lib/cpu.h"
+#include "../lib/spinlock.h"
+#include <stddef.h>
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+
+// Furthest from the wheel's time a timer can be hashed
+#define TIMER_WHEEL_RANGE (1ULL << TIMER_LEVEL_SHIFT(TIMER_WHEEL_LEVELS))
+
+// Not in a wheel slot
+#define TIMER_LEVEL_EXPIRED 0xFE    // On the list being run
+#define TIMER_LEVEL_FREE    0xFF
+
+typedef struct wheel_timer {
+    struct wheel_timer *next;
+    struct wheel_timer *prev;
+    uint64_t expires;           // Uptime in ms, slack applied
+    timer_callback_t callback;
+    void *arg;
+    uint16_t generation;        // Bumped on free, invalidates old handles
+    uint8_t level;
+    uint8_t slot;
+} wheel_timer_t;
+
+static wheel_timer_t pool[TIMER_POOL_SIZE];
+static wheel_timer_t *free_list = NULL;
+static int pool_used = 0;
+
+static wheel_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static uint64_t occupied[TIMER_WHEEL_LEVELS];   // One bit per non-empty slot
+static wheel_timer_t *expired = NULL;
+
+// First millisecond the wheel hasn't processed yet
+static uint64_t wheel_now = 0;
+
+// When the softirq has to run next (may be early after a cancel)
+static volatile uint64_t next_event = TIMER_NO_EXPIRY;
+
+static timer_wheel_stats_t stats;
+
+static spinlock_t wheel_lock = SPINLOCK_INIT("timer_wheel");
+
+// --- Lists ---
+
+static wheel_timer_t **timer_list_head(wheel_timer_t *t)
+{
+    if (t->level == TIMER_LEVEL_EXPIRED) {
+        return &expired;
+    }
+    return &slots[t->level][t->slot];
+}
+
+static void timer_link(wheel_timer_t **head, wheel_timer_t *t)
+{
+    t->prev = NULL;
+    t->next = *head;
+    if (*head) {
+        (*head)->prev = t;
+    }
+    *head = t;
+}
+
+static void timer_unlink(wheel_timer_t *t)
+{
+    wheel_timer_t **head = timer_list_head(t);
+    if (t->prev) {
+        t->prev->next = t->next;
+    } else {
+        *head = t->next;
+    }
+    if (t->next) {
+        t->next->prev = t->prev;
+    }
+    
+    if (t->level < TIMER_WHEEL_LEVELS && *head == NULL) {
+        occupied[t->level] &= ~(1ULL << t->slot);
+    }
+}
+
+// --- Pool ---
+
+static wheel_timer_t *timer_alloc(void)
+{
+    wheel_timer_t *t = free_list;
+    if (t) {
+        free_list = t->next;
+    } else if (pool_used < TIMER_POOL_SIZE) {
+        t = &pool[pool_used++];
+    } else {
+        return NULL;
+    }
+    stats.pending++;
+    return t;
+}
+
+static void timer_free(wheel_timer_t *t)
+{
+    t->level = TIMER_LEVEL_FREE;
+    t->generation++;
+    t->next = free_list;
+    free_list = t;
+    stats.pending--;
+}
+
+static timer_handle_t timer_handle(wheel_timer_t *t)
+{
+    return ((uint32_t)t->generation << 16) | (uint32_t)(t - pool + 1);
+}
+
+static wheel_timer_t *timer_lookup(timer_handle_t handle)
+{
+    uint32_t index = (handle & 0xFFFF) - 1;
+    if (handle == 0 || index >= (uint32_t)pool_used) {
+        return NULL;
+    }
+    
+    wheel_timer_t *t = &pool[index];
+    if (t->level == TIMER_LEVEL_FREE || t->generation != (handle >> 16)) {
+        return NULL;
+    }
+    return t;
+}
+
+// --- Wheel ---
+
+// Hash a timer into the level that covers its distance from the wheel's time
+static void timer_enqueue(wheel_timer_t *t)
+{
+    uint64_t expires = t->expires;
+    if (expires < wheel_now) {
+        expires = wheel_now;            // Overdue, run with the next slot
+    } else if (expires - wheel_now >= TIMER_WHEEL_RANGE) {
+        expires = wheel_now + TIMER_WHEEL_RANGE - 1;    // Re-hashed when cascaded
+    }
+    
+    uint64_t delta = expires - wheel_now;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << TIMER_LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    
+    int shift = TIMER_LEVEL_SHIFT(level);
+    t->level = level;
+    t->slot = (expires >> shift) & TIMER_WHEEL_MASK;
+    timer_link(&slots[level][t->slot], t);
+    occupied[level] |= 1ULL << t->slot;
+    
+    // Level 0 runs at the expiry, higher levels cascade at the slot's start
+    uint64_t event = (expires >> shift) << shift;
+    if (event < next_event) {
+        next_event = event;
+    }
+}
+
+// Slots from 'from' (included) to the first occupied one, wrapping around
+static int timer_slot_distance(uint64_t bits, int from)
+{
+    uint64_t rotated = from ? (bits >> from) | (bits << (TIMER_WHEEL_SIZE - from)) : bits;
+    return __builtin_ctzll(rotated);
+}
+
+// Earliest time the wheel needs processing: the next level 0 expiry or the
+// next cascade of an occupied slot, whichever comes first
+static uint64_t timer_wheel_scan(void)
+{
+    if (expired) {
+        return wheel_now;
+    }
+    
+    uint64_t next = TIMER_NO_EXPIRY;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if (!occupied[level]) {
+            continue;
+        }
+        
+        int shift = TIMER_LEVEL_SHIFT(level);
+        uint64_t base = wheel_now >> shift;
+        int current = base & TIMER_WHEEL_MASK;
+        
+        // Above level 0 the current slot was cascaded already, it holds a full turn ahead
+        uint64_t event;
+        if (level == 0) {
+            event = wheel_now + timer_slot_distance(occupied[0], current);
+        } else {
+            int from = (current + 1) & TIMER_WHEEL_MASK;
+            event = (base + 1 + timer_slot_distance(occupied[level], from)) << shift;
+        }
+        if (event < next) {
+            next = event;
+        }
+    }
+    return next;
+}
+
+// Move the slots that start now down a level
+static void timer_cascade(void)
+{
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        int slot = (wheel_now >> TIMER_LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+        wheel_timer_t *t = slots[level][slot];
+        slots[level][slot] = NULL;
+        occupied[level] &= ~(1ULL << slot);
+        
+        while (t) {
+            wheel_timer_t *next = t->next;
+            timer_enqueue(t);
+            stats.cascaded++;
+            t = next;
+        }
+        
+        // The next level only starts a slot when this one wrapped
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+// SOFTIRQ_TIMER: run everything due, jumping over empty stretches
+static void timer_wheel_run(void)
+{
+    uint64_t now = timer_get_uptime_ms();
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+    
+    while (wheel_now <= now) {
+        if ((wheel_now & TIMER_WHEEL_MASK) == 0) {
+            timer_cascade();
+        }
+        
+        int slot = wheel_now & TIMER_WHEEL_MASK;
+        expired = slots[0][slot];
+        slots[0][slot] = NULL;
+        occupied[0] &= ~(1ULL << slot);
+        for (wheel_timer_t *t = expired; t; t = t->next) {
+            t->level = TIMER_LEVEL_EXPIRED;
+        }
+        
+        // Timers added by the callbacks go to the next slot at the earliest
+        wheel_now++;
+        
+        while (expired) {
+            wheel_timer_t *t = expired;
+            timer_callback_t callback = t->callback;
+            void *arg = t->arg;
+            timer_unlink(t);
+            timer_free(t);
+            stats.expired++;
+            
+            spin_unlock_irqrestore(&wheel_lock, flags);
+            callback(arg);
+            flags = spin_lock_irqsave(&wheel_lock);
+        }
+        
+        uint64_t next = timer_wheel_scan();
+        wheel_now = next <= now ? next : now + 1;
+    }
+    
+    next_event = timer_wheel_scan();
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+// --- API ---
+
+void timer_wheel_init(void)
+{
+    softirq_register(SOFTIRQ_TIMER, timer_wheel_run);
+}
+
+// Round the expiry up to the coarsest boundary within the slack, so timers
+// that are close together end up in the same slot and one wakeup runs them all
+static uint64_t timer_apply_slack(uint64_t expires, uint64_t slack_ms)
+{
+    uint64_t limit = expires + slack_ms;
+    uint64_t mask = limit ^ expires;
+    if (slack_ms == 0 || mask == 0) {
+        return expires;
+    }
+    
+    int bit = 63 - __builtin_clzll(mask);
+    return limit & ~((1ULL << bit) - 1);
+}
+
+timer_handle_t timer_add_slack(uint64_t deadline_ms, uint64_t slack_ms,
+                               timer_callback_t callback, void *arg)
+{
+    if (callback == NULL) {
+        return 0;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+    wheel_timer_t *t = timer_alloc();
+    if (t == NULL) {
+        spin_unlock_irqrestore(&wheel_lock, flags);
+        return 0;
+    }
+    
+    // An empty wheel may have fallen behind, catch up for a precise hash
+    uint64_t now = timer_get_uptime_ms();
+    if (stats.pending == 1 && expired == NULL && wheel_now < now) {
+        wheel_now = now;
+    }
+    
+    t->expires = timer_apply_slack(deadline_ms, slack_ms);
+    t->callback = callback;
+    t->arg = arg;
+    if (t->expires != deadline_ms) {
+        stats.coalesced++;
+    }
+    stats.added++;
+    timer_enqueue(t);
+    
+    timer_handle_t handle = timer_handle(t);
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return handle;
+}
+
+timer_handle_t timer_add(uint64_t deadline_ms, timer_callback_t callback, void *arg)
+{
+    uint64_t now = timer_get_uptime_ms();
+    uint64_t slack = deadline_ms > now ? (deadline_ms - now) >> TIMER_DEFAULT_SLACK_SHIFT : 0;
+    return timer_add_slack(deadline_ms, slack, callback, arg);
+}
+
+bool timer_cancel(timer_handle_t handle)
+{
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+    wheel_timer_t *t = timer_lookup(handle);
+    if (t) {
+        timer_unlink(t);
+        timer_free(t);
+        stats.cancelled++;
+    }
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return t != NULL;
+}
+
+bool timer_pending(timer_handle_t handle)
+{
+    return timer_lookup(handle) != NULL;
+}
+
+uint64_t timer_wheel_next_expiry(void)
+{
+    return next_event;
+}
+
+void timer_wheel_tick(uint64_t now_ms)
+{
+    if (next_event <= now_ms) {
+        softirq_raise(SOFTIRQ_TIMER);
+    }
+}
+
+void timer_wheel_get_stats(timer_wheel_stats_t *out)
+{
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+    *out = stats;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        out->per_level[level] = 0;
+    }
+    for (int i = 0; i < pool_used; i++) {
+        if (pool[i].level < TIMER_WHEEL_LEVELS) {
+            out->per_level[pool[i].level]++;
+        }
+    }
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
@@ -0,0 +1,65 @@
+// kernel/drivers/timerwheel.h - Software timers on a hierarchical timing wheel
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 4 levels of 64 slots: 1ms, 64ms, 4s and 4.4min per slot. Timers further
+// out than ~4.6 hours sit in the last level and are re-cascaded.
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SIZE   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+// Timers that can be pending at once
+#define TIMER_POOL_SIZE 256
+
+// timer_wheel_next_expiry() with nothing queued
+#define TIMER_NO_EXPIRY ((uint64_t)-1)
+
+// Default slack is 1/256 of the delay (a 1s timer may fire up to ~4ms late,
+// so nearby timers share one expiry)
+#define TIMER_DEFAULT_SLACK_SHIFT 8
+
+// Called from the timer softirq, interrupts enabled. May add timers.
+typedef void (*timer_callback_t)(void *arg);
+
+// Identifies a pending timer, 0 = none. Stale handles are rejected.
+typedef uint32_t timer_handle_t;
+
+typedef struct {
+    uint64_t added;
+    uint64_t expired;
+    uint64_t cancelled;
+    uint64_t coalesced;         // Expiry moved by slack
+    uint64_t cascaded;          // Moved down a level
+    uint32_t pending;
+    uint32_t per_level[TIMER_WHEEL_LEVELS];
+} timer_wheel_stats_t;
+
+// Start the wheel at the current uptime (timer_init calls this)
+void timer_wheel_init(void);
+
+// Run callback(arg) once the uptime reaches deadline_ms (default slack).
+// O(1). Returns 0 if the pool is exhausted.
+timer_handle_t timer_add(uint64_t deadline_ms, timer_callback_t callback, void *arg);
+
+// Same with explicit slack: the timer may fire up to slack_ms late
+timer_handle_t timer_add_slack(uint64_t deadline_ms, uint64_t slack_ms,
+                               timer_callback_t callback, void *arg);
+
+// Remove a pending timer. O(1). Returns false if it already ran.
+bool timer_cancel(timer_handle_t handle);
+
+bool timer_pending(timer_handle_t handle);
+
+// Earliest time (ms of uptime) the wheel needs attention, TIMER_NO_EXPIRY if empty
+uint64_t timer_wheel_next_expiry(void);
+
+// Raise the timer softirq if something is due (called from the timer interrupt)
+void timer_wheel_tick(uint64_t now_ms);
+
+void timer_wheel_get_stats(timer_wheel_stats_t *stats);
+
+#endif // TIMERWHEEL_H
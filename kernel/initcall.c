@@ -0,0 +1,180 @@
+// kernel/initcall.c - Dependency-ordered initcall runner
+
+#include "initcall.h"
+#include "lib/cpu.h"
+#include "lib/string.h"
+
+// Table boundaries, set up in linker.ld (entries sorted by level)
+extern initcall_t *__initcall_start[];
+extern initcall_t *__initcall_end[];
+
+// Lowest level that still has initcalls waiting to start
+static int current_level = 0;
+
+#define INITCALL_COUNT ((int)(__initcall_end - __initcall_start))
+
+// Find an initcall by name
+static initcall_t *initcall_find(const char *name)
+{
+    for (initcall_t **p = __initcall_start; p < __initcall_end; p++) {
+        initcall_t *ic = *p;
+        if (strcmp(ic->name, name) == 0) {
+            return ic;
+        }
+    }
+    return NULL;
+}
+
+// 1 = dependency satisfied, 0 = not yet, -1 = never (missing or failed)
+static int initcall_dep_status(initcall_t *ic)
+{
+    if (ic->after == NULL) {
+        return 1;
+    }
+    
+    initcall_t *dep = initcall_find(ic->after);
+    if (dep == NULL || dep->state == INITCALL_STATE_FAILED) {
+        return -1;
+    }
+    return dep->state == INITCALL_STATE_DONE ? 1 : 0;
+}
+
+// Poll an async initcall once, returns true if it finished
+static bool initcall_poll_one(initcall_t *ic)
+{
+    int result = ic->poll();
+    if (result == INITCALL_PENDING) {
+        return false;
+    }
+    
+    ic->cycles = rdtsc() - ic->start_tsc;
+    ic->state = (result == INITCALL_DONE) ? INITCALL_STATE_DONE : INITCALL_STATE_FAILED;
+    return true;
+}
+
+// Start an initcall (runs sync ones to completion)
+static void initcall_start(initcall_t *ic)
+{
+    ic->start_tsc = rdtsc();
+    
+    if (ic->flags & INITCALL_ASYNC) {
+        ic->state = INITCALL_STATE_RUNNING;
+        initcall_poll_one(ic);
+        return;
+    }
+    
+    ic->init();
+    ic->cycles = rdtsc() - ic->start_tsc;
+    ic->state = INITCALL_STATE_DONE;
+}
+
+// Move current_level past levels with nothing left waiting
+static void initcall_advance_level(void)
+{
+    while (current_level < INITCALL_LEVELS) {
+        for (initcall_t **p = __initcall_start; p < __initcall_end; p++) {
+            initcall_t *ic = *p;
+            if (ic->level == current_level && ic->state == INITCALL_STATE_WAITING) {
+                return;
+            }
+        }
+        current_level++;
+    }
+}
+
+static bool initcall_any_running(void)
+{
+    for (initcall_t **p = __initcall_start; p < __initcall_end; p++) {
+        initcall_t *ic = *p;
+        if (ic->state == INITCALL_STATE_RUNNING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Nothing can make progress: whatever still waits has a dependency cycle
+// or depends on something from a later level
+static void initcall_fail_stuck(void)
+{
+    for (initcall_t **p = __initcall_start; p < __initcall_end; p++) {
+        initcall_t *ic = *p;
+        if (ic->level == current_level && ic->state == INITCALL_STATE_WAITING) {
+            ic->state = INITCALL_STATE_FAILED;
+        }
+    }
+    initcall_advance_level();
+}
+
+// Start ready initcalls of the current level and poll running async ones.
+// Returns true if any state changed.
+static bool initcall_step(int max_level)
+{
+    bool progress = false;
+    
+    for (initcall_t **p = __initcall_start; p < __initcall_end; p++) {
+        initcall_t *ic = *p;
+        if (ic->state == INITCALL_STATE_RUNNING) {
+            if (initcall_poll_one(ic)) {
+                progress = true;
+            }
+            continue;
+        }
+        
+        if (ic->state != INITCALL_STATE_WAITING ||
+            ic->level != current_level || ic->level > max_level) {
+            continue;
+        }
+        
+        int dep = initcall_dep_status(ic);
+        if (dep > 0) {
+            initcall_start(ic);
+            progress = true;
+        } else if (dep < 0) {
+            ic->state = INITCALL_STATE_FAILED;
+            progress = true;
+        }
+    }
+    
+    initcall_advance_level();
+    return progress;
+}
+
+// Run all levels up to 'level' (blocking)
+void initcall_run_until(int level)
+{
+    while (current_level <= level && current_level < INITCALL_LEVELS) {
+        if (!initcall_step(level)) {
+            if (initcall_any_running()) {
+                // Waiting on an async probe someone depends on
+                __asm__ volatile ("pause");
+            } else {
+                initcall_fail_stuck();
+            }
+        }
+    }
+}
+
+// Background progress, called from the idle loop
+bool initcall_poll(void)
+{
+    if (current_level >= INITCALL_LEVELS && !initcall_any_running()) {
+        return false;
+    }
+    
+    if (!initcall_step(INITCALL_LEVELS - 1) && !initcall_any_running() &&
+        current_level < INITCALL_LEVELS) {
+        initcall_fail_stuck();
+    }
+    
+    return current_level < INITCALL_LEVELS || initcall_any_running();
+}
+
+// Get all initcalls
+initcall_t **initcall_get_all(int *count)
+{
+    if (count) {
+        *count = INITCALL_COUNT;
+    }
+    return __initcall_start;
+}
@@ -0,0 +1,76 @@
+// kernel/initcall.h - Boot-time init functions registered through linker sections
+
+#ifndef INITCALL_H
+#define INITCALL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Levels run in order. The shell starts once INITCALL_CONSOLE is done,
+// everything after that finishes in the background from the idle loop.
+#define INITCALL_EARLY    0  // Screen, boot info
+#define INITCALL_CORE     1  // Interrupts, timer
+#define INITCALL_MEMORY   2  // Physical memory, heap
+#define INITCALL_CONSOLE  3  // Scrollback, keyboard
+#define INITCALL_DEVICE   4  // Device probes
+#define INITCALL_LATE     5
+#define INITCALL_LEVELS   6
+
+// Return values for asynchronous (polled) initcalls
+#define INITCALL_DONE     0
+#define INITCALL_PENDING  1
+#define INITCALL_FAILED  -1
+
+// Flags
+#define INITCALL_ASYNC    0x01
+
+// Runtime state
+typedef enum {
+    INITCALL_STATE_WAITING = 0,
+    INITCALL_STATE_RUNNING,     // Async, started but not finished
+    INITCALL_STATE_DONE,
+    INITCALL_STATE_FAILED,      // Probe failed or dependency never satisfied
+} initcall_state_t;
+
+typedef struct {
+    const char *name;
+    void (*init)(void);         // Synchronous initcall
+    int (*poll)(void);          // Asynchronous initcall, called until it stops returning PENDING
+    const char *after;          // Name of an initcall that must finish first (or NULL)
+    uint8_t level;
+    uint8_t flags;
+    
+    // Filled in by the runner
+    uint8_t state;
+    uint64_t start_tsc;
+    uint64_t cycles;            // Start to finish, including time spent pending
+} initcall_t;
+
+// The section only holds pointers: the compiler pads larger objects to
+// 32 bytes, which would leave holes in the table
+#define __INITCALL(lvl, fn_init, fn_poll, name_str, dep, flg)               \
+    static initcall_t __initcall_##name_str = {                             \
+        #name_str, fn_init, fn_poll, dep, lvl, flg, 0, 0, 0                 \
+    };                                                                      \
+    static initcall_t *__initcall_ptr_##name_str                            \
+    __attribute__((used, section(".initcall." #lvl))) = &__initcall_##name_str
+
+// Register void fn(void) at a level; dep is another initcall's name or NULL
+#define INITCALL(lvl, fn, dep)        __INITCALL(lvl, fn, 0, fn, dep, 0)
+
+// Register int fn(void) that is polled until it returns DONE or FAILED
+#define ASYNC_INITCALL(lvl, fn, dep)  __INITCALL(lvl, 0, fn, fn, dep, INITCALL_ASYNC)
+
+// Run every initcall up to and including the given level (async ones are
+// started but may still be pending afterwards)
+void initcall_run_until(int level);
+
+// Make progress on the remaining levels and pending async probes
+// Returns true while there's still something left to do
+bool initcall_poll(void);
+
+// Registered initcalls, in level order
+initcall_t **initcall_get_all(int *count);
+
+#endif // INITCALL_H
@@ -0,0 +1,426 @@
+// kernel/interrupts/apic.c - Local APIC and I/O APIC interrupt delivery
+//
+// ISA IRQ n keeps vector 32 + n, so handlers installed through
+// irq_install_handler() work the same on the APIC and the legacy PIC.
+
+#include "apic.h"
+#include "isr.h"
+#include "../drivers/acpi.h"
+#include "../memory/paging.h"
+#include "../lib/cpu.h"
+#include "../lib/io.h"
+#include "../lib/spinlock.h"
+#include "../initcall.h"
+
+#define IA32_APIC_BASE_MSR    0x1B
+#define IA32_APIC_BASE_ENABLE 0x800
+
+// IOAPIC registers (indirect through IOREGSEL/IOWIN)
+#define IOAPIC_REGSEL  0x00
+#define IOAPIC_WIN     0x10
+#define IOAPIC_VER     0x01
+#define IOAPIC_REDTBL  0x10
+
+// Redirection entry bits
+#define IOAPIC_ACTIVE_LOW 0x2000
+#define IOAPIC_LEVEL      0x8000
+#define IOAPIC_MASKED     0x10000
+
+// MADT entry types
+#define MADT_LOCAL_APIC         0
+#define MADT_IOAPIC             1
+#define MADT_ISO                2
+#define MADT_LAPIC_ADDR_OVERRIDE 5
+
+// MADT interrupt source override flags
+#define MPS_POLARITY_MASK 0x3
+#define MPS_POLARITY_LOW  0x3
+#define MPS_TRIGGER_MASK  0xC
+#define MPS_TRIGGER_LEVEL 0xC
+
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed)) madt_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct {
+    madt_entry_t header;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;             // Bit 0: enabled
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct {
+    madt_entry_t header;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct {
+    madt_entry_t header;
+    uint8_t bus;
+    uint8_t source;             // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed)) madt_iso_t;
+
+typedef struct {
+    madt_entry_t header;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed)) madt_lapic_override_t;
+
+static bool apic_enabled = false;
+static uint64_t lapic_base = 0;
+
+static apic_cpu_t cpus[APIC_MAX_CPUS];
+static int cpu_count = 0;
+
+static ioapic_t ioapics[APIC_MAX_IOAPICS];
+static int ioapic_count = 0;
+
+// ISA IRQ -> GSI and redirection flags (after overrides)
+static uint32_t isa_gsi[16];
+static uint32_t isa_flags[16];
+
+// Local APIC access
+uint32_t lapic_read(uint32_t reg)
+{
+    return mmio_read32(lapic_base + reg);
+}
+
+void lapic_write(uint32_t reg, uint32_t value)
+{
+    mmio_write32(lapic_base + reg, value);
+}
+
+void lapic_eoi(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+uint8_t lapic_get_id(void)
+{
+    return (uint8_t)(lapic_read(LAPIC_ID) >> 24);
+}
+
+// IOAPIC access
+// Select and window are one register pair per IOAPIC, no other CPU may
+// select in between
+static spinlock_t ioapic_lock = SPINLOCK_INIT("ioapic");
+
+static uint32_t ioapic_read(const ioapic_t *io, uint32_t reg)
+{
+    uint64_t flags = spin_lock_irqsave(&ioapic_lock);
+    mmio_write32(io->address + IOAPIC_REGSEL, reg);
+    uint32_t value = mmio_read32(io->address + IOAPIC_WIN);
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+    return value;
+}
+
+static void ioapic_write(const ioapic_t *io, uint32_t reg, uint32_t value)
+{
+    uint64_t flags = spin_lock_irqsave(&ioapic_lock);
+    mmio_write32(io->address + IOAPIC_REGSEL, reg);
+    mmio_write32(io->address + IOAPIC_WIN, value);
+    spin_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+// Find the IOAPIC that owns a GSI
+static const ioapic_t *ioapic_for_gsi(uint32_t gsi)
+{
+    for (int i = 0; i < ioapic_count; i++) {
+        if (gsi >= ioapics[i].gsi_base &&
+            gsi < ioapics[i].gsi_base + ioapics[i].gsi_count) {
+            return &ioapics[i];
+        }
+    }
+    return NULL;
+}
+
+// Program a redirection entry
+static void ioapic_set_entry(uint32_t gsi, uint64_t entry)
+{
+    const ioapic_t *io = ioapic_for_gsi(gsi);
+    if (io == NULL) {
+        return;
+    }
+    
+    uint32_t pin = gsi - io->gsi_base;
+    ioapic_write(io, IOAPIC_REDTBL + pin * 2 + 1, (uint32_t)(entry >> 32));
+    ioapic_write(io, IOAPIC_REDTBL + pin * 2, (uint32_t)entry);
+}
+
+static uint64_t ioapic_get_entry(uint32_t gsi)
+{
+    const ioapic_t *io = ioapic_for_gsi(gsi);
+    if (io == NULL) {
+        return IOAPIC_MASKED;
+    }
+    
+    uint32_t pin = gsi - io->gsi_base;
+    uint64_t high = ioapic_read(io, IOAPIC_REDTBL + pin * 2 + 1);
+    return (high << 32) | ioapic_read(io, IOAPIC_REDTBL + pin * 2);
+}
+
+uint32_t ioapic_isa_to_gsi(int irq)
+{
+    if (irq < 0 || irq >= 16) {
+        return 0xFFFFFFFF;
+    }
+    return isa_gsi[irq];
+}
+
+// Mask/unmask an ISA IRQ
+void ioapic_set_isa_mask(int irq, bool masked)
+{
+    if (!apic_enabled || irq < 0 || irq >= 16 || isa_gsi[irq] == 0xFFFFFFFF) {
+        return;
+    }
+    
+    uint64_t entry = ioapic_get_entry(isa_gsi[irq]);
+    if (masked) {
+        entry |= IOAPIC_MASKED;
+    } else {
+        entry &= ~(uint64_t)IOAPIC_MASKED;
+    }
+    ioapic_set_entry(isa_gsi[irq], entry);
+}
+
+// Retarget an ISA IRQ. The destination lives alone in the high dword, so
+// one write moves it without masking the pin.
+bool ioapic_set_isa_destination(int irq, uint8_t apic_id)
+{
+    if (!apic_enabled || irq < 0 || irq >= 16 || isa_gsi[irq] == 0xFFFFFFFF) {
+        return false;
+    }
+    
+    const ioapic_t *io = ioapic_for_gsi(isa_gsi[irq]);
+    if (io == NULL) {
+        return false;
+    }
+    
+    uint32_t pin = isa_gsi[irq] - io->gsi_base;
+    ioapic_write(io, IOAPIC_REDTBL + pin * 2 + 1, (uint32_t)apic_id << 24);
+    return true;
+}
+
+// Read CPUs, IOAPICs and ISA overrides out of the MADT
+static bool apic_parse_madt(void)
+{
+    madt_t *madt = (madt_t *)acpi_find_table("APIC");
+    if (madt == NULL) {
+        return false;
+    }
+    
+    lapic_base = madt->lapic_address;
+    
+    for (int i = 0; i < 16; i++) {
+        isa_gsi[i] = i;
+        isa_flags[i] = 0;  // ISA default: active high, edge triggered
+    }
+    
+    uint8_t *ptr = (uint8_t *)madt + sizeof(madt_t);
+    uint8_t *end = (uint8_t *)madt + madt->header.length;
+    
+    while (ptr + sizeof(madt_entry_t) <= end) {
+        madt_entry_t *entry = (madt_entry_t *)ptr;
+        if (entry->length < sizeof(madt_entry_t)) {
+            break;
+        }
+        
+        switch (entry->type) {
+            case MADT_LOCAL_APIC: {
+                madt_lapic_t *lapic = (madt_lapic_t *)entry;
+                if (cpu_count < APIC_MAX_CPUS) {
+                    cpus[cpu_count].acpi_id = lapic->acpi_id;
+                    cpus[cpu_count].apic_id = lapic->apic_id;
+                    cpus[cpu_count].enabled = (lapic->flags & 1) != 0;
+                    cpu_count++;
+                }
+                break;
+            }
+            case MADT_IOAPIC: {
+                madt_ioapic_t *io = (madt_ioapic_t *)entry;
+                if (ioapic_count < APIC_MAX_IOAPICS) {
+                    ioapics[ioapic_count].id = io->id;
+                    ioapics[ioapic_count].address = io->address;
+                    ioapics[ioapic_count].gsi_base = io->gsi_base;
+                    ioapic_count++;
+                }
+                break;
+            }
+            case MADT_ISO: {
+                madt_iso_t *iso = (madt_iso_t *)entry;
+                if (iso->bus == 0 && iso->source < 16) {
+                    uint32_t flags = 0;
+                    if ((iso->flags & MPS_POLARITY_MASK) == MPS_POLARITY_LOW) {
+                        flags |= IOAPIC_ACTIVE_LOW;
+                    }
+                    if ((iso->flags & MPS_TRIGGER_MASK) == MPS_TRIGGER_LEVEL) {
+                        flags |= IOAPIC_LEVEL;
+                    }
+                    isa_gsi[iso->source] = iso->gsi;
+                    isa_flags[iso->source] = flags;
+                }
+                break;
+            }
+            case MADT_LAPIC_ADDR_OVERRIDE: {
+                madt_lapic_override_t *ov = (madt_lapic_override_t *)entry;
+                lapic_base = ov->address;
+                break;
+            }
+        }
+        
+        ptr += entry->length;
+    }
+    
+    // An identity-mapped ISA IRQ loses its pin when another IRQ is
+    // overridden onto it (IRQ0 -> GSI2 leaves IRQ2 without a pin)
+    for (int irq = 0; irq < 16; irq++) {
+        for (int other = 0; other < 16; other++) {
+            if (other != irq && isa_gsi[other] == (uint32_t)irq && isa_gsi[irq] == (uint32_t)irq) {
+                isa_gsi[irq] = 0xFFFFFFFF;
+            }
+        }
+    }
+    
+    return ioapic_count > 0 && lapic_base != 0;
+}
+
+// Enable the calling CPU's local APIC
+void lapic_enable(void)
+{
+    uint64_t base = rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base | IA32_APIC_BASE_ENABLE);
+    
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);  // ExtINT from the 8259
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_SVR, 0x100 | APIC_SPURIOUS_VECTOR);
+}
+
+void lapic_mask_all(void)
+{
+    if (!apic_is_enabled()) {
+        return;
+    }
+    
+    // Thermal and performance counter entries are optional (max LVT, bits 16-23)
+    uint32_t max_lvt = (lapic_read(LAPIC_VERSION) >> 16) & 0xFF;
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    if (max_lvt >= 4) {
+        lapic_write(LAPIC_LVT_PERF, LAPIC_LVT_MASKED);
+    }
+    if (max_lvt >= 5) {
+        lapic_write(LAPIC_LVT_THERMAL, LAPIC_LVT_MASKED);
+    }
+}
+
+// Send an IPI and wait until the LAPIC has accepted it
+bool lapic_send_ipi(uint8_t apic_id, uint32_t command)
+{
+    // The ICR is two writes, another sender on this CPU must not get between them
+    uint64_t flags = irq_save();
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    
+    bool sent = false;
+    for (int spins = 0; spins < LAPIC_IPI_TIMEOUT; spins++) {
+        if (!(lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING)) {
+            sent = true;
+            break;
+        }
+        __asm__ volatile ("pause");
+    }
+    irq_restore(flags);
+    return sent;
+}
+
+// Initialize APICs
+void apic_init(void)
+{
+    if (!apic_parse_madt()) {
+        return;  // Stay on the 8259
+    }
+    
+    if (!paging_map_mmio(lapic_base, 0x1000)) {
+        return;
+    }
+    for (int i = 0; i < ioapic_count; i++) {
+        if (!paging_map_mmio(ioapics[i].address, 0x1000)) {
+            return;
+        }
+        ioapics[i].gsi_count = ((ioapic_read(&ioapics[i], IOAPIC_VER) >> 16) & 0xFF) + 1;
+    }
+    
+    lapic_enable();
+    
+    // Mask every IOAPIC pin, then route the ISA IRQs (still masked) to
+    // vector 32 + irq on this CPU. irq_install_handler() unmasks them.
+    for (int i = 0; i < ioapic_count; i++) {
+        for (uint32_t pin = 0; pin < ioapics[i].gsi_count; pin++) {
+            ioapic_set_entry(ioapics[i].gsi_base + pin, IOAPIC_MASKED);
+        }
+    }
+    
+    uint64_t dest = (uint64_t)lapic_get_id() << 56;
+    for (int irq = 0; irq < 16; irq++) {
+        if (isa_gsi[irq] != 0xFFFFFFFF) {
+            ioapic_set_entry(isa_gsi[irq], dest | IOAPIC_MASKED | isa_flags[irq] | (32 + irq));
+        }
+    }
+    
+    // Route through the IMCR on chipsets that have one, then silence the 8259
+    outb(0x22, 0x70);
+    outb(0x23, 0x01);
+    pic_disable();
+    
+    apic_enabled = true;
+}
+INITCALL(INITCALL_CORE, apic_init, "idt_init");
+
+bool apic_is_enabled(void)
+{
+    return apic_enabled;
+}
+
+const apic_cpu_t *apic_get_cpus(int *count)
+{
+    if (count) *count = cpu_count;
+    return cpus;
+}
+
+const ioapic_t *apic_get_ioapics(int *count)
+{
+    if (count) *count = ioapic_count;
+    return ioapics;
+}
+
+uint64_t apic_get_lapic_address(void)
+{
+    return lapic_base;
+}
+
+int apic_cpu_index(uint8_t apic_id)
+{
+    for (int i = 0; i < cpu_count; i++) {
+        if (cpus[i].apic_id == apic_id) {
+            return i;
+        }
+    }
+    return -1;
+}
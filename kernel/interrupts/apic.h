@@ -0,0 +1,113 @@
+// kernel/interrupts/apic.h - Local APIC and I/O APIC (discovered through the ACPI MADT)
+
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Local APIC register offsets
+#define LAPIC_ID            0x020
+#define LAPIC_VERSION       0x030
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0
+#define LAPIC_ESR           0x280
+#define LAPIC_ICR_LOW       0x300
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_THERMAL   0x330
+#define LAPIC_LVT_PERF      0x340
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_INIT    0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_LVT_MASKED    0x10000
+
+// ICR command bits
+#define LAPIC_ICR_INIT      0x00500
+#define LAPIC_ICR_STARTUP   0x00600
+#define LAPIC_ICR_PENDING   0x01000     // Delivery status
+#define LAPIC_ICR_ASSERT    0x04000
+#define LAPIC_ICR_LEVEL     0x08000
+
+// Polls of the delivery status before an IPI counts as lost
+#define LAPIC_IPI_TIMEOUT   100000
+
+// LVT timer modes
+#define LAPIC_TIMER_ONESHOT      0x00000
+#define LAPIC_TIMER_PERIODIC     0x20000
+#define LAPIC_TIMER_TSC_DEADLINE 0x40000
+
+// Vector for spurious LAPIC interrupts (never gets an EOI)
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// Vector of the local APIC timer
+#define LAPIC_TIMER_VECTOR 0xF2
+
+// Limits
+#define APIC_MAX_CPUS    32
+#define APIC_MAX_IOAPICS 4
+
+// A CPU listed in the MADT
+typedef struct {
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    bool enabled;
+} apic_cpu_t;
+
+// An I/O APIC listed in the MADT
+typedef struct {
+    uint8_t id;
+    uint64_t address;
+    uint32_t gsi_base;
+    uint32_t gsi_count;
+} ioapic_t;
+
+// Parse the MADT, switch from the 8259 to LAPIC + IOAPIC delivery
+void apic_init(void);
+
+// Whether interrupts are delivered through the APICs (false = legacy PIC)
+bool apic_is_enabled(void);
+
+// Signal end of interrupt to the local APIC
+void lapic_eoi(void);
+
+// Software-enable the calling CPU's local APIC (apic_init() does the BSP)
+void lapic_enable(void);
+
+// Mask every local interrupt source of the calling CPU and stop its timer
+// (for handing the CPU to another kernel)
+void lapic_mask_all(void);
+
+// Send an interprocessor interrupt (LAPIC_ICR_* | vector)
+bool lapic_send_ipi(uint8_t apic_id, uint32_t command);
+
+// Local APIC register access
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+
+// APIC ID of the running CPU
+uint8_t lapic_get_id(void);
+
+// Mask or unmask an ISA IRQ (0-15) at its IOAPIC pin
+void ioapic_set_isa_mask(int irq, bool masked);
+
+// Deliver an ISA IRQ to another local APIC (physical destination mode)
+bool ioapic_set_isa_destination(int irq, uint8_t apic_id);
+
+// Global system interrupt an ISA IRQ is wired to (after MADT overrides)
+uint32_t ioapic_isa_to_gsi(int irq);
+
+// MADT contents
+const apic_cpu_t *apic_get_cpus(int *count);
+const ioapic_t *apic_get_ioapics(int *count);
+uint64_t apic_get_lapic_address(void);
+
+// Index into apic_get_cpus() for an APIC ID, -1 if it isn't listed
+int apic_cpu_index(uint8_t apic_id);
+
+#endif // APIC_H
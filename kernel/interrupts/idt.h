@@ -28,6 +28,9 @@ typedef struct {
 // Initialize the IDT
 void idt_init(void);
 
+// Load the IDT on the calling CPU
+void idt_load(void);
+
 // Set an IDT gate
 void idt_set_gate(uint8_t num, uint64_t handler, uint16_t selector, uint8_t flags);
 
@@ -0,0 +1,302 @@
+// kernel/interrupts/irqbalance.c - IRQ affinity and the interrupt balancer
+//
+// APs join the pool as they come up (smp_ap_main()) and leave it before
+// they're stopped, so vectors only ever point at CPUs that take them. The
+// table is changed from the timer softirq, the shell and the CPUs coming
+// and going, all under affinity_lock, which also serializes reprogramming
+// the IOAPIC and MSI sources.
+
+#include "irqbalance.h"
+#include "apic.h"
+#include "irqstat.h"
+#include "idt.h"
+#include "../drivers/timer.h"
+#include "../drivers/timerwheel.h"
+#include "../lib/cpu.h"
+#include "../lib/spinlock.h"
+#include <stddef.h>
+#include "../initcall.h"
+
+static irq_affinity_t affinity[IDT_ENTRIES];
+
+// Online CPUs, one bit per apic_get_cpus() index
+static uint32_t cpu_online = 0;
+static int boot_cpu = 0;
+
+static spinlock_t affinity_lock = SPINLOCK_INIT("irq_affinity");
+
+bool irq_cpu_is_online(int cpu)
+{
+    return cpu >= 0 && cpu < APIC_MAX_CPUS && (cpu_online & (1U << cpu));
+}
+
+// Point a vector's source at a CPU
+static bool irq_affinity_program(int vector, int cpu)
+{
+    irq_affinity_t *a = &affinity[vector];
+    
+    int count;
+    const apic_cpu_t *cpus = apic_get_cpus(&count);
+    if (cpu >= count || !irq_cpu_is_online(cpu)) {
+        return false;
+    }
+    
+    if (!a->retarget(vector, cpus[cpu].apic_id)) {
+        return false;
+    }
+    if (a->cpu != cpu) {
+        a->cpu = cpu;
+        a->moves++;
+    }
+    return true;
+}
+
+// ISA IRQs go through their IOAPIC pin
+static bool irq_isa_retarget(int vector, uint8_t apic_id)
+{
+    return ioapic_set_isa_destination(vector - 32, apic_id);
+}
+
+// Register a steerable vector
+void irq_affinity_add(int vector, int cpu, irq_retarget_t retarget)
+{
+    if (vector < 0 || vector >= IDT_ENTRIES || retarget == 0) {
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&affinity_lock);
+    irq_affinity_t *a = &affinity[vector];
+    a->steerable = true;
+    a->mode = IRQ_AFFINITY_AUTO;
+    a->cpu = cpu;
+    a->hint = -1;
+    a->retarget = retarget;
+    a->load = 0;
+    a->moves = 0;
+    
+    // Only count what arrives from now on
+    const irqstat_t *stat = irqstat_get(vector);
+    a->last_cycles = stat ? stat->total_cycles : 0;
+    a->last_fast = stat ? stat->fast_count : 0;
+    spin_unlock_irqrestore(&affinity_lock, flags);
+}
+
+void irq_affinity_remove(int vector)
+{
+    if (vector >= 0 && vector < IDT_ENTRIES) {
+        uint64_t flags = spin_lock_irqsave(&affinity_lock);
+        affinity[vector].steerable = false;
+        spin_unlock_irqrestore(&affinity_lock, flags);
+    }
+}
+
+// Pin a vector
+bool irq_set_affinity(int vector, int cpu)
+{
+    if (vector < 0 || vector >= IDT_ENTRIES || !affinity[vector].steerable) {
+        return false;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&affinity_lock);
+    bool ok = irq_affinity_program(vector, cpu);
+    if (ok) {
+        affinity[vector].mode = IRQ_AFFINITY_PINNED;
+    }
+    spin_unlock_irqrestore(&affinity_lock, flags);
+    return ok;
+}
+
+void irq_clear_affinity(int vector)
+{
+    if (vector >= 0 && vector < IDT_ENTRIES) {
+        uint64_t flags = spin_lock_irqsave(&affinity_lock);
+        affinity[vector].mode = IRQ_AFFINITY_AUTO;
+        affinity[vector].hint = -1;
+        spin_unlock_irqrestore(&affinity_lock, flags);
+    }
+}
+
+// Prefer a CPU, moving there right away
+bool irq_set_affinity_hint(int vector, int cpu)
+{
+    if (vector < 0 || vector >= IDT_ENTRIES || !affinity[vector].steerable ||
+        cpu < 0 || cpu >= APIC_MAX_CPUS) {
+        return false;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&affinity_lock);
+    irq_affinity_t *a = &affinity[vector];
+    a->mode = IRQ_AFFINITY_HINT;
+    a->hint = cpu;
+    if (irq_cpu_is_online(cpu)) {
+        irq_affinity_program(vector, cpu);
+    }
+    spin_unlock_irqrestore(&affinity_lock, flags);
+    return true;
+}
+
+const irq_affinity_t *irq_get_affinity(int vector)
+{
+    if (vector < 0 || vector >= IDT_ENTRIES) {
+        return NULL;
+    }
+    return &affinity[vector];
+}
+
+// Bring a CPU in or out of the interrupt pool
+void irq_cpu_set_online(int cpu, bool online)
+{
+    if (cpu < 0 || cpu >= APIC_MAX_CPUS) {
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&affinity_lock);
+    if (online) {
+        cpu_online |= 1U << cpu;
+    } else if (cpu != boot_cpu) {
+        cpu_online &= ~(1U << cpu);
+        
+        // Nothing may be left aimed at a CPU that stopped taking interrupts
+        for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+            if (affinity[vector].steerable && affinity[vector].cpu == cpu) {
+                irq_affinity_program(vector, boot_cpu);
+            }
+        }
+    }
+    spin_unlock_irqrestore(&affinity_lock, flags);
+}
+
+// Counter difference, tolerating an 'irqstat reset' in between
+static uint64_t irq_balance_delta(uint64_t now, uint64_t last)
+{
+    return now >= last ? now - last : now;
+}
+
+// One balancing pass: place the heaviest vectors first, each on its hinted or
+// current CPU unless that would push the CPU past an even share plus slack
+int irq_balance_run(void)
+{
+    uint64_t cpu_load[APIC_MAX_CPUS] = {0};
+    bool placed[IDT_ENTRIES] = {0};
+    uint64_t total = 0;
+    int online = 0;
+    int moved = 0;
+    
+    uint64_t flags = spin_lock_irqsave(&affinity_lock);
+    
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (irq_cpu_is_online(cpu)) {
+            online++;
+        }
+    }
+    
+    // Sample the counters, pinned vectors stay where they are
+    for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+        irq_affinity_t *a = &affinity[vector];
+        if (!a->steerable) {
+            placed[vector] = true;
+            continue;
+        }
+        
+        const irqstat_t *stat = irqstat_get(vector);
+        a->load = irq_balance_delta(stat->total_cycles, a->last_cycles) +
+                  irq_balance_delta(stat->fast_count, a->last_fast) * IRQ_BALANCE_FAST_COST;
+        a->last_cycles = stat->total_cycles;
+        a->last_fast = stat->fast_count;
+        total += a->load;
+        
+        if (a->mode == IRQ_AFFINITY_PINNED && irq_cpu_is_online(a->cpu)) {
+            cpu_load[a->cpu] += a->load;
+            placed[vector] = true;
+        }
+    }
+    
+    if (online < 2) {
+        spin_unlock_irqrestore(&affinity_lock, flags);
+        return 0;
+    }
+    
+    uint64_t share = total / online;
+    uint64_t limit = share + share * IRQ_BALANCE_SLACK / 100;
+    
+    for (;;) {
+        int heaviest = -1;
+        for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+            if (!placed[vector] &&
+                (heaviest < 0 || affinity[vector].load > affinity[heaviest].load)) {
+                heaviest = vector;
+            }
+        }
+        if (heaviest < 0) {
+            break;
+        }
+        placed[heaviest] = true;
+        
+        irq_affinity_t *a = &affinity[heaviest];
+        
+        int least = -1;
+        for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+            if (irq_cpu_is_online(cpu) && (least < 0 || cpu_load[cpu] < cpu_load[least])) {
+                least = cpu;
+            }
+        }
+        
+        // The consumer's CPU if there is one, else stay put to keep caches warm
+        int target = a->cpu;
+        if (a->mode == IRQ_AFFINITY_HINT && irq_cpu_is_online(a->hint)) {
+            target = a->hint;
+        }
+        if (!irq_cpu_is_online(target)) {
+            target = least;
+        }
+        
+        if (a->load > 0 && cpu_load[target] + a->load > limit && cpu_load[least] < cpu_load[target]) {
+            target = least;
+        }
+        cpu_load[target] += a->load;
+        
+        if (target != a->cpu && irq_affinity_program(heaviest, target)) {
+            moved++;
+        }
+    }
+    
+    spin_unlock_irqrestore(&affinity_lock, flags);
+    return moved;
+}
+
+// Periodic pass from the timer softirq. The interval is generous, so give
+// the wheel a lot of slack to fold it into other wakeups.
+static void irq_balance_timer(void *arg)
+{
+    (void)arg;
+    irq_balance_run();
+    timer_add_slack(timer_get_uptime_ms() + IRQ_BALANCE_INTERVAL_MS,
+                    IRQ_BALANCE_INTERVAL_MS / 4, irq_balance_timer, NULL);
+}
+
+// Initialize
+void irq_balance_init(void)
+{
+    boot_cpu = apic_cpu_index(lapic_get_id());
+    if (boot_cpu < 0) {
+        boot_cpu = 0;
+    }
+    cpu_online = 1U << boot_cpu;
+    
+    timer_add_slack(IRQ_BALANCE_INTERVAL_MS, IRQ_BALANCE_INTERVAL_MS / 4, irq_balance_timer, NULL);
+    
+    if (!apic_is_enabled()) {
+        return;  // The 8259 only talks to the boot CPU
+    }
+    
+    // apic_init() routed every ISA IRQ to this CPU
+    for (int irq = 0; irq < 16; irq++) {
+        if (ioapic_isa_to_gsi(irq) != 0xFFFFFFFF) {
+            irq_affinity_add(32 + irq, boot_cpu, irq_isa_retarget);
+        }
+    }
+    
+    // The tick stays with the boot CPU: its timer wheel wakes the threads there
+    affinity[32].mode = IRQ_AFFINITY_PINNED;
+}
+INITCALL(INITCALL_CORE, irq_balance_init, "apic_init");
@@ -0,0 +1,67 @@
+// kernel/interrupts/irqbalance.h - IRQ affinity and the interrupt balancer
+
+#ifndef IRQBALANCE_H
+#define IRQBALANCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// How often the balancer looks at the interrupt counters
+#define IRQ_BALANCE_INTERVAL_MS 1000
+
+// Fast-path interrupts aren't timed, charge them this many cycles each
+#define IRQ_BALANCE_FAST_COST 500
+
+// A CPU may carry this much more than an even share (in %) before its
+// interrupts are spread to other CPUs
+#define IRQ_BALANCE_SLACK 25
+
+// Affinity modes
+#define IRQ_AFFINITY_AUTO   0   // Balancer decides
+#define IRQ_AFFINITY_HINT   1   // Balancer prefers the hinted CPU (the queue's consumer)
+#define IRQ_AFFINITY_PINNED 2   // Never moved by the balancer
+
+// Reprograms a vector's source (IOAPIC pin, MSI address) to another LAPIC
+typedef bool (*irq_retarget_t)(int vector, uint8_t apic_id);
+
+// Per-vector affinity, CPU numbers are indexes into apic_get_cpus()
+typedef struct {
+    bool steerable;             // Routed through an IOAPIC pin or MSI/MSI-X
+    uint8_t mode;
+    int8_t cpu;                 // Where it's delivered now
+    int8_t hint;                // Preferred CPU for IRQ_AFFINITY_HINT
+    irq_retarget_t retarget;
+
+    // Balancer bookkeeping
+    uint64_t last_cycles;
+    uint64_t last_fast;
+    uint64_t load;              // Handler cycles during the last interval
+    uint32_t moves;
+} irq_affinity_t;
+
+// Mark the boot CPU online and make the ISA IRQs steerable
+void irq_balance_init(void);
+
+// A vector whose destination can be changed (called by the IOAPIC and MSI code)
+void irq_affinity_add(int vector, int cpu, irq_retarget_t retarget);
+void irq_affinity_remove(int vector);
+
+// Pin a vector to a CPU
+bool irq_set_affinity(int vector, int cpu);
+
+// Let the balancer move a vector again
+void irq_clear_affinity(int vector);
+
+// Prefer a CPU (the one that consumes the queue's data) while it isn't overloaded
+bool irq_set_affinity_hint(int vector, int cpu);
+
+const irq_affinity_t *irq_get_affinity(int vector);
+
+// CPUs interrupts may be sent to. Taking a CPU offline moves its vectors away.
+void irq_cpu_set_online(int cpu, bool online);
+bool irq_cpu_is_online(int cpu);
+
+// Run one balancing pass now (a wheel timer does this every IRQ_BALANCE_INTERVAL_MS), returns the number of vectors moved
+int irq_balance_run(void);
+
+#endif // IRQBALANCE_H
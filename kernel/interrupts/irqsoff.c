@@ -0,0 +1,134 @@
+// kernel/interrupts/irqsoff.c - Tracer for sections that run with interrupts disabled
+
+#include "irqsoff.h"
+#include "../lib/cpu.h"
+#include "../lib/string.h"
+#include "../smp.h"
+
+static bool enabled = true;
+
+// The section currently open (interrupts are off, so nothing races with it).
+// Only the boot CPU's sections are traced, that's where device interrupts
+// have to get through.
+static bool open = false;
+static uint64_t open_tsc = 0;
+static const char *open_site = NULL;
+static int open_vector = -1;
+
+static irqsoff_site_t sites[IRQSOFF_MAX_SITES];
+static int site_count = 0;
+static uint64_t sections = 0;
+
+void irqsoff_begin(const char *site, int vector)
+{
+    if (!enabled || open || smp_processor_id() != smp_boot_cpu()) {
+        return;
+    }
+    open = true;
+    open_site = site;
+    open_vector = vector;
+    open_tsc = rdtsc();
+}
+
+void irqsoff_irq_enter(int vector)
+{
+    irqsoff_begin("irq", vector);
+}
+
+// Charge a finished section to its site
+void irqsoff_end(void)
+{
+    if (!open || smp_processor_id() != smp_boot_cpu()) {
+        return;
+    }
+    
+    uint64_t now = rdtsc();
+    uint64_t cycles = now - open_tsc;
+    open = false;
+    sections++;
+    
+    irqsoff_site_t *slot = NULL;
+    for (int i = 0; i < site_count; i++) {
+        if (sites[i].site == open_site && sites[i].vector == open_vector) {
+            slot = &sites[i];
+            break;
+        }
+    }
+    
+    if (slot == NULL) {
+        if (site_count < IRQSOFF_MAX_SITES) {
+            slot = &sites[site_count++];
+        } else {
+            // Full: replace the site with the mildest worst case, if this beats it
+            slot = &sites[0];
+            for (int i = 1; i < site_count; i++) {
+                if (sites[i].max_cycles < slot->max_cycles) {
+                    slot = &sites[i];
+                }
+            }
+            if (cycles <= slot->max_cycles) {
+                return;
+            }
+        }
+        memset(slot, 0, sizeof(irqsoff_site_t));
+        slot->site = open_site;
+        slot->vector = open_vector;
+    }
+    
+    slot->count++;
+    slot->total_cycles += cycles;
+    if (cycles > slot->max_cycles) {
+        slot->max_cycles = cycles;
+        slot->max_tsc = now;
+    }
+}
+
+void irqsoff_set_enabled(bool on)
+{
+    uint64_t flags = irq_save();
+    enabled = on;
+    if (!on) {
+        open = false;
+    }
+    irq_restore(flags);
+}
+
+bool irqsoff_is_enabled(void)
+{
+    return enabled;
+}
+
+// Sorted copy, so the table can keep changing underneath the caller
+int irqsoff_get_worst(irqsoff_site_t *out, int max)
+{
+    uint64_t flags = irq_save();
+    int count = site_count < max ? site_count : max;
+    bool taken[IRQSOFF_MAX_SITES] = {0};
+    
+    for (int n = 0; n < count; n++) {
+        int worst = -1;
+        for (int i = 0; i < site_count; i++) {
+            if (!taken[i] && (worst < 0 || sites[i].max_cycles > sites[worst].max_cycles)) {
+                worst = i;
+            }
+        }
+        taken[worst] = true;
+        out[n] = sites[worst];
+    }
+    irq_restore(flags);
+    return count;
+}
+
+uint64_t irqsoff_get_sections(void)
+{
+    return sections;
+}
+
+void irqsoff_reset(void)
+{
+    uint64_t flags = irq_save();
+    memset(sites, 0, sizeof(sites));
+    site_count = 0;
+    sections = 0;
+    irq_restore(flags);
+}
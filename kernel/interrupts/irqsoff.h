@@ -0,0 +1,40 @@
+// kernel/interrupts/irqsoff.h - Tracer for sections that run with interrupts disabled
+
+#ifndef IRQSOFF_H
+#define IRQSOFF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Distinct call sites remembered (the shortest worst case is evicted first)
+#define IRQSOFF_MAX_SITES 24
+
+// Where interrupts went off and how long they stayed off
+typedef struct {
+    const char *site;           // Function that disabled them ("irq" for handlers)
+    int vector;                 // Interrupt vector for handler sections, else -1
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    uint64_t max_tsc;           // When the worst one ended
+} irqsoff_site_t;
+
+// Open/close a section (irq_save()/irq_restore() call these on the outermost
+// transition, the IRQ entry paths call irqsoff_irq_enter())
+void irqsoff_begin(const char *site, int vector);
+void irqsoff_end(void);
+void irqsoff_irq_enter(int vector);
+
+// Turn recording on or off (on by default)
+void irqsoff_set_enabled(bool enabled);
+bool irqsoff_is_enabled(void);
+
+// Copy up to max sites into out, worst first. Returns how many were copied.
+int irqsoff_get_worst(irqsoff_site_t *out, int max);
+
+// Total number of sections measured
+uint64_t irqsoff_get_sections(void);
+
+void irqsoff_reset(void);
+
+#endif // IRQSOFF_H
@@ -0,0 +1,88 @@
+// kernel/interrupts/irqstat.c - Per-vector interrupt counters and handler latency histograms
+
+#include "irqstat.h"
+#include "idt.h"
+#include "../lib/string.h"
+#include "../lib/cpu.h"
+#include "../smp.h"
+
+static irqstat_t stats[IDT_ENTRIES];
+
+// Index of the highest set bit
+static inline int irqstat_bucket(uint64_t cycles)
+{
+    if (cycles == 0) {
+        return 0;
+    }
+    int bucket = 63 - __builtin_clzll(cycles);
+    return bucket < IRQSTAT_BUCKETS ? bucket : IRQSTAT_BUCKETS - 1;
+}
+
+// Record an interrupt
+void irqstat_record(int vector, uint64_t cycles)
+{
+    if (vector < 0 || vector >= IDT_ENTRIES) {
+        return;
+    }
+    
+    irqstat_t *stat = &stats[vector];
+    
+    if (stat->count == 0 || cycles < stat->min_cycles) {
+        stat->min_cycles = cycles;
+    }
+    if (cycles > stat->max_cycles) {
+        stat->max_cycles = cycles;
+    }
+    stat->count++;
+    stat->last_cpu = smp_processor_id();
+    stat->total_cycles += cycles;
+    stat->histogram[irqstat_bucket(cycles)]++;
+}
+
+// Count a fast-path interrupt
+void irqstat_count(int vector)
+{
+    if (vector >= 0 && vector < IDT_ENTRIES) {
+        stats[vector].fast_count++;
+        stats[vector].last_cpu = smp_processor_id();
+    }
+}
+
+const irqstat_t *irqstat_get(int vector)
+{
+    if (vector < 0 || vector >= IDT_ENTRIES) {
+        return NULL;
+    }
+    return &stats[vector];
+}
+
+// Walk the histogram until 99% of the samples are covered
+uint64_t irqstat_p99(const irqstat_t *stat)
+{
+    uint64_t samples = 0;
+    for (int b = 0; b < IRQSTAT_BUCKETS; b++) {
+        samples += stat->histogram[b];
+    }
+    if (samples == 0) {
+        return 0;
+    }
+    
+    uint64_t target = samples - samples / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < IRQSTAT_BUCKETS; b++) {
+        seen += stat->histogram[b];
+        if (seen >= target) {
+            uint64_t upper = 2ULL << b;
+            return upper < stat->max_cycles ? upper : stat->max_cycles;
+        }
+    }
+    return stat->max_cycles;
+}
+
+// Clear all counters
+void irqstat_reset(void)
+{
+    uint64_t flags = irq_save();
+    memset(stats, 0, sizeof(stats));
+    irq_restore(flags);
+}
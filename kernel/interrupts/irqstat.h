@@ -0,0 +1,36 @@
+// kernel/interrupts/irqstat.h - Per-vector interrupt counters and handler latency histograms
+
+#ifndef IRQSTAT_H
+#define IRQSTAT_H
+
+#include <stdint.h>
+
+// Handler durations go into power-of-two cycle buckets (bucket b = [2^b, 2^(b+1)))
+#define IRQSTAT_BUCKETS 32
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t min_cycles;
+    uint64_t max_cycles;
+    uint32_t histogram[IRQSTAT_BUCKETS];
+    uint64_t fast_count;        // Fast-path interrupts (counted, not timed)
+    int last_cpu;               // CPU that took the latest one
+} irqstat_t;
+
+// Record one interrupt on a vector (called from irq_handler)
+void irqstat_record(int vector, uint64_t cycles);
+
+// Count an interrupt that came through the fast path (not timed)
+void irqstat_count(int vector);
+
+// Stats for a vector (NULL if out of range)
+const irqstat_t *irqstat_get(int vector);
+
+// Approximate 99th percentile handler duration (upper edge of the bucket)
+uint64_t irqstat_p99(const irqstat_t *stat);
+
+// Clear all counters
+void irqstat_reset(void);
+
+#endif // IRQSTAT_H
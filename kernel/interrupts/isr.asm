@@ -4,6 +4,11 @@
 
 extern isr_handler
 extern irq_handler
+extern irq_fast_exit
+extern irq_fast_preempt
+extern irq_fast_handlers
+extern irqsoff_irq_enter
+extern thread_switch_finish
 
 ; Macro for ISRs without error code
 %macro ISR_NOERRCODE 1
@@ -22,15 +27,6 @@ isr%1:
     jmp isr_common
 %endmacro
 
-; Macro for IRQs
-%macro IRQ 2
-global irq%1
-irq%1:
-    push qword 0
-    push qword %2
-    jmp irq_common
-%endmacro
-
 ; Define all ISRs (0-31)
 ISR_NOERRCODE 0
 ISR_NOERRCODE 1
@@ -65,26 +61,35 @@ ISR_NOERRCODE 29
 ISR_ERRCODE   30
 ISR_NOERRCODE 31
 
-; Define all IRQs (32-47)
-IRQ 0,  32
-IRQ 1,  33
-IRQ 2,  34
-IRQ 3,  35
-IRQ 4,  36
-IRQ 5,  37
-IRQ 6,  38
-IRQ 7,  39
-IRQ 8,  40
-IRQ 9,  41
-IRQ 10, 42
-IRQ 11, 43
-IRQ 12, 44
-IRQ 13, 45
-IRQ 14, 46
-IRQ 15, 47
+; Hardware interrupt vectors 32-255 (ISA IRQ n = vector 32 + n)
+%assign vec 32
+%rep 224
+irq_vector%[vec]:
+    push qword 0
+    push qword vec
+    jmp irq_common
+%assign vec vec + 1
+%endrep
+
+; Fast path stubs for irq_fast_handler_t handlers (vectors 32-255)
+%assign vec 32
+%rep 224
+irq_fast%[vec]:
+    push rax
+    push rcx
+    mov ecx, vec
+    jmp irq_fast_common
+%assign vec vec + 1
+%endrep
 
-; Common ISR stub
+; Common ISR stub. All three entry paths find the CPU's CS 24 bytes up
+; from the stack pointer (below it two words pushed by the vector stub).
 isr_common:
+    ; From user mode: GS goes back to the kernel's per-CPU area
+    test byte [rsp + 24], 3
+    jz .from_kernel
+    swapgs
+.from_kernel:
     ; Save ALL registers
     push rax
     push rbx
@@ -137,11 +142,22 @@ isr_common:
     ; Remove error code and int number from stack
     add rsp, 16
     
+    ; Back to user mode: give the program its GS again
+    test byte [rsp + 8], 3
+    jz .to_kernel
+    swapgs
+.to_kernel:
+    
     ; Return from interrupt
     iretq
 
 ; Common IRQ stub
 irq_common:
+    ; From user mode: GS goes back to the kernel's per-CPU area
+    test byte [rsp + 24], 3
+    jz .from_kernel
+    swapgs
+.from_kernel:
     ; Save ALL registers (same as ISR)
     push rax
     push rbx
@@ -166,11 +182,18 @@ irq_common:
     mov rbp, rsp
     and rsp, ~0xF
     
-    ; Call C handler
+    ; Call C handler, it returns the frame to resume: ours, or another
+    ; thread's saved frame when it switched threads (see sched/thread.c)
     call irq_handler
+.resume:
+    mov rsp, rax
     
-    ; Restore stack
-    mov rsp, rbp
+    ; Switched threads: now that we're off its stack, the previous one may
+    ; be resumed by another CPU
+    cmp rax, rbp
+    je .same_thread
+    call thread_switch_finish
+.same_thread:
     
     ; Restore ALL registers
     pop r15
@@ -192,5 +215,130 @@ irq_common:
     ; Remove error code and int number
     add rsp, 16
     
+    ; Back to user mode (the frame may be another thread's): give the
+    ; program its GS again
+    test byte [rsp + 8], 3
+    jz .to_kernel
+    swapgs
+.to_kernel:
+    
     ; Return from interrupt
-    iretq
\ No newline at end of file
+    iretq
+
+; Fast IRQ path - only the caller-clobbered registers are saved, because the
+; handler is a plain SysV C function that preserves rbx, rbp and r12-r15.
+; No registers_t frame, no realignment: the CPU aligns the stack to 16 bytes
+; before pushing its 40 byte frame, and the 9 pushes + 16 below restore it.
+; rcx = vector (rax and rcx already pushed by the per-vector stub)
+irq_fast_common:
+    ; From user mode: GS goes back to the kernel's per-CPU area
+    test byte [rsp + 24], 3
+    jz .from_kernel
+    swapgs
+.from_kernel:
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    sub rsp, 16
+    mov [rsp], rcx
+    
+    ; Start the irqsoff section (see irqsoff.c)
+    mov edi, ecx
+    call irqsoff_irq_enter
+    
+    ; Direct dispatch: irq_fast_handlers[vector](vector)
+    mov rcx, [rsp]
+    mov edi, ecx
+    call [irq_fast_handlers + rcx * 8]
+    
+    ; EOI, stats and softirqs. Nonzero if they woke a thread that should
+    ; have the CPU right away.
+    mov rdi, [rsp]
+    call irq_fast_exit
+    test eax, eax
+    jnz .preempt
+    
+    add rsp, 16
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    
+    ; Back to user mode: give the program its GS again
+    test byte [rsp + 8], 3
+    jz .to_kernel
+    swapgs
+.to_kernel:
+    iretq
+
+.preempt:
+    ; A thread switch needs a registers_t frame. Put the registers back,
+    ; turn the stub's two words into the int_no and err_code irq_common's
+    ; stubs push, then save everything the way irq_common does and leave
+    ; through its exit. GS is the kernel's already.
+    mov rcx, [rsp]
+    add rsp, 16
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    xchg rcx, [rsp]
+    xchg rax, [rsp + 8]
+    mov qword [rsp + 8], 0
+    
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rbp
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+    
+    mov rdi, rsp
+    mov rbp, rsp
+    and rsp, ~0xF
+    call irq_fast_preempt
+    jmp irq_common.resume
+
+; Stub addresses for every vector, used by idt_init()
+section .rodata
+global isr_stub_table
+isr_stub_table:
+%assign vec 0
+%rep 32
+    dq isr%[vec]
+%assign vec vec + 1
+%endrep
+%rep 224
+    dq irq_vector%[vec]
+%assign vec vec + 1
+%endrep
+
+; Fast path stubs for vectors 32-255, installed by irq_install_fast_handler()
+global irq_fast_stubs
+irq_fast_stubs:
+%assign vec 32
+%rep 224
+    dq irq_fast%[vec]
+%assign vec vec + 1
+%endrep
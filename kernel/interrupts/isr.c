@@ -1,7 +1,19 @@
 // kernel/interrupts/isr.c - Ultra minimal for debugging
 
 #include "isr.h"
+#include "apic.h"
+#include "irqstat.h"
+#include "softirq.h"
+#include "irqsoff.h"
+#include "../sched/thread.h"
+#include "../sched/cputime.h"
+#include "../smp.h"
+#include "../syscall.h"
+#include "../process.h"
+#include <stdbool.h>
+#include "../lib/cpu.h"
 #include "../lib/io.h"
+#include "../initcall.h"
 
 #define PIC1_COMMAND 0x20
 #define PIC1_DATA 0x21
@@ -9,7 +21,18 @@
 #define PIC2_DATA 0xA1
 #define PIC_EOI 0x20
 
-static irq_handler_t irq_handlers[16] = {0};
+// Indexed by vector - IRQ_BASE_VECTOR (ISA IRQs first, then APIC/MSI vectors)
+static irq_handler_t irq_handlers[IRQ_VECTOR_COUNT] = {0};
+
+// Indexed by vector, called straight from the fast stubs in isr.asm
+irq_fast_handler_t irq_fast_handlers[IDT_ENTRIES] = {0};
+
+// Dynamic vectors in use, one bit per vector
+static uint64_t vector_used[IDT_ENTRIES / 64] = {0};
+
+// Entry stubs (isr.asm)
+extern uint64_t isr_stub_table[];
+extern uint64_t irq_fast_stubs[];
 
 // Remap PIC
 static void pic_remap(void)
@@ -40,10 +63,23 @@ static void pic_remap(void)
     outb(PIC2_DATA, 0xFF);
 }
 
+// Mask every 8259 line (interrupts come through the IOAPIC instead)
+void pic_disable(void)
+{
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
 // ISR handler - MINIMAL (just halt)
 // ISR handler - show exception info
 void isr_handler(registers_t *regs)
 {
+    // A user program's fault only ends that program
+    if (regs->cs & 3) {
+        cputime_switch(CPUTIME_KERNEL);
+        process_fault(regs);
+    }
+    
     // Write to VGA memory
     volatile uint16_t *vga = (volatile uint16_t *)0xB8000;
     vga[0] = 'E' | 0x4F00;  // White on red
@@ -75,38 +111,133 @@ void isr_handler(registers_t *regs)
     }
 }
 
+// Send EOI to whichever controller delivered the interrupt
+static inline void irq_eoi(int irq)
+{
+    if (apic_is_enabled()) {
+        lapic_eoi();
+        return;
+    }
+    
+    if (irq >= 16) {
+        return;
+    }
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
 // IRQ handler - ABSOLUTELY MINIMAL
-void irq_handler(registers_t *regs)
+// Full IRQ path, returns the frame irq_common resumes (another thread's after a switch)
+registers_t *irq_handler(registers_t *regs)
 {
+    // Spurious LAPIC interrupts must not be acknowledged
+    if (regs->int_no == APIC_SPURIOUS_VECTOR) {
+        return regs;
+    }
+    
+    // Ends an idle AP's hlt, or switches to the deadline thread another
+    // CPU queued here. Nothing else to do, and no shared state to touch.
+    if (regs->int_no == SMP_WAKE_VECTOR) {
+        lapic_eoi();
+        return thread_preempt(regs);
+    }
+    
+    // thread_yield() is a software interrupt, nothing to acknowledge either
+    if (regs->int_no == THREAD_YIELD_VECTOR) {
+        return thread_switch(regs);
+    }
+    
+    // So is a system call through the interrupt gate (SYSCALL is the fast way)
+    if (regs->int_no == SYSCALL_INT_VECTOR) {
+        regs->rax = syscall_dispatch(regs->rdi, regs->rsi, regs->rdx,
+                                     regs->r10, regs->r8, regs->rax);
+        return regs;
+    }
+    
+    irqsoff_irq_enter(regs->int_no);
+    cputime_state_t prev = cputime_switch(CPUTIME_IRQ);
+    uint64_t start = rdtsc();
+    
     // Calculate IRQ number
-    int irq = regs->int_no - 32;
+    int irq = regs->int_no - IRQ_BASE_VECTOR;
     
     // Call custom handler if exists
-    if (irq >= 0 && irq < 16 && irq_handlers[irq] != 0) {
+    if (irq >= 0 && irq < IRQ_VECTOR_COUNT && irq_handlers[irq] != 0) {
         irq_handlers[irq](regs);
     }
     
+    irqstat_record(regs->int_no, rdtsc() - start);
+    
     // Send EOI
-    if (irq >= 8) {
-        outb(PIC2_COMMAND, PIC_EOI);
+    irq_eoi(irq);
+    
+    // Deferred work runs with interrupts back on
+    softirq_irq_exit();
+    irqsoff_end();
+    
+    // Round robin: the timer may have asked for the next thread, which
+    // sets the state it resumes in. A killed process doesn't get back to
+    // user mode, its thread exits in the kernel instead.
+    registers_t *next = thread_preempt(regs);
+    if (process_check_killed(next)) {
+        cputime_switch(cputime_frame_state(next));
+    } else if (next == regs) {
+        cputime_switch(prev);
     }
-    outb(PIC1_COMMAND, PIC_EOI);
+    return next;
+}
+
+// Tail of the fast path (irq_fast_common), after the handler ran. True if
+// its deferred work woke a thread that should run now (the shell, for a
+// key), irq_fast_common then goes through irq_fast_preempt().
+bool irq_fast_exit(int vector)
+{
+    irqstat_count(vector);
+    irq_eoi(vector - IRQ_BASE_VECTOR);
+    softirq_irq_exit();
+    irqsoff_end();
+    return thread_need_resched();
+}
+
+// Exit of a fast path interrupt that has to switch threads, on the full
+// frame irq_fast_common built. The interrupt itself is done.
+registers_t *irq_fast_preempt(registers_t *regs)
+{
+    registers_t *next = thread_preempt(regs);
+    if (process_check_killed(next)) {
+        cputime_switch(cputime_frame_state(next));
+    }
+    return next;
 }
 
 // Public EOI
 void pic_send_eoi_public(uint8_t irq)
 {
-    if (irq >= 8) {
-        outb(PIC2_COMMAND, PIC_EOI);
+    irq_eoi(irq);
+}
+
+// Point a vector's IDT gate at the full or the fast entry stub
+static void irq_set_gate(int vector, bool fast)
+{
+    uint64_t flags = irq_save();
+    if (fast) {
+        idt_set_gate(vector, irq_fast_stubs[vector - IRQ_BASE_VECTOR], 0x18, 0x8E);
+    } else {
+        idt_set_gate(vector, isr_stub_table[vector], 0x18, 0x8E);
+        irq_fast_handlers[vector] = 0;
     }
-    outb(PIC1_COMMAND, PIC_EOI);
+    irq_restore(flags);
 }
 
-// Install handler
+// Install handler for an ISA IRQ line and unmask it
 void irq_install_handler(int irq, irq_handler_t handler)
 {
     if (irq >= 0 && irq < 16) {
         irq_handlers[irq] = handler;
+        irq_set_gate(IRQ_BASE_VECTOR + irq, false);
+        ioapic_set_isa_mask(irq, false);
     }
 }
 
@@ -114,16 +245,73 @@ void irq_install_handler(int irq, irq_handler_t handler)
 void irq_uninstall_handler(int irq)
 {
     if (irq >= 0 && irq < 16) {
+        ioapic_set_isa_mask(irq, true);
         irq_handlers[irq] = 0;
     }
 }
 
+// Install handler for a raw vector (LAPIC timer, IPIs, MSI)
+void irq_install_vector_handler(int vector, irq_handler_t handler)
+{
+    if (vector >= IRQ_BASE_VECTOR && vector < IDT_ENTRIES) {
+        irq_handlers[vector - IRQ_BASE_VECTOR] = handler;
+        irq_set_gate(vector, false);
+    }
+}
+
+// Install a fast-path handler
+void irq_install_fast_handler(int vector, irq_fast_handler_t handler)
+{
+    if (vector < IRQ_BASE_VECTOR || vector >= IDT_ENTRIES || handler == 0) {
+        return;
+    }
+    
+    irq_handlers[vector - IRQ_BASE_VECTOR] = 0;
+    irq_fast_handlers[vector] = handler;
+    irq_set_gate(vector, true);
+    
+    if (vector < IRQ_BASE_VECTOR + 16) {
+        ioapic_set_isa_mask(vector - IRQ_BASE_VECTOR, false);
+    }
+}
+
+// Allocate a dynamic vector
+int irq_alloc_vector(void)
+{
+    uint64_t flags = irq_save();
+    for (int vector = IRQ_DYNAMIC_FIRST; vector <= IRQ_DYNAMIC_LAST; vector++) {
+        uint64_t bit = 1ULL << (vector % 64);
+        if (!(vector_used[vector / 64] & bit)) {
+            vector_used[vector / 64] |= bit;
+            irq_restore(flags);
+            return vector;
+        }
+    }
+    irq_restore(flags);
+    return -1;
+}
+
+// Free a dynamic vector
+void irq_free_vector(int vector)
+{
+    if (vector < IRQ_DYNAMIC_FIRST || vector > IRQ_DYNAMIC_LAST) {
+        return;
+    }
+    
+    irq_install_vector_handler(vector, 0);
+    
+    uint64_t flags = irq_save();
+    vector_used[vector / 64] &= ~(1ULL << (vector % 64));
+    irq_restore(flags);
+}
+
 // Initialize
 void isr_init(void)
 {
     pic_remap();
     
-    for (int i = 0; i < 16; i++) {
+    for (int i = 0; i < IRQ_VECTOR_COUNT; i++) {
         irq_handlers[i] = 0;
     }
-}
\ No newline at end of file
+}
+INITCALL(INITCALL_CORE, isr_init, NULL);
@@ -4,6 +4,16 @@
 #define ISR_H
 
 #include <stdint.h>
+#include "idt.h"
+
+// First vector used for hardware interrupts (ISA IRQ n = vector 32 + n)
+#define IRQ_BASE_VECTOR  32
+#define IRQ_VECTOR_COUNT (IDT_ENTRIES - IRQ_BASE_VECTOR)
+
+// Vectors handed out by irq_alloc_vector() (MSI/MSI-X). Everything from
+// 0xF0 up is reserved for fixed system vectors (irqbench, spurious, IPIs, ...)
+#define IRQ_DYNAMIC_FIRST (IRQ_BASE_VECTOR + 16)
+#define IRQ_DYNAMIC_LAST  0xEF
 
 typedef struct {
     uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
@@ -14,10 +24,27 @@ typedef struct {
 
 typedef void (*irq_handler_t)(registers_t *regs);
 
+// Fast-path handler: no register frame, just the vector (see irq_fast_common)
+typedef void (*irq_fast_handler_t)(int vector);
+
 void irq_install_handler(int irq, irq_handler_t handler);
 void irq_uninstall_handler(int irq);
+void irq_install_vector_handler(int vector, irq_handler_t handler);
+
+// Install a fast-path handler on a vector (ISA lines are unmasked too).
+// Fast handlers skip the full register save and the cycle histograms.
+void irq_install_fast_handler(int vector, irq_fast_handler_t handler);
+
+// Reserve a free vector from the dynamic range, -1 if none are left
+int irq_alloc_vector(void);
+
+// Give a vector back (its handler is removed)
+void irq_free_vector(int vector);
 void isr_init(void);
 
+// Mask the legacy 8259 PIC completely
+void pic_disable(void);
+
 // Public EOI function for testing
 void pic_send_eoi_public(uint8_t irq);
 
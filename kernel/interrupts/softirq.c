@@ -0,0 +1,205 @@
+// kernel/interrupts/softirq.c - Deferred interrupt work (softirqs and tasklets)
+//
+// Hard IRQ handlers do the minimum (read the device, queue the data) and
+// raise a softirq. Pending softirqs run right after the EOI with interrupts
+// enabled, so another interrupt can come in while the deferred work runs.
+// Work runs on the CPU whose interrupt raised it: each CPU has its own
+// pending mask and tasklet list, only ever touched by that CPU with
+// interrupts off, so none of it needs a lock. A tasklet's RUN bit keeps it
+// from running on two CPUs at once when it is scheduled again on another
+// CPU while its function is still going.
+
+#include "softirq.h"
+#include "../lib/cpu.h"
+#include "../sched/cputime.h"
+#include "../smp.h"
+
+// Rounds of pending work handled per IRQ exit before leaving the rest to the
+// idle loop, so an interrupt storm can't keep us in softirq context forever
+#define SOFTIRQ_MAX_RESTART 8
+
+static void tasklet_action(void);
+
+static softirq_handler_t handlers[SOFTIRQ_COUNT] = {
+    [SOFTIRQ_TASKLET] = tasklet_action,
+};
+
+static const char *names[SOFTIRQ_COUNT] = {
+    [SOFTIRQ_TIMER] = "timer",
+    [SOFTIRQ_TASKLET] = "tasklet",
+};
+
+static softirq_stat_t stats[SOFTIRQ_COUNT];
+
+typedef struct {
+    volatile uint32_t pending;
+    volatile bool in_softirq;
+    tasklet_t *tasklet_head;
+    tasklet_t *tasklet_tail;
+} __attribute__((aligned(64))) softirq_cpu_t;
+
+static softirq_cpu_t softirq_cpus[APIC_MAX_CPUS];
+
+// Only stable while interrupts are off (or in softirq context, which doesn't move)
+static inline softirq_cpu_t *this_softirq(void)
+{
+    return &softirq_cpus[smp_processor_id()];
+}
+
+void softirq_register(softirq_type_t type, softirq_handler_t handler)
+{
+    if (type < SOFTIRQ_COUNT) {
+        handlers[type] = handler;
+    }
+}
+
+void softirq_raise(softirq_type_t type)
+{
+    if (type < SOFTIRQ_COUNT) {
+        uint64_t flags = irq_save();
+        this_softirq()->pending |= 1u << type;
+        irq_restore(flags);
+        __atomic_fetch_add(&stats[type].raised, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Handle this CPU's pending work, entered and left with interrupts disabled
+static void softirq_do(softirq_cpu_t *sc)
+{
+    sc->in_softirq = true;
+    cputime_state_t prev = cputime_switch(CPUTIME_SOFTIRQ);
+    
+    for (int restart = 0; restart < SOFTIRQ_MAX_RESTART && sc->pending; restart++) {
+        uint32_t work = sc->pending;
+        sc->pending = 0;
+        
+        irqsoff_end();
+        __asm__ volatile ("sti");
+        
+        for (int type = 0; type < SOFTIRQ_COUNT; type++) {
+            if (!(work & (1u << type)) || handlers[type] == 0) {
+                continue;
+            }
+            
+            uint64_t start = rdtsc();
+            handlers[type]();
+            __atomic_fetch_add(&stats[type].cycles, rdtsc() - start, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&stats[type].runs, 1, __ATOMIC_RELAXED);
+        }
+        
+        __asm__ volatile ("cli");
+        irqsoff_begin(__func__, -1);
+    }
+    
+    cputime_switch(prev);
+    sc->in_softirq = false;
+}
+
+// Called at the end of irq_handler()
+void softirq_irq_exit(void)
+{
+    // A nested interrupt leaves its work to the softirq loop it interrupted
+    softirq_cpu_t *sc = this_softirq();
+    if (sc->pending && !sc->in_softirq) {
+        softirq_do(sc);
+    }
+}
+
+// Called from the idle loop for work left over after SOFTIRQ_MAX_RESTART
+void softirq_run(void)
+{
+    uint64_t flags = irq_save();
+    softirq_cpu_t *sc = this_softirq();
+    if (sc->pending && !sc->in_softirq) {
+        softirq_do(sc);
+    }
+    irq_restore(flags);
+}
+
+// A thread that moves CPUs between the two loads isn't in softirq context
+// anyway, but it could see the other CPU's flag
+bool softirq_running(void)
+{
+    uint64_t flags = irq_save();
+    bool running = this_softirq()->in_softirq;
+    irq_restore(flags);
+    return running;
+}
+
+// Tasklets
+void tasklet_init(tasklet_t *tasklet, void (*func)(uint64_t), uint64_t data)
+{
+    tasklet->next = 0;
+    tasklet->func = func;
+    tasklet->data = data;
+    tasklet->state = 0;
+    tasklet->runs = 0;
+}
+
+// Called with interrupts disabled
+static void tasklet_enqueue(softirq_cpu_t *sc, tasklet_t *tasklet)
+{
+    tasklet->next = 0;
+    if (sc->tasklet_tail) {
+        sc->tasklet_tail->next = tasklet;
+    } else {
+        sc->tasklet_head = tasklet;
+    }
+    sc->tasklet_tail = tasklet;
+}
+
+void tasklet_schedule(tasklet_t *tasklet)
+{
+    // Whoever sets SCHED owns the queueing, on whatever CPU that is
+    uint32_t old = __atomic_fetch_or(&tasklet->state, TASKLET_SCHED, __ATOMIC_ACQ_REL);
+    if (old & TASKLET_SCHED) {
+        return;
+    }
+    
+    uint64_t flags = irq_save();
+    tasklet_enqueue(this_softirq(), tasklet);
+    softirq_raise(SOFTIRQ_TASKLET);
+    irq_restore(flags);
+}
+
+// SOFTIRQ_TASKLET handler: run everything queued on this CPU so far
+static void tasklet_action(void)
+{
+    uint64_t flags = irq_save();
+    softirq_cpu_t *sc = this_softirq();
+    tasklet_t *list = sc->tasklet_head;
+    sc->tasklet_head = 0;
+    sc->tasklet_tail = 0;
+    irq_restore(flags);
+    
+    while (list) {
+        tasklet_t *tasklet = list;
+        list = list->next;
+        
+        // Still running on another CPU: try again on the next round
+        uint32_t old = __atomic_fetch_or(&tasklet->state, TASKLET_RUN, __ATOMIC_ACQUIRE);
+        if (old & TASKLET_RUN) {
+            flags = irq_save();
+            tasklet_enqueue(sc, tasklet);
+            softirq_raise(SOFTIRQ_TASKLET);
+            irq_restore(flags);
+            continue;
+        }
+        
+        // SCHED cleared first so the function (or its IRQ) can schedule it again
+        __atomic_fetch_and(&tasklet->state, ~TASKLET_SCHED, __ATOMIC_ACQ_REL);
+        tasklet->func(tasklet->data);
+        tasklet->runs++;
+        __atomic_fetch_and(&tasklet->state, ~TASKLET_RUN, __ATOMIC_RELEASE);
+    }
+}
+
+const softirq_stat_t *softirq_get_stat(softirq_type_t type)
+{
+    return type < SOFTIRQ_COUNT ? &stats[type] : 0;
+}
+
+const char *softirq_get_name(softirq_type_t type)
+{
+    return type < SOFTIRQ_COUNT ? names[type] : "?";
+}
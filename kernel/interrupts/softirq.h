@@ -0,0 +1,63 @@
+// kernel/interrupts/softirq.h - Deferred interrupt work (softirqs and tasklets)
+
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Softirq types, lower number runs first
+typedef enum {
+    SOFTIRQ_TIMER = 0,
+    SOFTIRQ_TASKLET,
+    SOFTIRQ_COUNT
+} softirq_type_t;
+
+typedef void (*softirq_handler_t)(void);
+
+// tasklet_t.state bits
+#define TASKLET_SCHED   (1u << 0)   // Queued on some CPU's list
+#define TASKLET_RUN     (1u << 1)   // Function running on some CPU
+
+// A deferred function, queued from IRQ context, run once per schedule on the
+// CPU that scheduled it, and never on two CPUs at once
+typedef struct tasklet {
+    struct tasklet *next;
+    void (*func)(uint64_t data);
+    uint64_t data;
+    volatile uint32_t state;
+    uint64_t runs;
+} tasklet_t;
+
+// Per-type counters
+typedef struct {
+    uint64_t raised;
+    uint64_t runs;
+    uint64_t cycles;
+} softirq_stat_t;
+
+// Set the handler for a softirq type
+void softirq_register(softirq_type_t type, softirq_handler_t handler);
+
+// Mark a softirq pending on the calling CPU (safe from IRQ context)
+void softirq_raise(softirq_type_t type);
+
+// Run pending softirqs on the way out of an interrupt (interrupts disabled)
+void softirq_irq_exit(void);
+
+// Run pending softirqs from process context (idle loop)
+void softirq_run(void);
+
+// Whether deferred work is running on this CPU right now (threads can't be
+// switched then)
+bool softirq_running(void);
+
+// Tasklets
+void tasklet_init(tasklet_t *tasklet, void (*func)(uint64_t), uint64_t data);
+void tasklet_schedule(tasklet_t *tasklet);
+
+// Statistics
+const softirq_stat_t *softirq_get_stat(softirq_type_t type);
+const char *softirq_get_name(softirq_type_t type);
+
+#endif // SOFTIRQ_H
@@ -8,24 +8,17 @@
 #include "memory/pmm.h"      // ADD
 #include "memory/heap.h"     // ADD
 #include "shell/shell.h"
+#include "sched/thread.h"
+#include "boot_info.h"
+#include "kexec.h"
+#include "initcall.h"
 
-void kernel_main(void)
+// Memory detection and initialization
+static void memory_init(void)
 {
-    // Initialize screen (early)
-    screen_init();
-    
-    // Initialize interrupts
-    isr_init();
-    idt_init();
-    __asm__ volatile ("sti");
-    
-    // Initialize timer
-    timer_init();
-    
-    // Memory detection and initialization
-    uint16_t *mem_info = (uint16_t*)0x9000;
-    uint32_t mem_1mb_16mb = mem_info[0];
-    uint32_t mem_above_16mb = mem_info[2];
+    volatile boot_info_t *boot_info = BOOT_INFO;
+    uint32_t mem_1mb_16mb = boot_info->mem_1mb_16mb;
+    uint32_t mem_above_16mb = boot_info->mem_above_16mb;
     uint32_t total_memory_kb;
     
     if (mem_1mb_16mb == 0 && mem_above_16mb == 0) {
@@ -36,21 +29,30 @@ void kernel_main(void)
     
     pmm_init(total_memory_kb);
     heap_init();
-    
-    // NOW initialize scrollback (after heap is ready)
-    screen_init_scrollback();  // ADD THIS
+}
+INITCALL(INITCALL_MEMORY, memory_init, NULL);
+
+// Interrupts go on once the IDT is loaded and the APICs (or PIC) are set up
+static void interrupts_enable(void)
+{
+    __asm__ volatile ("sti");
+}
+INITCALL(INITCALL_CORE, interrupts_enable, "apic_init");
+
+void kernel_main(void)
+{
+    // Screen, boot info, interrupts, timer, memory, scrollback and keyboard
+    // (see the INITCALL registrations next to each init function).
+    // Device probes keep running from the idle loop once the shell is up.
+    initcall_run_until(INITCALL_CONSOLE);
     
     // Initialize filesystem
     // vfs_init();  // TODO: Implement VFS
     
-    // Initialize keyboard
-    keyboard_init();
-    
     // Initialize and run shell
     shell_init();
     shell_run();
     
-    while (1) {
-        __asm__ volatile ("hlt");
-    }
-}
\ No newline at end of file
+    // Nothing left for this thread, the idle thread takes the CPU
+    thread_exit();
+}
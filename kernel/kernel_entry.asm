@@ -2,6 +2,8 @@
 
 [bits 64]
 [extern kernel_main]
+[extern __bss_start]
+[extern __bss_end]
 
 global _start
 
@@ -20,6 +22,14 @@ _start:
     ; Set up stack
     mov rsp, 0x90000
     
+    ; Zero .bss (after a kexec it still holds the old kernel's data)
+    mov rdi, __bss_start
+    mov rcx, __bss_end
+    sub rcx, rdi
+    xor eax, eax
+    cld
+    rep stosb
+    
     ; Call the C kernel
     call kernel_main
     
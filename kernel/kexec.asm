@@ -0,0 +1,21 @@
+; kernel/kexec.asm - Position independent copy-and-jump stub for kexec
+
+[bits 64]
+
+global kexec_trampoline
+global kexec_trampoline_end
+
+; Copied to low memory and called there, because it overwrites the kernel
+; rdi = destination, rsi = source, rdx = length, rcx = entry point
+kexec_trampoline:
+    cli
+    mov r8, rcx
+    mov rcx, rdx
+    cld
+    rep movsb
+
+    ; Fresh stack, same as the bootloader hands over
+    mov rsp, 0x90000
+    xor rbp, rbp
+    jmp r8
+kexec_trampoline_end:
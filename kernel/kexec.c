@@ -0,0 +1,163 @@
+// kernel/kexec.c - Warm restart into a kernel image without BIOS POST
+
+#include "kexec.h"
+#include "boot_info.h"
+#include "initcall.h"
+#include "drivers/ata.h"
+#include "drivers/pci.h"
+#include "drivers/timer.h"
+#include "interrupts/apic.h"
+#include "memory/paging.h"
+#include "smp.h"
+#include "lib/io.h"
+#include "lib/cpu.h"
+#include "lib/string.h"
+
+// Copy-and-jump stub (kexec.asm), relocated below the kernel before use
+extern uint8_t kexec_trampoline[];
+extern uint8_t kexec_trampoline_end[];
+
+typedef void (*kexec_trampoline_t)(uint64_t dest, uint64_t src,
+                                   uint64_t length, uint64_t entry);
+
+// Boot info captured at startup, handed on to the next kernel
+static uint16_t saved_mem_1mb_16mb = 0;
+static uint16_t saved_mem_above_16mb = 0;
+static uint32_t warm_boots = 0;
+static uint64_t restart_cycles = 0;
+static bool image_loaded = false;
+
+// Read the boot info block
+void kexec_init(void)
+{
+    volatile boot_info_t *info = BOOT_INFO;
+    
+    saved_mem_1mb_16mb = info->mem_1mb_16mb;
+    saved_mem_above_16mb = info->mem_above_16mb;
+    
+    if (info->warm_magic == BOOT_INFO_WARM_MAGIC) {
+        warm_boots = info->warm_boots;
+        restart_cycles = rdtsc() - info->kexec_tsc;
+    } else {
+        warm_boots = 0;
+        restart_cycles = 0;
+    }
+    
+    // Consume the marker so a later cold boot isn't mistaken for a warm one
+    info->warm_magic = 0;
+    image_loaded = false;
+}
+INITCALL(INITCALL_EARLY, kexec_init, NULL);
+
+// Load kernel image from disk
+bool kexec_load(void)
+{
+    image_loaded = false;
+    
+    if (!ata_present()) {
+        return false;
+    }
+    
+    // One READ SECTORS command moves at most 256 sectors
+    for (uint32_t done = 0; done < KEXEC_IMAGE_SECTORS; done += 256) {
+        uint32_t count = KEXEC_IMAGE_SECTORS - done < 256 ? KEXEC_IMAGE_SECTORS - done : 256;
+        if (!ata_read_sectors(KEXEC_IMAGE_LBA + done, count,
+                              (void *)(uint64_t)(KEXEC_STAGING_ADDR + done * ATA_SECTOR_SIZE))) {
+            return false;
+        }
+    }
+    
+    // An all-zero first page means there's no image on disk
+    const uint8_t *image = (const uint8_t *)KEXEC_STAGING_ADDR;
+    bool empty = true;
+    for (int i = 0; i < ATA_SECTOR_SIZE; i++) {
+        if (image[i] != 0) {
+            empty = false;
+            break;
+        }
+    }
+    
+    image_loaded = !empty;
+    return image_loaded;
+}
+
+// Mask every interrupt source so nothing fires mid-handover, and stop DMA.
+// The next kernel's IDT is empty until it sets one up.
+static void kexec_quiesce(void)
+{
+    __asm__ volatile ("cli");
+    
+    // Mask all PIC lines and IOAPIC pins
+    outb(0x21, 0xFF);
+    outb(0xA1, 0xFF);
+    for (int irq = 0; irq < 16; irq++) {
+        ioapic_set_isa_mask(irq, true);
+    }
+    timer_shutdown();
+    smp_stop_aps();
+    
+    // Message interrupts bypass the IOAPIC, and a device still mastering
+    // could write over the image being copied
+    pci_quiesce();
+    lapic_mask_all();
+    
+    // Drain the keyboard controller so the new kernel starts clean
+    for (int i = 0; i < 16 && (inb(0x64) & 0x01); i++) {
+        inb(0x60);
+    }
+}
+
+// Last steps, on the boot stack. The next kernel adopts boot32's page
+// tables, but the ones added for MMIO and ACPI live in our .bss, which it
+// zeroes and hands out again, so only the low 16MB may stay mapped. Our
+// thread stack may be above that.
+static void __attribute__((noreturn)) kexec_handover(void)
+{
+    paging_reset_boot();
+    
+    // The trampoline overwrites us, so it has to run from somewhere else
+    uint64_t size = (uint64_t)(kexec_trampoline_end - kexec_trampoline);
+    memcpy((void *)KEXEC_TRAMPOLINE_ADDR, kexec_trampoline, size);
+    
+    kexec_trampoline_t jump = (kexec_trampoline_t)KEXEC_TRAMPOLINE_ADDR;
+    BOOT_INFO->kexec_tsc = rdtsc();
+    jump(KEXEC_KERNEL_ADDR, KEXEC_STAGING_ADDR,
+         KEXEC_IMAGE_SECTORS * ATA_SECTOR_SIZE, KEXEC_KERNEL_ADDR);
+    
+    // Not reached
+    while (1) {
+        __asm__ volatile ("cli; hlt");
+    }
+}
+
+// Jump into the staged image
+void kexec_execute(void)
+{
+    if (!image_loaded) {
+        return;
+    }
+    
+    kexec_quiesce();
+    
+    // Fresh boot info block for the next kernel
+    volatile boot_info_t *info = BOOT_INFO;
+    info->mem_1mb_16mb = saved_mem_1mb_16mb;
+    info->mem_above_16mb = saved_mem_above_16mb;
+    info->warm_boots = warm_boots + 1;
+    info->warm_magic = BOOT_INFO_WARM_MAGIC;
+    
+    // Our thread stack may go away with the mappings, finish on the boot one
+    __asm__ volatile ("mov %0, %%rsp\n\tcall *%1"
+                      : : "r"((uint64_t)KEXEC_BOOT_STACK), "r"(kexec_handover) : "memory");
+    __builtin_unreachable();
+}
+
+uint32_t kexec_get_warm_boots(void)
+{
+    return warm_boots;
+}
+
+uint64_t kexec_get_restart_cycles(void)
+{
+    return restart_cycles;
+}
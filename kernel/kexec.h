@@ -0,0 +1,34 @@
+// kernel/kexec.h - Warm restart into a kernel image without BIOS POST
+
+#ifndef KEXEC_H
+#define KEXEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Where the kernel image lives on disk (must match boot16.asm dap_kernel)
+#define KEXEC_IMAGE_LBA     33
+#define KEXEC_IMAGE_SECTORS 384
+
+// Low memory used during the handover
+#define KEXEC_STAGING_ADDR    0x10000   // Same staging area stage 1 uses
+#define KEXEC_TRAMPOLINE_ADDR 0x7000    // Below the boot info block
+#define KEXEC_KERNEL_ADDR     0x100000  // Kernel load and entry address
+#define KEXEC_BOOT_STACK      0x90000   // Stack top the bootloader and trampoline use
+
+// Pick up the boot info block (call early, before anything touches 0x9000)
+void kexec_init(void);
+
+// Read the kernel image from disk into the staging area
+bool kexec_load(void);
+
+// Quiesce the machine and jump into the staged image (does not return)
+void kexec_execute(void);
+
+// Warm restarts since the last cold boot (0 = cold boot)
+uint32_t kexec_get_warm_boots(void);
+
+// TSC cycles from the old kernel's jump to our kexec_init (0 = cold boot)
+uint64_t kexec_get_restart_cycles(void);
+
+#endif // KEXEC_H
@@ -0,0 +1,56 @@
+// kernel/lib/atomic.h - C11-style atomics for the freestanding build
+//
+// The C11 names mapped straight onto the GCC builtins <stdatomic.h> would
+// use, so they work on ordinary (volatile) integers and pointers instead of
+// _Atomic types.
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdbool.h>
+
+#define memory_order_relaxed __ATOMIC_RELAXED
+#define memory_order_acquire __ATOMIC_ACQUIRE
+#define memory_order_release __ATOMIC_RELEASE
+#define memory_order_acq_rel __ATOMIC_ACQ_REL
+#define memory_order_seq_cst __ATOMIC_SEQ_CST
+
+#define atomic_load_explicit(ptr, order)            __atomic_load_n(ptr, order)
+#define atomic_store_explicit(ptr, value, order)    __atomic_store_n(ptr, value, order)
+#define atomic_exchange_explicit(ptr, value, order) __atomic_exchange_n(ptr, value, order)
+#define atomic_fetch_add_explicit(ptr, value, order) __atomic_fetch_add(ptr, value, order)
+#define atomic_fetch_sub_explicit(ptr, value, order) __atomic_fetch_sub(ptr, value, order)
+#define atomic_fetch_or_explicit(ptr, value, order)  __atomic_fetch_or(ptr, value, order)
+#define atomic_fetch_and_explicit(ptr, value, order) __atomic_fetch_and(ptr, value, order)
+
+// On failure *expected is updated to the value found
+#define atomic_compare_exchange_strong_explicit(ptr, expected, desired, success, failure) \
+    __atomic_compare_exchange_n(ptr, expected, desired, false, success, failure)
+#define atomic_compare_exchange_weak_explicit(ptr, expected, desired, success, failure) \
+    __atomic_compare_exchange_n(ptr, expected, desired, true, success, failure)
+
+// Sequentially consistent shorthands
+#define atomic_load(ptr)                atomic_load_explicit(ptr, memory_order_seq_cst)
+#define atomic_store(ptr, value)        atomic_store_explicit(ptr, value, memory_order_seq_cst)
+#define atomic_exchange(ptr, value)     atomic_exchange_explicit(ptr, value, memory_order_seq_cst)
+#define atomic_fetch_add(ptr, value)    atomic_fetch_add_explicit(ptr, value, memory_order_seq_cst)
+#define atomic_fetch_sub(ptr, value)    atomic_fetch_sub_explicit(ptr, value, memory_order_seq_cst)
+#define atomic_fetch_or(ptr, value)     atomic_fetch_or_explicit(ptr, value, memory_order_seq_cst)
+#define atomic_fetch_and(ptr, value)    atomic_fetch_and_explicit(ptr, value, memory_order_seq_cst)
+#define atomic_compare_exchange_strong(ptr, expected, desired) \
+    atomic_compare_exchange_strong_explicit(ptr, expected, desired, \
+                                            memory_order_seq_cst, memory_order_seq_cst)
+#define atomic_compare_exchange_weak(ptr, expected, desired) \
+    atomic_compare_exchange_weak_explicit(ptr, expected, desired, \
+                                          memory_order_seq_cst, memory_order_seq_cst)
+
+#define atomic_thread_fence(order)      __atomic_thread_fence(order)
+#define atomic_signal_fence(order)      __atomic_signal_fence(order)
+
+// Spin-wait hint, also a compiler barrier so polled loads are redone
+static inline void cpu_relax(void)
+{
+    __asm__ volatile ("pause" : : : "memory");
+}
+
+#endif // ATOMIC_H
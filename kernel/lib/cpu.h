@@ -0,0 +1,69 @@
+// kernel/lib/cpu.h - CPU instruction helpers
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// Read the time stamp counter
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#define RFLAGS_IF 0x200
+
+// irqsoff tracer hooks (interrupts/irqsoff.c). Only the outermost on->off
+// and off->on transitions call them.
+void irqsoff_begin(const char *site, int vector);
+void irqsoff_end(void);
+
+// Disable interrupts, returning the previous RFLAGS. The irqsoff section
+// is named after the calling function.
+#define irq_save() irq_save_at(__func__)
+
+static inline uint64_t irq_save_at(const char *site)
+{
+    uint64_t flags;
+    __asm__ volatile ("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    if (flags & RFLAGS_IF) {
+        irqsoff_begin(site, -1);
+    }
+    return flags;
+}
+
+// Restore RFLAGS saved by irq_save (re-enables interrupts if they were on)
+static inline void irq_restore(uint64_t flags)
+{
+    if (flags & RFLAGS_IF) {
+        irqsoff_end();
+    }
+    __asm__ volatile ("pushq %0; popfq" : : "r"(flags) : "memory", "cc");
+}
+
+// Read a model specific register
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Write a model specific register
+static inline void wrmsr(uint32_t msr, uint64_t val)
+{
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+// Execute CPUID for a leaf/subleaf
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    __asm__ volatile ("cpuid"
+                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                      : "a"(leaf), "c"(subleaf));
+}
+
+#endif // CPU_H
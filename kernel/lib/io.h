@@ -33,6 +33,32 @@ static inline void outw(uint16_t port, uint16_t val)
     __asm__ volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
 }
 
+// Read a dword (4 bytes) from a port
+static inline uint32_t inl(uint16_t port)
+{
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Write a dword (4 bytes) to a port
+static inline void outl(uint16_t port, uint32_t val)
+{
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+// Read a 32-bit memory mapped register
+static inline uint32_t mmio_read32(uint64_t addr)
+{
+    return *(volatile uint32_t *)addr;
+}
+
+// Write a 32-bit memory mapped register
+static inline void mmio_write32(uint64_t addr, uint32_t val)
+{
+    *(volatile uint32_t *)addr = val;
+}
+
 // Small delay for I/O operations
 static inline void io_wait(void)
 {
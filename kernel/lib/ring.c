@@ -0,0 +1,147 @@
+// kernel/lib/ring.c - Lock-free ring buffers (SPSC, and MPSC producers)
+
+#include "ring.h"
+#include "atomic.h"
+#include "cpu.h"
+#include "string.h"
+#include <stddef.h>
+
+bool ring_init(ring_t *ring, void *buffer, uint32_t capacity, uint32_t elem_size)
+{
+    if (buffer == NULL || capacity == 0 || (capacity & (capacity - 1)) || elem_size == 0) {
+        return false;
+    }
+    
+    memset(ring, 0, sizeof(*ring));
+    ring->buffer = (uint8_t *)buffer;
+    ring->mask = capacity - 1;
+    ring->elem_size = elem_size;
+    return true;
+}
+
+static inline uint8_t *ring_slot(const ring_t *ring, uint32_t index)
+{
+    return ring->buffer + (uint64_t)(index & ring->mask) * ring->elem_size;
+}
+
+// Copy count elements in from index on, wrapping at the end of the buffer
+static void ring_copy_in(ring_t *ring, uint32_t index, const uint8_t *src, uint32_t count)
+{
+    uint32_t first = ring->mask + 1 - (index & ring->mask);
+    if (first > count) {
+        first = count;
+    }
+    memcpy(ring_slot(ring, index), src, (size_t)first * ring->elem_size);
+    if (count > first) {
+        memcpy(ring->buffer, src + (size_t)first * ring->elem_size,
+               (size_t)(count - first) * ring->elem_size);
+    }
+}
+
+static void ring_copy_out(const ring_t *ring, uint32_t index, uint8_t *dst, uint32_t count)
+{
+    uint32_t first = ring->mask + 1 - (index & ring->mask);
+    if (first > count) {
+        first = count;
+    }
+    memcpy(dst, ring_slot(ring, index), (size_t)first * ring->elem_size);
+    if (count > first) {
+        memcpy(dst + (size_t)first * ring->elem_size, ring->buffer,
+               (size_t)(count - first) * ring->elem_size);
+    }
+}
+
+uint32_t ring_push_batch(ring_t *ring, const void *elems, uint32_t count)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t space = ring->mask + 1 - (tail - head);
+    
+    uint32_t n = count < space ? count : space;
+    if (n) {
+        ring_copy_in(ring, tail, (const uint8_t *)elems, n);
+        atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+        ring->pushed += n;
+    }
+    if (n < count) {
+        ring->dropped += count - n;
+    }
+    return n;
+}
+
+bool ring_push(ring_t *ring, const void *elem)
+{
+    return ring_push_batch(ring, elem, 1) == 1;
+}
+
+// Claim a slot by moving reserve, fill it, then publish in claim order:
+// each producer waits for the ones before it to move tail past their slot.
+// Interrupts stay off from claim to publish, or a handler pushing on the
+// same CPU would wait forever for the slot the thread it interrupted holds.
+bool ring_push_mp(ring_t *ring, const void *elem)
+{
+    uint64_t flags = irq_save();
+    uint32_t slot = atomic_load_explicit(&ring->reserve, memory_order_relaxed);
+    do {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (slot - head > ring->mask) {
+            irq_restore(flags);
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&ring->reserve, &slot, slot + 1,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    
+    memcpy(ring_slot(ring, slot), elem, ring->elem_size);
+    
+    while (atomic_load_explicit(&ring->tail, memory_order_relaxed) != slot) {
+        cpu_relax();
+    }
+    atomic_store_explicit(&ring->tail, slot + 1, memory_order_release);
+    irq_restore(flags);
+    atomic_fetch_add_explicit(&ring->pushed, 1, memory_order_relaxed);
+    return true;
+}
+
+uint32_t ring_pop_batch(ring_t *ring, void *elems, uint32_t max)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    
+    uint32_t n = tail - head;
+    if (n > max) {
+        n = max;
+    }
+    if (n) {
+        ring_copy_out(ring, head, (uint8_t *)elems, n);
+        atomic_store_explicit(&ring->head, head + n, memory_order_release);
+    }
+    return n;
+}
+
+bool ring_pop(ring_t *ring, void *elem)
+{
+    return ring_pop_batch(ring, elem, 1) == 1;
+}
+
+uint32_t ring_count(const ring_t *ring)
+{
+    return atomic_load_explicit(&ring->tail, memory_order_acquire) -
+           atomic_load_explicit(&ring->head, memory_order_relaxed);
+}
+
+uint32_t ring_capacity(const ring_t *ring)
+{
+    return ring->mask + 1;
+}
+
+bool ring_empty(const ring_t *ring)
+{
+    return ring_count(ring) == 0;
+}
+
+void ring_clear(ring_t *ring)
+{
+    atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->tail, memory_order_acquire),
+                          memory_order_release);
+}
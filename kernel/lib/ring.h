@@ -0,0 +1,57 @@
+// kernel/lib/ring.h - Lock-free ring buffers (SPSC, and MPSC producers)
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Head and tail are free-running counters, the slot is counter & mask. The
+// producer publishes slots with a release store of tail, the consumer
+// frees them with a release store of head. Each side's index sits on its
+// own cache line so the two CPUs don't bounce one line between them.
+typedef struct ring {
+    // Consumer
+    volatile uint32_t head __attribute__((aligned(64)));
+    
+    // Producers
+    volatile uint32_t tail __attribute__((aligned(64)));
+    volatile uint32_t reserve;          // Next slot handed out (MPSC only)
+    volatile uint64_t pushed;
+    volatile uint64_t dropped;          // Elements refused because it was full
+    
+    // Fixed after ring_init()
+    uint8_t *buffer __attribute__((aligned(64)));
+    uint32_t mask;
+    uint32_t elem_size;
+} ring_t;
+
+// Use caller-provided storage for capacity elements of elem_size bytes.
+// capacity has to be a power of two.
+bool ring_init(ring_t *ring, void *buffer, uint32_t capacity, uint32_t elem_size);
+
+// Single producer. Returns false (and counts a drop) when full.
+bool ring_push(ring_t *ring, const void *elem);
+
+// Several producers (other CPUs, or a thread and an interrupt handler).
+// Disables interrupts while it holds a slot, so one never waits on the
+// thread it interrupted. A ring is either single or multi producer, the
+// two don't mix.
+bool ring_push_mp(ring_t *ring, const void *elem);
+
+// Single consumer. Returns false when empty.
+bool ring_pop(ring_t *ring, void *elem);
+
+// Batches: as many as fit (or are there), published with one store.
+// Elements that didn't fit count as dropped.
+uint32_t ring_push_batch(ring_t *ring, const void *elems, uint32_t count);
+uint32_t ring_pop_batch(ring_t *ring, void *elems, uint32_t max);
+
+uint32_t ring_count(const ring_t *ring);
+uint32_t ring_capacity(const ring_t *ring);
+bool ring_empty(const ring_t *ring);
+
+// Drop everything queued (consumer side)
+void ring_clear(ring_t *ring);
+
+#endif // RING_H
@@ -0,0 +1,217 @@
+// kernel/lib/spinlock.c - Spinlocks, ticket and MCS queue locks, lockstat
+//
+// A plain spinlock is cheapest when nobody else wants it. Under contention
+// every waiter hammers the same cache line and whoever is closest wins, so
+// busy paths use a ticket lock (served in order) or an MCS lock (in order,
+// and each waiter spins on its own node). The statistics are only touched
+// while the lock is held, the lock itself keeps them consistent.
+
+#include "spinlock.h"
+#include "string.h"
+#include <stddef.h>
+
+static lockstat_t *volatile lockstat_list = NULL;
+static volatile bool lockstat_enabled = true;
+
+// --- lockstat ---
+
+static void lockstat_register(lockstat_t *stat)
+{
+    uint32_t expected = 0;
+    if (!atomic_compare_exchange_strong(&stat->registered, &expected, 1)) {
+        return;
+    }
+    
+    lockstat_t *head = atomic_load(&lockstat_list);
+    do {
+        stat->next = head;
+    } while (!atomic_compare_exchange_weak(&lockstat_list, &head, stat));
+}
+
+// Lock just taken; wait_start is 0 if it was free right away. Locks without
+// a name aren't tracked, they may live in memory that goes away.
+static inline void lockstat_acquired(lockstat_t *stat, uint64_t wait_start)
+{
+    if (!lockstat_enabled || stat->name == NULL) {
+        stat->acquired_at = 0;
+        return;
+    }
+    if (!stat->registered) {
+        lockstat_register(stat);
+    }
+    
+    uint64_t now = rdtsc();
+    stat->acquisitions++;
+    if (wait_start) {
+        uint64_t wait = now - wait_start;
+        stat->contended++;
+        stat->wait_cycles += wait;
+        if (wait > stat->max_wait_cycles) {
+            stat->max_wait_cycles = wait;
+        }
+    }
+    stat->acquired_at = now;
+}
+
+// About to be released
+static inline void lockstat_released(lockstat_t *stat)
+{
+    if (stat->acquired_at == 0) {
+        return;
+    }
+    
+    uint64_t hold = rdtsc() - stat->acquired_at;
+    stat->hold_cycles += hold;
+    if (hold > stat->max_hold_cycles) {
+        stat->max_hold_cycles = hold;
+    }
+    stat->acquired_at = 0;
+}
+
+static void lockstat_init(lockstat_t *stat, const char *name, const char *type)
+{
+    memset(stat, 0, sizeof(*stat));
+    stat->name = name;
+    stat->type = type;
+}
+
+void lockstat_set_enabled(bool enabled)
+{
+    lockstat_enabled = enabled;
+}
+
+bool lockstat_is_enabled(void)
+{
+    return lockstat_enabled;
+}
+
+const lockstat_t *lockstat_first(void)
+{
+    return atomic_load(&lockstat_list);
+}
+
+// A lock held right now may still add its current hold afterwards
+void lockstat_reset(void)
+{
+    for (lockstat_t *stat = atomic_load(&lockstat_list); stat; stat = stat->next) {
+        stat->acquisitions = 0;
+        stat->contended = 0;
+        stat->wait_cycles = 0;
+        stat->max_wait_cycles = 0;
+        stat->hold_cycles = 0;
+        stat->max_hold_cycles = 0;
+    }
+}
+
+// --- Spinlock ---
+
+void spin_lock_init(spinlock_t *lock, const char *name)
+{
+    lock->locked = 0;
+    lockstat_init(&lock->stat, name, "spin");
+}
+
+void spin_lock(spinlock_t *lock)
+{
+    uint64_t wait_start = 0;
+    while (atomic_exchange_explicit(&lock->locked, 1, memory_order_acquire)) {
+        if (wait_start == 0) {
+            wait_start = rdtsc();
+        }
+        // Spin on a read so the line stays shared until it's released
+        while (atomic_load_explicit(&lock->locked, memory_order_relaxed)) {
+            cpu_relax();
+        }
+    }
+    lockstat_acquired(&lock->stat, wait_start);
+}
+
+bool spin_trylock(spinlock_t *lock)
+{
+    if (atomic_load_explicit(&lock->locked, memory_order_relaxed) ||
+        atomic_exchange_explicit(&lock->locked, 1, memory_order_acquire)) {
+        return false;
+    }
+    lockstat_acquired(&lock->stat, 0);
+    return true;
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+    lockstat_released(&lock->stat);
+    atomic_store_explicit(&lock->locked, 0, memory_order_release);
+}
+
+// --- Ticket lock ---
+
+void ticket_lock_init(ticket_lock_t *lock, const char *name)
+{
+    lock->next = 0;
+    lock->owner = 0;
+    lockstat_init(&lock->stat, name, "ticket");
+}
+
+void ticket_lock(ticket_lock_t *lock)
+{
+    uint32_t ticket = atomic_fetch_add_explicit(&lock->next, 1, memory_order_relaxed);
+    uint64_t wait_start = 0;
+    
+    if (atomic_load_explicit(&lock->owner, memory_order_acquire) != ticket) {
+        wait_start = rdtsc();
+        while (atomic_load_explicit(&lock->owner, memory_order_acquire) != ticket) {
+            cpu_relax();
+        }
+    }
+    lockstat_acquired(&lock->stat, wait_start);
+}
+
+void ticket_unlock(ticket_lock_t *lock)
+{
+    lockstat_released(&lock->stat);
+    atomic_store_explicit(&lock->owner, lock->owner + 1, memory_order_release);
+}
+
+// --- MCS lock ---
+
+void mcs_lock_init(mcs_lock_t *lock, const char *name)
+{
+    lock->tail = NULL;
+    lockstat_init(&lock->stat, name, "mcs");
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    node->next = NULL;
+    node->locked = 1;
+    
+    mcs_node_t *prev = atomic_exchange_explicit(&lock->tail, node, memory_order_acq_rel);
+    uint64_t wait_start = 0;
+    if (prev) {
+        // Queue behind the previous tail, it hands over by clearing our flag
+        wait_start = rdtsc();
+        atomic_store_explicit(&prev->next, node, memory_order_release);
+        while (atomic_load_explicit(&node->locked, memory_order_acquire)) {
+            cpu_relax();
+        }
+    }
+    lockstat_acquired(&lock->stat, wait_start);
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    lockstat_released(&lock->stat);
+    
+    mcs_node_t *next = atomic_load_explicit(&node->next, memory_order_acquire);
+    if (next == NULL) {
+        // Nobody queued: empty the lock, unless someone is just linking in
+        mcs_node_t *expected = node;
+        if (atomic_compare_exchange_strong_explicit(&lock->tail, &expected, NULL,
+                                                    memory_order_release, memory_order_relaxed)) {
+            return;
+        }
+        while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL) {
+            cpu_relax();
+        }
+    }
+    atomic_store_explicit(&next->locked, 0, memory_order_release);
+}
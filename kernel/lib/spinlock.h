@@ -0,0 +1,130 @@
+// kernel/lib/spinlock.h - Spinlocks, ticket and MCS queue locks, lockstat
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "atomic.h"
+#include "cpu.h"
+
+// Threads are preempted from the timer interrupt, so a lock that a thread
+// may hold has to be taken with the _irqsave variants. The plain ones are
+// for code that already runs with interrupts off (handlers, AP tasks).
+
+// Contention statistics, kept by whoever holds the lock
+typedef struct lockstat {
+    const char *name;
+    const char *type;
+    uint64_t acquisitions;
+    uint64_t contended;         // Acquisitions that had to wait
+    uint64_t wait_cycles;       // TSC cycles spent waiting
+    uint64_t max_wait_cycles;
+    uint64_t hold_cycles;       // TSC cycles between lock and unlock
+    uint64_t max_hold_cycles;
+    uint64_t acquired_at;       // 0 when this hold isn't being timed
+    struct lockstat *next;      // All locks taken so far (lockstat_first())
+    volatile uint32_t registered;
+} lockstat_t;
+
+#define LOCKSTAT_INIT(lock_name, lock_type) { .name = (lock_name), .type = (lock_type) }
+
+// Test and test-and-set
+typedef struct {
+    volatile uint32_t locked;
+    lockstat_t stat;
+} spinlock_t;
+
+// FIFO: take a number, wait until it's served
+typedef struct {
+    volatile uint32_t next;
+    volatile uint32_t owner;
+    lockstat_t stat;
+} ticket_lock_t;
+
+// Waiters queue up and each spins on its own node (on the waiter's stack)
+typedef struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile uint32_t locked;
+} mcs_node_t;
+
+typedef struct {
+    mcs_node_t *volatile tail;
+    lockstat_t stat;
+} mcs_lock_t;
+
+#define SPINLOCK_INIT(name)     { 0, LOCKSTAT_INIT(name, "spin") }
+#define TICKET_LOCK_INIT(name)  { 0, 0, LOCKSTAT_INIT(name, "ticket") }
+#define MCS_LOCK_INIT(name)     { NULL, LOCKSTAT_INIT(name, "mcs") }
+
+// A NULL name leaves the lock out of lockstat (locks on the stack or in
+// memory that is freed while the list still points at it)
+void spin_lock_init(spinlock_t *lock, const char *name);
+void spin_lock(spinlock_t *lock);
+bool spin_trylock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+
+void ticket_lock_init(ticket_lock_t *lock, const char *name);
+void ticket_lock(ticket_lock_t *lock);
+void ticket_unlock(ticket_lock_t *lock);
+
+void mcs_lock_init(mcs_lock_t *lock, const char *name);
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+
+// Disable interrupts, then lock; returns the RFLAGS to restore. Like
+// irq_save(), the irqsoff section is named after the caller.
+#define spin_lock_irqsave(lock)         spin_lock_irqsave_at(lock, __func__)
+#define ticket_lock_irqsave(lock)       ticket_lock_irqsave_at(lock, __func__)
+#define mcs_lock_irqsave(lock, node)    mcs_lock_irqsave_at(lock, node, __func__)
+
+static inline uint64_t spin_lock_irqsave_at(spinlock_t *lock, const char *site)
+{
+    uint64_t flags = irq_save_at(site);
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags)
+{
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline uint64_t ticket_lock_irqsave_at(ticket_lock_t *lock, const char *site)
+{
+    uint64_t flags = irq_save_at(site);
+    ticket_lock(lock);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(ticket_lock_t *lock, uint64_t flags)
+{
+    ticket_unlock(lock);
+    irq_restore(flags);
+}
+
+static inline uint64_t mcs_lock_irqsave_at(mcs_lock_t *lock, mcs_node_t *node, const char *site)
+{
+    uint64_t flags = irq_save_at(site);
+    mcs_lock(lock, node);
+    return flags;
+}
+
+static inline void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags)
+{
+    mcs_unlock(lock, node);
+    irq_restore(flags);
+}
+
+// Collection can be switched off at runtime (two TSC reads per acquisition)
+void lockstat_set_enabled(bool enabled);
+bool lockstat_is_enabled(void);
+
+// Locks that have been taken at least once, newest first
+const lockstat_t *lockstat_first(void);
+
+// Zero every registered lock's counters
+void lockstat_reset(void);
+
+#endif // SPINLOCK_H
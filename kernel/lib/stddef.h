@@ -8,4 +8,6 @@
 typedef unsigned long size_t;
 typedef long ptrdiff_t;
 
+#define offsetof(type, member) __builtin_offsetof(type, member)
+
 #endif // STDDEF_H
\ No newline at end of file
@@ -177,6 +177,29 @@ void itoa(int value, char *str, int base)
     }
 }
 
+// Convert unsigned 64-bit integer to string
+void ultoa(uint64_t value, char *str, int base)
+{
+    char *ptr = str;
+    char *ptr1 = str;
+    char tmp_char;
+    
+    // Convert to string (reversed)
+    do {
+        *ptr++ = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+    
+    *ptr-- = '\0';
+    
+    // Reverse the string
+    while (ptr1 < ptr) {
+        tmp_char = *ptr;
+        *ptr-- = *ptr1;
+        *ptr1++ = tmp_char;
+    }
+}
+
 // Convert string to integer
 int atoi(const char *str)
 {
@@ -226,3 +249,20 @@ void* memmove(void* dest, const void* src, size_t n)
     
     return dest;
 }
+
+// Additive checksum: the 32-bit words of a buffer (and any tail bytes) summed
+uint64_t memsum(const void *data, size_t n)
+{
+    const uint32_t *words = (const uint32_t *)data;
+    uint64_t sum = 0;
+    
+    for (size_t i = 0; i < n / 4; i++) {
+        sum += words[i];
+    }
+    
+    const unsigned char *tail = (const unsigned char *)data + (n & ~(size_t)3);
+    for (size_t i = 0; i < (n & 3); i++) {
+        sum += tail[i];
+    }
+    return sum;
+}
@@ -39,8 +39,14 @@ int memcmp(const void *s1, const void *s2, size_t n);
 // Convert integer to string
 void itoa(int value, char *str, int base);
 
+// Convert unsigned 64-bit integer to string
+void ultoa(uint64_t value, char *str, int base);
+
 // Convert string to integer
 int atoi(const char *str);
 
 void* memmove(void* dest, const void* src, size_t n);
+
+// Sum of the 32-bit words in a buffer, so sums of pieces add up to the whole
+uint64_t memsum(const void *data, size_t n);
 #endif // STRING_H
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "heap.h"
 #include "pmm.h"
 #include "../lib/string.h"
+#include "../lib/spinlock.h"
 
 // Block header
 typedef struct block_header {
@@ -17,6 +18,10 @@ typedef struct block_header {
 // Free list head
 static block_header_t *heap_start = NULL;
 
+// Block list. Allocations walk the whole list, so waiters queue (MCS)
+// instead of all spinning on one line.
+static mcs_lock_t heap_lock = MCS_LOCK_INIT("heap");
+
 // Find free block that fits
 static block_header_t* find_free_block(uint32_t size)
 {
@@ -108,6 +113,9 @@ void* malloc(size_t size)
         return NULL;
     }
     
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&heap_lock, &node);
+    
     // Try to find existing free block
     block_header_t *block = find_free_block(aligned_size);
     
@@ -115,12 +123,14 @@ void* malloc(size_t size)
     if (block == NULL) {
         block = request_pages(pages_needed);
         if (block == NULL) {
+            mcs_unlock_irqrestore(&heap_lock, &node, flags);
             return NULL;
         }
     }
     
     // Mark as used
     block->is_free = false;
+    mcs_unlock_irqrestore(&heap_lock, &node, flags);
     
     // Return pointer after header
     return (void*)((char*)block + BLOCK_HEADER_SIZE);
@@ -132,7 +142,10 @@ void free(void* ptr)
     if (ptr == NULL) return;
     
     block_header_t *block = (block_header_t*)((char*)ptr - BLOCK_HEADER_SIZE);
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&heap_lock, &node);
     block->is_free = true;
+    mcs_unlock_irqrestore(&heap_lock, &node, flags);
     
     // TODO: Return pages to PMM if block is large
     // TODO: Coalesce adjacent free blocks
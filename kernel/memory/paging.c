@@ -0,0 +1,214 @@
+// kernel/memory/paging.c - Identity mapping helpers for boot32's page tables
+//
+// boot32.asm only maps the first 16MB. ACPI tables and device registers
+// (LAPIC, IOAPIC, ...) live higher up, so they get mapped here on demand.
+//
+// A user address space is a PML4 of its own whose slot 0 points at the
+// kernel's PDPT, so the kernel (supervisor only) is mapped the same way in
+// all of them and later kernel mappings show up everywhere. User pages are
+// 4KB pages in slot 1.
+
+#include "paging.h"
+#include "pmm.h"
+#include "../lib/string.h"
+
+// Tables for mappings made before the PMM is up (ACPI, APIC at CORE level)
+#define PAGING_POOL_PAGES 4
+static uint64_t table_pool[PAGING_POOL_PAGES][512] __attribute__((aligned(4096)));
+static int pool_used = 0;
+
+static uint64_t *kernel_pml4 = NULL;
+
+// Get a zeroed page for a new page table
+static uint64_t *paging_alloc_table(void)
+{
+    uint64_t *table;
+    
+    if (pool_used < PAGING_POOL_PAGES) {
+        table = table_pool[pool_used++];
+    } else {
+        table = (uint64_t *)pmm_alloc_page();
+        if (table == NULL) {
+            return NULL;
+        }
+    }
+    
+    memset(table, 0, PAGE_SIZE);
+    return table;
+}
+
+// Get the next level table, creating it with the given extra flags if needed
+static uint64_t *paging_next_table_flags(uint64_t *table, int index, uint64_t flags)
+{
+    if (!(table[index] & PTE_PRESENT)) {
+        uint64_t *next = paging_alloc_table();
+        if (next == NULL) {
+            return NULL;
+        }
+        table[index] = (uint64_t)next | PTE_PRESENT | PTE_WRITABLE | flags;
+    }
+    return (uint64_t *)(table[index] & PTE_ADDR_MASK);
+}
+
+static uint64_t *paging_next_table(uint64_t *table, int index)
+{
+    return paging_next_table_flags(table, index, 0);
+}
+
+uint64_t *paging_kernel_space(void)
+{
+    // Read before any user address space exists, so this is boot32's
+    if (kernel_pml4 == NULL) {
+        uint64_t cr3;
+        __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+        kernel_pml4 = (uint64_t *)(cr3 & PTE_ADDR_MASK);
+    }
+    return kernel_pml4;
+}
+
+// Identity map a range with 2MB pages
+bool paging_map_identity(uint64_t phys, uint64_t size, uint64_t flags)
+{
+    uint64_t *pml4 = paging_kernel_space();
+    
+    uint64_t start = phys & ~(HUGE_PAGE_SIZE - 1);
+    uint64_t end = (phys + size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    
+    for (uint64_t addr = start; addr < end; addr += HUGE_PAGE_SIZE) {
+        uint64_t *pdpt = paging_next_table(pml4, (addr >> 39) & 0x1FF);
+        if (pdpt == NULL) {
+            return false;
+        }
+        
+        int pdpt_index = (addr >> 30) & 0x1FF;
+        if (pdpt[pdpt_index] & PTE_HUGE) {
+            continue;  // Covered by a 1GB page
+        }
+        
+        uint64_t *pd = paging_next_table(pdpt, pdpt_index);
+        if (pd == NULL) {
+            return false;
+        }
+        
+        int pd_index = (addr >> 21) & 0x1FF;
+        if (pd[pd_index] & PTE_PRESENT) {
+            continue;
+        }
+        
+        pd[pd_index] = addr | PTE_PRESENT | PTE_WRITABLE | PTE_HUGE | flags;
+        __asm__ volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+    }
+    
+    return true;
+}
+
+// Map device registers
+bool paging_map_mmio(uint64_t phys, uint64_t size)
+{
+    return paging_map_identity(phys, size, PTE_PCD | PTE_PWT);
+}
+
+void paging_reset_boot(void)
+{
+    uint64_t *pml4 = paging_kernel_space();
+    uint64_t *pdpt = (uint64_t *)(pml4[0] & PTE_ADDR_MASK);
+    uint64_t *pd = (uint64_t *)(pdpt[0] & PTE_ADDR_MASK);
+    
+    for (int i = PAGING_BOOT_MAPPED / HUGE_PAGE_SIZE; i < 512; i++) {
+        pd[i] = 0;
+    }
+    for (int i = 1; i < 512; i++) {
+        pdpt[i] = 0;
+        pml4[i] = 0;
+    }
+    
+    // Also drops every TLB entry for what was just unmapped
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(pml4) : "memory");
+}
+
+// --- User address spaces ---
+
+uint64_t *paging_create_space(void)
+{
+    uint64_t *pml4 = (uint64_t *)pmm_alloc_page();
+    if (pml4 == NULL) {
+        return NULL;
+    }
+    
+    uint64_t *kernel = paging_kernel_space();
+    memset(pml4, 0, PAGE_SIZE);
+    pml4[0] = kernel[0];
+    return pml4;
+}
+
+// Free a table and what it points to, level 1 being a page table
+static void paging_free_table(uint64_t *table, int level)
+{
+    for (int i = 0; i < 512; i++) {
+        if (!(table[i] & PTE_PRESENT)) {
+            continue;
+        }
+        void *next = (void *)(table[i] & PTE_ADDR_MASK);
+        if (level > 1) {
+            paging_free_table(next, level - 1);
+        } else if (!(table[i] & PTE_SHARED)) {
+            pmm_free_page(next);
+        }
+    }
+    pmm_free_page(table);
+}
+
+void paging_destroy_space(uint64_t *pml4)
+{
+    int first = (USER_SPACE_START >> 39) & 0x1FF;
+    int last = ((USER_SPACE_END - 1) >> 39) & 0x1FF;
+    for (int i = first; i <= last; i++) {
+        if (pml4[i] & PTE_PRESENT) {
+            paging_free_table((uint64_t *)(pml4[i] & PTE_ADDR_MASK), 3);
+        }
+    }
+    pmm_free_page(pml4);
+}
+
+bool paging_map_user(uint64_t *pml4, uint64_t virt, uint64_t phys, uint64_t flags)
+{
+    if (virt < USER_SPACE_START || virt >= USER_SPACE_END || (virt & (PAGE_SIZE - 1))) {
+        return false;
+    }
+    
+    uint64_t *pdpt = paging_next_table_flags(pml4, (virt >> 39) & 0x1FF, PTE_USER);
+    uint64_t *pd = pdpt ? paging_next_table_flags(pdpt, (virt >> 30) & 0x1FF, PTE_USER) : NULL;
+    uint64_t *pt = pd ? paging_next_table_flags(pd, (virt >> 21) & 0x1FF, PTE_USER) : NULL;
+    if (pt == NULL) {
+        return false;
+    }
+    
+    pt[(virt >> 12) & 0x1FF] = (phys & PTE_ADDR_MASK) | PTE_PRESENT | PTE_USER | flags;
+    return true;
+}
+
+uint64_t paging_user_phys(uint64_t *pml4, uint64_t virt)
+{
+    if (virt < USER_SPACE_START || virt >= USER_SPACE_END) {
+        return 0;
+    }
+    
+    uint64_t *table = pml4;
+    for (int shift = 39; shift >= 12; shift -= 9) {
+        uint64_t entry = table[(virt >> shift) & 0x1FF];
+        if ((entry & (PTE_PRESENT | PTE_USER)) != (PTE_PRESENT | PTE_USER)) {
+            return 0;
+        }
+        table = (uint64_t *)(entry & PTE_ADDR_MASK);
+    }
+    return (uint64_t)table | (virt & (PAGE_SIZE - 1));
+}
+
+void paging_switch(uint64_t *pml4)
+{
+    uint64_t cr3;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    if ((cr3 & PTE_ADDR_MASK) != (uint64_t)pml4) {
+        __asm__ volatile ("mov %0, %%cr3" : : "r"(pml4) : "memory");
+    }
+}
@@ -0,0 +1,62 @@
+// kernel/memory/paging.h - Identity mapping helpers for boot32's page tables,
+// and user address spaces
+
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Page table entry flags
+#define PTE_PRESENT   0x001
+#define PTE_WRITABLE  0x002
+#define PTE_USER      0x004
+#define PTE_PWT       0x008
+#define PTE_PCD       0x010
+#define PTE_HUGE      0x080
+#define PTE_SHARED    0x200         // Software bit: not freed with the address space
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+#define HUGE_PAGE_SIZE 0x200000ULL  // 2MB
+
+// What boot32.asm maps (2MB pages in its one PD)
+#define PAGING_BOOT_MAPPED 0x1000000ULL  // 16MB
+
+// User space is PML4 slot 1 (512GB-1TB), out of the way of the kernel's
+// identity map in slot 0, which every address space shares
+#define USER_SPACE_START 0x0000008000000000ULL
+#define USER_SPACE_END   0x0000010000000000ULL
+
+// Identity map a physical range with 2MB pages (already mapped pages are left alone)
+bool paging_map_identity(uint64_t phys, uint64_t size, uint64_t flags);
+
+// Identity map a device register range, uncached
+bool paging_map_mmio(uint64_t phys, uint64_t size);
+
+// The page tables the kernel booted with (what kernel threads run on)
+uint64_t *paging_kernel_space(void);
+
+// Put boot32's tables back the way boot32 left them, for kexec: everything
+// above PAGING_BOOT_MAPPED goes (those tables are in this kernel's memory)
+// and CR3 is reloaded. Only the low 16MB is mapped afterwards.
+void paging_reset_boot(void);
+
+// New address space: the kernel half shared, no user mappings. NULL if out
+// of memory.
+uint64_t *paging_create_space(void);
+
+// Free an address space with its page tables and every user page mapped in
+// it. It must not be the one loaded.
+void paging_destroy_space(uint64_t *pml4);
+
+// Map one 4KB page at a user address (PTE_USER is added). The page then
+// belongs to the address space and is freed with it, unless PTE_SHARED.
+bool paging_map_user(uint64_t *pml4, uint64_t virt, uint64_t phys, uint64_t flags);
+
+// Physical address behind a user address, 0 if it isn't mapped for user access
+uint64_t paging_user_phys(uint64_t *pml4, uint64_t virt);
+
+// Load an address space into CR3 (no-op if it already is)
+void paging_switch(uint64_t *pml4);
+
+#endif // PAGING_H
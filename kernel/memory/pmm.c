@@ -2,6 +2,7 @@
 
 #include "pmm.h"
 #include "../lib/string.h"
+#include "../lib/spinlock.h"
 
 // Bitmap to track pages (1 bit per 4KB page)
 // We'll allocate this statically for simplicity
@@ -12,6 +13,10 @@ static uint32_t total_pages = 0;
 static uint32_t used_pages = 0;
 static uint32_t first_free_page = 0;
 
+// Bitmap, counters and hint. Every CPU allocates from here, so it's a ticket
+// lock: waiters are served in the order they came.
+static ticket_lock_t pmm_lock = TICKET_LOCK_INIT("pmm");
+
 // Set a bit in the bitmap
 static inline void bitmap_set(uint32_t page)
 {
@@ -76,8 +81,8 @@ void pmm_init(uint32_t total_memory_kb)
     first_free_page = 0;
 }
 
-// Allocate a page
-void* pmm_alloc_page(void)
+// Allocate a page (lock held)
+static void* alloc_page_locked(void)
 {
     uint32_t page = find_first_free();
     
@@ -95,15 +100,58 @@ void* pmm_alloc_page(void)
     
     // Convert page number to physical address
     // Pages start at 2MB (0x200000)
-    return (void*)(0x200000 + (page * PAGE_SIZE));
+    return (void*)(uint64_t)(0x200000 + (uint64_t)page * PAGE_SIZE);
 }
 
-// Free a page
-void pmm_free_page(void* page_addr)
+// Allocate a page
+void* pmm_alloc_page(void)
+{
+    uint64_t flags = ticket_lock_irqsave(&pmm_lock);
+    void *page = alloc_page_locked();
+    ticket_unlock_irqrestore(&pmm_lock, flags);
+    return page;
+}
+
+// Allocate physically contiguous pages (stacks, DMA buffers)
+void* pmm_alloc_pages(uint32_t count)
+{
+    if (count == 0) return NULL;
+    if (count == 1) return pmm_alloc_page();
+    
+    uint64_t flags = ticket_lock_irqsave(&pmm_lock);
+    uint32_t run = 0;
+    for (uint32_t i = first_free_page; i < total_pages; i++) {
+        if (bitmap_test(i)) {
+            run = 0;
+            continue;
+        }
+        if (++run < count) {
+            continue;
+        }
+        
+        uint32_t start = i + 1 - count;
+        for (uint32_t page = start; page <= i; page++) {
+            bitmap_set(page);
+        }
+        used_pages += count;
+        
+        if (start == first_free_page) {
+            first_free_page = find_first_free();
+        }
+        ticket_unlock_irqrestore(&pmm_lock, flags);
+        return (void*)(uint64_t)(0x200000 + (uint64_t)start * PAGE_SIZE);
+    }
+    
+    ticket_unlock_irqrestore(&pmm_lock, flags);
+    return NULL;  // No run long enough
+}
+
+// Free a page (lock held)
+static void free_page_locked(void* page_addr)
 {
     if (page_addr == NULL) return;
     
-    uint32_t addr = (uint32_t)page_addr;
+    uint64_t addr = (uint64_t)page_addr;
     
     // Check if address is valid
     if (addr < 0x200000) return;
@@ -124,6 +172,24 @@ void pmm_free_page(void* page_addr)
     }
 }
 
+// Free pages from pmm_alloc_pages()
+void pmm_free_pages(void* page_addr, uint32_t count)
+{
+    uint64_t flags = ticket_lock_irqsave(&pmm_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        free_page_locked((uint8_t*)page_addr + i * PAGE_SIZE);
+    }
+    ticket_unlock_irqrestore(&pmm_lock, flags);
+}
+
+// Free a page
+void pmm_free_page(void* page_addr)
+{
+    uint64_t flags = ticket_lock_irqsave(&pmm_lock);
+    free_page_locked(page_addr);
+    ticket_unlock_irqrestore(&pmm_lock, flags);
+}
+
 // Get statistics
 uint32_t pmm_get_total_memory(void)
 {
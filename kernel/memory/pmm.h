@@ -19,6 +19,10 @@ void* pmm_alloc_page(void);
 // Free a physical page
 void pmm_free_page(void* page);
 
+// Allocate/free physically contiguous pages
+void* pmm_alloc_pages(uint32_t count);
+void pmm_free_pages(void* page, uint32_t count);
+
 // Get memory statistics
 uint32_t pmm_get_total_memory(void);
 uint32_t pmm_get_used_memory(void);
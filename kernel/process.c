@@ -0,0 +1,254 @@
+// kernel/process.c - User processes: an address space and a thread in ring 3
+//
+// A process is a kernel thread that loaded its own page tables and dropped
+// to ring 3 with SYSRET. From then on it only comes back through SYSCALL,
+// interrupts and exceptions, on the top of its kernel stack (TSS rsp0 and
+// percpu kernel_rsp, set by the scheduler when it switches to the thread).
+// The kernel half of the address space is shared but supervisor only, so
+// a stray access faults and ends the process instead of the machine.
+
+#include "process.h"
+#include "syscall.h"
+#include "vdso.h"
+#include "smp.h"
+#include "sched/cputime.h"
+#include "drivers/screen.h"
+#include "memory/pmm.h"
+#include "memory/heap.h"
+#include "lib/cpu.h"
+#include "lib/atomic.h"
+#include "lib/string.h"
+
+// Programs in user.asm
+extern uint8_t user_hello[], user_hello_end[];
+extern uint8_t user_bench_syscall[], user_bench_syscall_end[];
+extern uint8_t user_bench_int[], user_bench_int_end[];
+extern uint8_t user_fault[], user_fault_end[];
+extern uint8_t user_clock[], user_clock_end[];
+extern uint8_t user_bench_vdso[], user_bench_vdso_end[];
+extern uint8_t user_bench_clock[], user_bench_clock_end[];
+extern uint8_t user_spin[], user_spin_end[];
+
+static const user_program_t programs[] = {
+    { "hello", "Print a line and exit", user_hello, user_hello_end },
+    { "bench-syscall", "Time getpid through SYSCALL", user_bench_syscall, user_bench_syscall_end },
+    { "bench-int", "Time getpid through an interrupt gate", user_bench_int, user_bench_int_end },
+    { "fault", "Read kernel memory (gets killed)", user_fault, user_fault_end },
+    { "clock", "Exit with the uptime in ms, from the time page", user_clock, user_clock_end },
+    { "bench-vdso", "Time clock reads from the time page", user_bench_vdso, user_bench_vdso_end },
+    { "bench-clock", "Time clock reads through SYSCALL", user_bench_clock, user_bench_clock_end },
+    { "spin", "Busy loop for arg million iterations", user_spin, user_spin_end },
+};
+
+#define PROGRAM_COUNT (int)(sizeof(programs) / sizeof(programs[0]))
+
+static int next_pid = 1;
+
+const user_program_t *process_get_programs(int *count)
+{
+    *count = PROGRAM_COUNT;
+    return programs;
+}
+
+const user_program_t *process_find_program(const char *name)
+{
+    for (int i = 0; i < PROGRAM_COUNT; i++) {
+        if (strcmp(programs[i].name, name) == 0) {
+            return &programs[i];
+        }
+    }
+    return NULL;
+}
+
+// Map zeroed pages from virt up, copying data into the start of them
+static bool process_map_pages(process_t *process, uint64_t virt, int pages, uint64_t flags,
+                              const uint8_t *data, size_t size)
+{
+    for (int i = 0; i < pages; i++) {
+        uint8_t *page = pmm_alloc_page();
+        if (page == NULL) {
+            return false;
+        }
+        
+        memset(page, 0, PAGE_SIZE);
+        size_t offset = (size_t)i * PAGE_SIZE;
+        if (offset < size) {
+            size_t count = size - offset < PAGE_SIZE ? size - offset : PAGE_SIZE;
+            memcpy(page, data + offset, count);
+        }
+        
+        if (!paging_map_user(process->pml4, virt + offset, (uint64_t)page, flags)) {
+            pmm_free_page(page);
+            return false;
+        }
+    }
+    return true;
+}
+
+// First thing the process's thread runs, still in the kernel
+static void process_start(void *arg)
+{
+    process_t *process = arg;
+    thread_t *self = thread_current();
+    
+    // From here on the scheduler loads these whenever it switches to us
+    uint64_t flags = irq_save();
+    self->process = process;
+    self->console = process->console;
+    self->address_space = process->pml4;
+    paging_switch(process->pml4);
+    smp_set_kernel_stack(thread_stack_top(self));
+    irq_restore(flags);
+    
+    // Interrupts stay off until SYSRET loads the program's flags
+    __asm__ volatile ("cli");
+    cputime_switch(CPUTIME_USER);
+    syscall_enter_user(USER_CODE_BASE, USER_STACK_TOP, process->arg);
+}
+
+process_t *process_spawn(const user_program_t *program, uint64_t arg)
+{
+    if (program == NULL) {
+        return NULL;
+    }
+    
+    size_t size = program->end - program->start;
+    if (size > USER_CODE_PAGES * PAGE_SIZE) {
+        return NULL;
+    }
+    
+    process_t *process = malloc(sizeof(process_t));
+    if (process == NULL) {
+        return NULL;
+    }
+    memset(process, 0, sizeof(*process));
+    
+    process->pml4 = paging_create_space();
+    if (process->pml4 == NULL) {
+        free(process);
+        return NULL;
+    }
+    
+    // Code read-only, stack writable, and the time page
+    if (!process_map_pages(process, USER_CODE_BASE, USER_CODE_PAGES, 0, program->start, size) ||
+        !process_map_pages(process, USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE,
+                           USER_STACK_PAGES, PTE_WRITABLE, NULL, 0) ||
+        !vdso_map(process->pml4)) {
+        paging_destroy_space(process->pml4);
+        free(process);
+        return NULL;
+    }
+    
+    strncpy(process->name, program->name, THREAD_NAME_MAX - 1);
+    process->pid = atomic_fetch_add_explicit(&next_pid, 1, memory_order_relaxed);
+    process->arg = arg;
+    process->console = thread_current()->console;
+    wait_queue_init(&process->exit_waiters);
+    
+    // It may start on another CPU right away, process_start() takes it from here
+    thread_t *thread = thread_create_on(process->name, process_start, process, THREAD_ANY_CPU);
+    if (thread == NULL) {
+        paging_destroy_space(process->pml4);
+        free(process);
+        return NULL;
+    }
+    return process;
+}
+
+int64_t process_wait(process_t *process)
+{
+    wait_event_interruptible(&process->exit_waiters, process->exited);
+    if (!process->exited) {
+        process->killed = true;
+        wait_event(&process->exit_waiters, process->exited);
+    }
+    
+    // The exiting thread may still be in wake_up_set() on another CPU
+    wait_queue_sync(&process->exit_waiters);
+    int64_t code = process->exit_code;
+    free(process);
+    return code;
+}
+
+process_t *process_current(void)
+{
+    thread_t *self = thread_current();
+    return self ? self->process : NULL;
+}
+
+void process_exit(int64_t code)
+{
+    thread_t *self = thread_current();
+    process_t *process = self->process;
+    
+    // Back on the kernel's page tables before freeing ours
+    uint64_t flags = irq_save();
+    self->address_space = NULL;
+    self->process = NULL;
+    paging_switch(paging_kernel_space());
+    irq_restore(flags);
+    
+    paging_destroy_space(process->pml4);
+    process->pml4 = NULL;
+    process->exit_code = code;
+    
+    // The waiter frees it, don't touch it after this
+    wake_up_set(&process->exit_waiters, &process->exited);
+    thread_exit();
+}
+
+// A killed process's thread continues here instead of in user mode, as a
+// kernel flow that may block and switch while it tears the process down
+static void process_killed(void)
+{
+    process_exit(PROCESS_EXIT_KILLED);
+}
+
+bool process_check_killed(registers_t *frame)
+{
+    process_t *process = process_current();
+    if (!(frame->cs & 3) || process == NULL || !process->killed) {
+        return false;
+    }
+    
+    // Entries from ring 3 start at the top of the thread's stack, so the
+    // frame is all there is on it: start over from the top
+    frame->rip = (uint64_t)process_killed;
+    frame->cs = GDT_KERNEL_CODE;
+    frame->rflags = RFLAGS_IF | 0x2;
+    frame->rsp = thread_stack_top(thread_current()) - 8;
+    frame->ss = GDT_KERNEL_DATA;
+    return true;
+}
+
+void process_fault(const registers_t *regs)
+{
+    process_t *process = process_current();
+    char num_str[32];
+    
+    screen_write_color("Process ", COLOR_LIGHT_RED, COLOR_BLACK);
+    itoa(process ? process->pid : 0, num_str, 10);
+    screen_write(num_str);
+    screen_write(" killed: exception ");
+    itoa((int)regs->int_no, num_str, 10);
+    screen_write(num_str);
+    screen_write(" at 0x");
+    ultoa(regs->rip, num_str, 16);
+    screen_write(num_str);
+    if (regs->int_no == 14) {
+        uint64_t cr2;
+        __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+        screen_write(", address 0x");
+        ultoa(cr2, num_str, 16);
+        screen_write(num_str);
+    }
+    screen_write("\n");
+    
+    if (process == NULL) {
+        // Ring 3 without a process can't happen, nothing sane left to do
+        for (;;) {
+            __asm__ volatile ("cli; hlt");
+        }
+    }
+    process_exit(PROCESS_EXIT_FAULT);
+}
@@ -0,0 +1,74 @@
+// kernel/process.h - User processes: an address space and a thread in ring 3
+
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sched/thread.h"
+#include "sched/wait.h"
+#include "memory/paging.h"
+#include "interrupts/isr.h"
+
+// Layout of every process
+#define USER_CODE_BASE      USER_SPACE_START
+#define USER_CODE_PAGES     4
+#define USER_STACK_TOP      (USER_SPACE_START + 0x40000000ULL)
+#define USER_STACK_PAGES    4
+
+// Exit codes the kernel picks
+#define PROCESS_EXIT_KILLED (-1)    // kill, Ctrl+C
+#define PROCESS_EXIT_FAULT  (-2)    // CPU exception in user mode
+
+typedef struct process {
+    int pid;
+    char name[THREAD_NAME_MAX];
+    uint64_t *pml4;
+    uint64_t arg;               // rdi when it starts
+    volatile bool exited;
+    volatile bool killed;       // Stop at the next kernel entry
+    int64_t exit_code;
+    uint64_t syscalls;
+    struct ring *console;       // The spawner's, its thread writes there too
+    wait_queue_t exit_waiters;
+} process_t;
+
+// A program built into the kernel (user.asm). The code is position
+// independent and gets copied to USER_CODE_BASE.
+typedef struct {
+    const char *name;
+    const char *description;
+    const uint8_t *start;
+    const uint8_t *end;
+} user_program_t;
+
+// Built-in programs, for listing
+const user_program_t *process_get_programs(int *count);
+const user_program_t *process_find_program(const char *name);
+
+// Start a program in a new address space on a thread of its own, on
+// whichever CPU has the least to do. It inherits the caller's console. NULL
+// if program is NULL (process_find_program() found nothing) or out of
+// memory or threads.
+process_t *process_spawn(const user_program_t *program, uint64_t arg);
+
+// Wait for a process to exit and free it, returning its exit code. If the
+// wait is interrupted (Ctrl+C) the process is killed first.
+int64_t process_wait(process_t *process);
+
+// The calling thread's process (NULL for kernel threads)
+process_t *process_current(void);
+
+// End the calling process: drop its address space and its thread
+void process_exit(int64_t code) __attribute__((noreturn));
+
+// Last thing before an interrupt returns to frame: if that is a killed
+// process's user mode, make it resume in the kernel and exit from there.
+// True if the frame was changed.
+bool process_check_killed(registers_t *frame);
+
+// A CPU exception in user mode, the process is ended
+void process_fault(const registers_t *regs) __attribute__((noreturn));
+
+#endif // PROCESS_H
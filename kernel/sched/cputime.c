@@ -0,0 +1,58 @@
+// kernel/sched/cputime.c - Where each CPU's time goes
+//
+// Every CPU is in one state at a time and charges the TSC cycles since its
+// last transition to it. The transitions are interrupt entry and exit,
+// softirq processing, system calls, thread switches and cpu_idle(), each
+// of which saves the state it found and puts it back when it's done. A
+// thread switch can't do that, it resumes a different frame: the state
+// comes from that frame instead. Handlers on the fast IRQ path are charged
+// to whatever they interrupted, they're too short to bother.
+
+#include "cputime.h"
+#include "../smp.h"
+#include "../lib/cpu.h"
+#include "../lib/string.h"
+
+static cputime_t cputime[APIC_MAX_CPUS];
+
+cputime_state_t cputime_switch(cputime_state_t state)
+{
+    cputime_t *ct = &cputime[smp_processor_id()];
+    uint64_t now = rdtsc();
+    
+    cputime_state_t prev = ct->state;
+    if (ct->since) {
+        ct->cycles[prev] += now - ct->since;
+    }
+    ct->since = now;
+    ct->state = state;
+    return prev;
+}
+
+// Read from another CPU without locking, the numbers are for display
+void cputime_get(int cpu, cputime_t *out)
+{
+    if (cpu < 0 || cpu >= APIC_MAX_CPUS) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    
+    const volatile cputime_t *ct = &cputime[cpu];
+    for (int i = 0; i < CPUTIME_STATES; i++) {
+        out->cycles[i] = ct->cycles[i];
+    }
+    out->since = ct->since;
+    out->state = ct->state;
+    
+    uint64_t now = rdtsc();
+    if (out->since && now > out->since) {
+        out->cycles[out->state] += now - out->since;
+    }
+}
+
+const char *cputime_state_name(cputime_state_t state)
+{
+    static const char *names[CPUTIME_STATES] = { "user", "kernel", "irq", "softirq", "idle" };
+    
+    return (unsigned)state < CPUTIME_STATES ? names[state] : "?";
+}
@@ -0,0 +1,41 @@
+// kernel/sched/cputime.h - Where each CPU's time goes
+
+#ifndef CPUTIME_H
+#define CPUTIME_H
+
+#include <stdint.h>
+#include "../interrupts/isr.h"
+
+typedef enum {
+    CPUTIME_USER = 0,           // Ring 3
+    CPUTIME_KERNEL,             // Threads and tasks in the kernel
+    CPUTIME_IRQ,                // Hard interrupt handlers
+    CPUTIME_SOFTIRQ,            // Deferred interrupt work
+    CPUTIME_IDLE,               // Halted in cpu_idle()
+    CPUTIME_STATES
+} cputime_state_t;
+
+// TSC cycles per state, the state being charged and since when
+typedef struct {
+    uint64_t cycles[CPUTIME_STATES];
+    uint64_t since;
+    cputime_state_t state;
+} cputime_t;
+
+// Charge the calling CPU's time so far to its current state and move to
+// 'state'. Returns the state it was in, to go back to afterwards. Called
+// with interrupts disabled, a nested transition in between would be lost.
+cputime_state_t cputime_switch(cputime_state_t state);
+
+// State an interrupt frame returns to (user or kernel)
+static inline cputime_state_t cputime_frame_state(const registers_t *regs)
+{
+    return (regs->cs & 3) ? CPUTIME_USER : CPUTIME_KERNEL;
+}
+
+// A CPU's totals including the time in its current state so far
+void cputime_get(int cpu, cputime_t *out);
+
+const char *cputime_state_name(cputime_state_t state);
+
+#endif // CPUTIME_H
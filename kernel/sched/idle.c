@@ -0,0 +1,85 @@
+// kernel/sched/idle.c - Halting an idle CPU (MWAIT or HLT)
+//
+// Every place that has nothing to do ends up here: the idle thread (via
+// timer_idle()) and the task workers on the APs. HLT sleeps until the
+// next interrupt, so waking another CPU takes an IPI. MWAIT also wakes on
+// a store to the cache line armed with MONITOR, which lets cpu_idle_wake()
+// get a CPU going again with a plain write. Only the C1 hint is used:
+// deeper states may stop the TSC and the LAPIC timer on older parts.
+
+#include "idle.h"
+#include "cputime.h"
+#include "../smp.h"
+#include "../lib/cpu.h"
+#include "../lib/atomic.h"
+#include "../initcall.h"
+
+#define CPUID_FEATURE_MONITOR  (1u << 3)    // Leaf 1 ECX
+
+// MWAIT hint for C1
+#define MWAIT_HINT_C1 0
+
+// One cache line per CPU so a wake store only disturbs its target
+typedef struct {
+    volatile uint32_t wake;     // Written to end the MWAIT
+    volatile uint32_t polling;  // Set while waiting in MWAIT
+    uint64_t count;
+} __attribute__((aligned(64))) idle_cpu_t;
+
+static idle_cpu_t idle_cpus[APIC_MAX_CPUS];
+static bool use_mwait = false;
+
+void idle_init(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    use_mwait = (ecx & CPUID_FEATURE_MONITOR) != 0;
+}
+INITCALL(INITCALL_CORE, idle_init, NULL);
+
+// A wake that comes in after polling is set either lands before the
+// check below or hits the armed line. One before that also sends an IPI,
+// which is held until the sti and ends the MWAIT as soon as it starts.
+void cpu_idle(void)
+{
+    idle_cpu_t *idle = &idle_cpus[smp_processor_id()];
+    idle->count++;
+    cputime_switch(CPUTIME_IDLE);
+    
+    if (use_mwait) {
+        atomic_store_explicit(&idle->polling, 1, memory_order_seq_cst);
+        __asm__ volatile ("monitor" : : "a"(&idle->wake), "c"(0), "d"(0));
+        if (!idle->wake) {
+            // sti takes effect after the next instruction, so an interrupt
+            // can't slip in between and leave us waiting for the next one
+            __asm__ volatile ("sti; mwait; cli" : : "a"(MWAIT_HINT_C1), "c"(0) : "memory");
+        }
+        atomic_store_explicit(&idle->polling, 0, memory_order_relaxed);
+        idle->wake = 0;
+    } else {
+        __asm__ volatile ("sti; hlt; cli" : : : "memory");
+    }
+    
+    cputime_switch(CPUTIME_KERNEL);
+}
+
+bool cpu_idle_wake(int cpu)
+{
+    if (!use_mwait || cpu < 0 || cpu >= APIC_MAX_CPUS) {
+        return false;
+    }
+    
+    idle_cpu_t *idle = &idle_cpus[cpu];
+    atomic_store_explicit(&idle->wake, 1, memory_order_seq_cst);
+    return atomic_load_explicit(&idle->polling, memory_order_seq_cst) != 0;
+}
+
+bool cpu_idle_mwait(void)
+{
+    return use_mwait;
+}
+
+uint64_t cpu_idle_count(int cpu)
+{
+    return cpu >= 0 && cpu < APIC_MAX_CPUS ? idle_cpus[cpu].count : 0;
+}
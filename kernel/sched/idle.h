@@ -0,0 +1,28 @@
+// kernel/sched/idle.h - Halting an idle CPU (MWAIT or HLT)
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Check for MONITOR/MWAIT
+void idle_init(void);
+
+// Halt until an interrupt or cpu_idle_wake(), with the time charged to
+// CPUTIME_IDLE. Called with interrupts disabled (and the irqsoff section
+// ended) after the caller looked for work; returns with them disabled,
+// any interrupt that woke it has been handled.
+void cpu_idle(void);
+
+// Get a CPU out of cpu_idle() without an interrupt, which only works while
+// it's waiting in MWAIT. Returns false if it has to be sent an IPI instead.
+bool cpu_idle_wake(int cpu);
+
+// Whether cpu_idle() uses MWAIT
+bool cpu_idle_mwait(void);
+
+// Times a CPU went idle
+uint64_t cpu_idle_count(int cpu);
+
+#endif // IDLE_H
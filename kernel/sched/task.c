@@ -0,0 +1,440 @@
+// kernel/sched/task.c - Work-stealing fork/join tasks across CPUs
+//
+// Every CPU has a Chase-Lev deque. The owner pushes and pops tasks at the
+// bottom without locks; other CPUs steal from the top with a compare and
+// swap, so the oldest (and for parallel_for() the largest) piece of work is
+// what moves. APs run task_worker() after bring-up as their idle thread and
+// halt when no deque (and no run queue) has anything; task_spawn() wakes one
+// with an IPI. On the BSP only one pinned thread at a time may own the
+// deque. Other threads' groups run inline, as do those of threads running
+// on an AP: that deque belongs to its idle thread.
+
+#include "task.h"
+#include "thread.h"
+#include "idle.h"
+#include "../smp.h"
+#include "../memory/pmm.h"
+#include "../lib/cpu.h"
+#include "../lib/atomic.h"
+#include "../lib/string.h"
+#include "../initcall.h"
+#include <stddef.h>
+
+#define TASK_DEQUE_MASK (TASK_DEQUE_SIZE - 1)
+
+// Chunk sizes for the bulk helpers
+#define TASK_ZERO_GRAIN     16          // Pages
+#define TASK_CHECKSUM_GRAIN 0x10000     // Bytes
+
+typedef struct {
+    volatile int64_t top;               // Next to steal
+    volatile int64_t bottom;            // Next free slot (owner only)
+    task_t *volatile tasks[TASK_DEQUE_SIZE];
+    task_stats_t stats;
+    uint64_t seed;                      // Victim selection
+} __attribute__((aligned(64))) task_deque_t;
+
+static task_deque_t deques[APIC_MAX_CPUS];
+
+// CPUs taking part, and those halted waiting for work (one bit per CPU)
+static volatile uint64_t workers = 0;
+static volatile uint64_t sleeping = 0;
+
+// Thread that owns the BSP's deque, and how many of its groups are open
+static thread_t *bsp_owner = NULL;
+static int bsp_depth = 0;
+
+// --- Deque ---
+
+static bool deque_push(task_deque_t *d, task_t *task)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= TASK_DEQUE_SIZE) {
+        return false;
+    }
+    
+    atomic_store_explicit(&d->tasks[b & TASK_DEQUE_MASK], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static task_t *deque_pop(task_deque_t *d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    
+    task_t *task = atomic_load_explicit(&d->tasks[b & TASK_DEQUE_MASK], memory_order_relaxed);
+    if (t == b) {
+        // Last one, a thief may be after it too
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+static task_t *deque_steal(task_deque_t *d)
+{
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+    
+    task_t *task = atomic_load_explicit(&d->tasks[t & TASK_DEQUE_MASK], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+static bool deque_empty(task_deque_t *d)
+{
+    return atomic_load_explicit(&d->top, memory_order_seq_cst) >=
+           atomic_load_explicit(&d->bottom, memory_order_seq_cst);
+}
+
+// --- Scheduling ---
+
+static void task_run(int cpu, task_t *task, bool stolen)
+{
+    task_group_t *group = task->group;
+    task->fn(task->arg);
+    atomic_fetch_sub_explicit(&group->pending, 1, memory_order_release);
+    
+    deques[cpu].stats.executed++;
+    if (stolen) {
+        deques[cpu].stats.stolen++;
+    }
+}
+
+// Try every other worker once, starting at a pseudo-random one
+static task_t *task_steal(int cpu)
+{
+    task_deque_t *self = &deques[cpu];
+    self->seed = self->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    int start = (self->seed >> 33) % APIC_MAX_CPUS;
+    uint64_t victims = atomic_load_explicit(&workers, memory_order_relaxed) & ~(1ULL << cpu);
+    
+    for (int i = 0; i < APIC_MAX_CPUS; i++) {
+        int victim = (start + i) % APIC_MAX_CPUS;
+        if (!(victims & (1ULL << victim))) {
+            continue;
+        }
+        task_t *task = deque_steal(&deques[victim]);
+        if (task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+// Own work first (newest, still in cache), then someone else's
+static bool task_run_one(int cpu)
+{
+    task_t *task = deque_pop(&deques[cpu]);
+    if (task) {
+        task_run(cpu, task, false);
+        return true;
+    }
+    
+    task = task_steal(cpu);
+    if (task) {
+        task_run(cpu, task, true);
+        return true;
+    }
+    return false;
+}
+
+static bool task_work_available(void)
+{
+    uint64_t mask = atomic_load_explicit(&workers, memory_order_seq_cst);
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if ((mask & (1ULL << cpu)) && !deque_empty(&deques[cpu])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Wake one halted AP, it wakes the next if it finds more than it can do
+static void task_wake_one(void)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t mask = atomic_load_explicit(&sleeping, memory_order_seq_cst);
+    if (mask) {
+        smp_wake(__builtin_ctzll(mask));
+    }
+}
+
+// Tasks run with interrupts on, but with preemption off: the idle thread
+// only runs again once the run queue is empty, so a task suspended halfway
+// would hold up its group (and whoever spins in task_wait() on it) for as
+// long as a busy thread keeps the CPU. Tasks are short chunks, a thread
+// woken meanwhile waits for the end of one. Interrupts are only off from
+// the last look for work to the halt.
+void task_worker(void)
+{
+    int cpu = smp_processor_id();
+    uint64_t bit = 1ULL << cpu;
+    deques[cpu].seed = cpu + 1;
+    atomic_fetch_or_explicit(&workers, bit, memory_order_seq_cst);
+    
+    __asm__ volatile ("sti");
+    int idle = 0;
+    for (;;) {
+        thread_preempt_disable();
+        bool ran = task_run_one(cpu);
+        thread_preempt_enable();
+        if (ran) {
+            idle = 0;
+            continue;
+        }
+        
+        // Threads queued here (or waiting elsewhere) come before spinning
+        if (thread_ready_count() > 0 || thread_pull()) {
+            thread_yield();
+            idle = 0;
+            continue;
+        }
+        if (++idle < TASK_IDLE_SPINS) {
+            cpu_relax();
+            continue;
+        }
+        
+        // Say we're going to sleep before the last look, so a spawner
+        // either sees the bit or we see its task
+        __asm__ volatile ("cli");
+        atomic_fetch_or_explicit(&sleeping, bit, memory_order_seq_cst);
+        if (!task_work_available() && thread_ready_count() == 0) {
+            deques[cpu].stats.sleeps++;
+            thread_idle_tick_stop();
+            cpu_idle();
+        }
+        atomic_fetch_and_explicit(&sleeping, ~bit, memory_order_seq_cst);
+        __asm__ volatile ("sti");
+        idle = 0;
+    }
+}
+
+static void task_init(void)
+{
+    int cpu = smp_boot_cpu();
+    deques[cpu].seed = cpu + 1;
+    atomic_fetch_or_explicit(&workers, 1ULL << cpu, memory_order_seq_cst);
+}
+INITCALL(INITCALL_MEMORY, task_init, "smp_init");
+
+// --- API ---
+
+static bool task_on_bsp(void)
+{
+    return smp_processor_id() == smp_boot_cpu();
+}
+
+// An AP's task worker is its idle thread (or all there is before threads)
+static bool task_in_worker(void)
+{
+    return thread_current() == NULL || thread_is_idle();
+}
+
+// Whether the calling thread may use the BSP's deque for a new group. It
+// has to stay on the BSP until the group is done.
+static bool task_claim_bsp(void)
+{
+    bool claimed = false;
+    uint64_t flags = irq_save();
+    thread_t *self = thread_current();
+    if (self && self->affinity == THREAD_ANY_CPU) {
+        irq_restore(flags);
+        return false;
+    }
+    if (bsp_owner == NULL || bsp_owner == self) {
+        bsp_owner = self;
+        bsp_depth++;
+        claimed = true;
+    }
+    irq_restore(flags);
+    return claimed;
+}
+
+static void task_release_bsp(void)
+{
+    uint64_t flags = irq_save();
+    if (--bsp_depth == 0) {
+        bsp_owner = NULL;
+    }
+    irq_restore(flags);
+}
+
+void task_group_init(task_group_t *group)
+{
+    group->pending = 0;
+    if (task_on_bsp()) {
+        group->inline_only = !task_claim_bsp();
+    } else {
+        group->inline_only = !task_in_worker();
+    }
+}
+
+void task_spawn(task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg)
+{
+    task->fn = fn;
+    task->arg = arg;
+    task->group = group;
+    
+    if (group->inline_only) {
+        fn(arg);
+        return;
+    }
+    
+    atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+    if (!deque_push(&deques[smp_processor_id()], task)) {
+        task_run(smp_processor_id(), task, false);
+        return;
+    }
+    task_wake_one();
+}
+
+void task_wait(task_group_t *group)
+{
+    if (group->inline_only) {
+        return;
+    }
+    
+    int cpu = smp_processor_id();
+    while (atomic_load_explicit(&group->pending, memory_order_acquire) > 0) {
+        if (!task_run_one(cpu)) {
+            cpu_relax();
+        }
+    }
+    
+    if (task_on_bsp()) {
+        task_release_bsp();
+    }
+}
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t grain;
+    parallel_fn_t fn;
+    void *arg;
+} parallel_range_t;
+
+// Give the right half away and keep splitting the left one
+static void parallel_range(void *p)
+{
+    parallel_range_t *range = (parallel_range_t *)p;
+    if (range->end - range->start <= range->grain) {
+        range->fn(range->start, range->end, range->arg);
+        return;
+    }
+    
+    uint64_t mid = range->start + (range->end - range->start) / 2;
+    parallel_range_t right = *range;
+    parallel_range_t left = *range;
+    right.start = mid;
+    left.end = mid;
+    
+    task_group_t group;
+    task_t task;
+    task_group_init(&group);
+    task_spawn(&group, &task, parallel_range, &right);
+    parallel_range(&left);
+    task_wait(&group);
+}
+
+void parallel_for(uint64_t start, uint64_t end, uint64_t grain, parallel_fn_t fn, void *arg)
+{
+    if (start >= end) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    
+    // Nobody to share with, skip the splitting
+    if (task_worker_count() < 2) {
+        for (uint64_t i = start; i < end; i += grain) {
+            fn(i, end - i < grain ? end : i + grain, arg);
+        }
+        return;
+    }
+    
+    parallel_range_t range = { start, end, grain, fn, arg };
+    parallel_range(&range);
+}
+
+int task_worker_count(void)
+{
+    uint64_t mask = atomic_load_explicit(&workers, memory_order_relaxed);
+    int count = 0;
+    for (; mask; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+void task_get_stats(int cpu, task_stats_t *out)
+{
+    if (cpu < 0 || cpu >= APIC_MAX_CPUS) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    *out = deques[cpu].stats;
+}
+
+// --- Bulk helpers ---
+
+static void zero_chunk(uint64_t start, uint64_t end, void *arg)
+{
+    memset((uint8_t *)arg + start * PAGE_SIZE, 0, (end - start) * PAGE_SIZE);
+}
+
+void parallel_zero_pages(void *pages, uint32_t count)
+{
+    parallel_for(0, count, TASK_ZERO_GRAIN, zero_chunk, pages);
+}
+
+typedef struct {
+    const uint8_t *data;
+    uint64_t size;
+    volatile uint64_t sum;
+} checksum_job_t;
+
+// Whole blocks, so every piece but the last is a word multiple
+static void checksum_chunk(uint64_t start, uint64_t end, void *arg)
+{
+    checksum_job_t *job = (checksum_job_t *)arg;
+    uint64_t first = start * TASK_CHECKSUM_GRAIN;
+    uint64_t last = end * TASK_CHECKSUM_GRAIN;
+    if (last > job->size) {
+        last = job->size;
+    }
+    
+    uint64_t sum = memsum(job->data + first, last - first);
+    atomic_fetch_add_explicit(&job->sum, sum, memory_order_relaxed);
+}
+
+// Same result as memsum()
+uint64_t parallel_checksum(const void *data, uint64_t size)
+{
+    checksum_job_t job = { (const uint8_t *)data, size, 0 };
+    uint64_t blocks = (size + TASK_CHECKSUM_GRAIN - 1) / TASK_CHECKSUM_GRAIN;
+    parallel_for(0, blocks, 1, checksum_chunk, &job);
+    return job.sum;
+}
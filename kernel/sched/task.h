@@ -0,0 +1,61 @@
+// kernel/sched/task.h - Work-stealing fork/join tasks across CPUs
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Tasks a CPU can have queued before task_spawn() runs them inline
+#define TASK_DEQUE_SIZE 256
+
+// Empty steal rounds before an idle AP halts until woken
+#define TASK_IDLE_SPINS 2000
+
+typedef struct task_group {
+    volatile int pending;       // Spawned tasks that haven't finished
+    bool inline_only;           // Another thread owns the BSP's deque, run spawns inline
+} task_group_t;
+
+// Storage belongs to the spawner and has to outlive task_wait()
+typedef struct task {
+    void (*fn)(void *arg);
+    void *arg;
+    task_group_t *group;
+} task_t;
+
+// Body of a parallel_for() chunk, [start, end)
+typedef void (*parallel_fn_t)(uint64_t start, uint64_t end, void *arg);
+
+typedef struct {
+    uint64_t executed;          // Tasks run on this CPU
+    uint64_t stolen;            // ... of which taken from another CPU's deque
+    uint64_t sleeps;            // Times it halted for lack of work
+} task_stats_t;
+
+// An AP's life after bring-up: run and steal tasks, halt when there are none
+void task_worker(void) __attribute__((noreturn));
+
+void task_group_init(task_group_t *group);
+
+// Queue fn(arg) on this CPU's deque, where idle CPUs can steal it. An AP
+// runs the ones it takes without being preempted, so keep them short.
+void task_spawn(task_group_t *group, task_t *task, void (*fn)(void *arg), void *arg);
+
+// Run queued or stolen tasks until everything spawned in the group is done
+void task_wait(task_group_t *group);
+
+// Call fn on chunks of at most grain items covering [start, end), split in
+// halves across the CPUs. Returns when all chunks are done.
+void parallel_for(uint64_t start, uint64_t end, uint64_t grain, parallel_fn_t fn, void *arg);
+
+// CPUs taking work (the BSP plus APs in task_worker())
+int task_worker_count(void);
+
+void task_get_stats(int cpu, task_stats_t *out);
+
+// Bulk helpers built on parallel_for()
+void parallel_zero_pages(void *pages, uint32_t count);
+uint64_t parallel_checksum(const void *data, uint64_t size);
+
+#endif // TASK_H
@@ -0,0 +1,1021 @@
+// kernel/sched/thread.c - Preemptive kernel threads
+//
+// A thread that isn't running is nothing but the registers_t frame irq_common
+// pushed on its stack when it was interrupted. Switching threads means
+// returning another thread's frame from irq_handler(): irq_common loads it
+// into rsp and the pops and iretq resume that thread. A new thread starts
+// from a frame built by hand. thread_yield() raises THREAD_YIELD_VECTOR to
+// get the same frame without waiting for the timer. A blocked thread (see
+// wait.c) simply isn't on a run queue until thread_wake() puts it back.
+//
+// Every CPU has a run queue of its own under its own lock, so picking the
+// next thread never touches another CPU's lines. A woken thread goes back to
+// the queue of the CPU it last ran on, where its data is most likely still
+// cached. A CPU about to go idle, and each one every THREAD_BALANCE_MS, pulls
+// waiting threads over from the busiest queue; pinned threads never move.
+// A frame stays in use until irq_common is on the next thread's stack, only
+// after thread_switch_finish() may another CPU resume it.
+//
+// Above round robin sits the deadline class (thread_set_deadline()): each
+// queue keeps its ready deadline threads apart, ordered by absolute
+// deadline, and picks from them first. Admission keeps a CPU's reserved
+// runtime/period sum under THREAD_DL_MAX_PERCENT, so as long as the threads
+// stay within their budgets every deadline can be met. One that doesn't is
+// throttled into round robin until its next period rather than stopped,
+// the CPU may as well be used if nothing else wants it.
+
+#include "thread.h"
+#include "idle.h"
+#include "cputime.h"
+#include "../drivers/timer.h"
+#include "../interrupts/softirq.h"
+#include "../memory/pmm.h"
+#include "../memory/paging.h"
+#include "../smp.h"
+#include "../lib/cpu.h"
+#include "../lib/atomic.h"
+#include "../lib/spinlock.h"
+#include "../lib/string.h"
+#include "../initcall.h"
+#include <stddef.h>
+
+typedef struct {
+    spinlock_t lock;
+    thread_t *head;             // Ready threads, FIFO (round robin)
+    thread_t *tail;
+    thread_t *dl_head;          // Ready deadline threads, earliest deadline first
+    volatile int count;         // Ready threads on both lists
+    volatile int dl_count;
+    uint64_t dl_bandwidth;      // Reserved by the deadline threads pinned here
+    thread_t *volatile current;
+    thread_t *idle;             // NULL until the CPU joined in
+    thread_t *prev;             // Switched away from, frame still in use
+    volatile bool online;       // Has a tick, may be given threads
+    bool tick_stopped;          // Idle AP halted without it, back on the next switch
+    volatile bool need_resched;
+    int preempt_off;            // thread_preempt_disable() depth, switches wait
+    uint64_t slice_start_ms;
+    uint64_t next_balance_ms;
+    
+    // Statistics
+    uint64_t switches;
+    uint64_t wakeups;
+    uint64_t remote_wakeups;
+    uint64_t migrations;
+    uint64_t balance_runs;
+    uint64_t idle_pulls;
+    uint64_t dl_misses;
+    uint64_t dl_rejected;
+} __attribute__((aligned(64))) runqueue_t;
+
+static runqueue_t runqueues[APIC_MAX_CPUS];
+
+// Thread table
+static thread_t threads[THREAD_MAX];
+static spinlock_t thread_lock = SPINLOCK_INIT("threads");
+static int next_id = 0;
+
+// Set once the boot CPU's queue is up, APs wait for it
+static volatile bool sched_ready = false;
+
+// Selectors new threads start with (the ones the kernel runs on)
+static uint16_t kernel_cs = 0;
+static uint16_t kernel_ss = 0;
+
+static inline runqueue_t *this_rq(void)
+{
+    return &runqueues[smp_processor_id()];
+}
+
+// Bandwidths are fractions of a CPU with this many bits
+#define DL_SHIFT 20
+
+// --- Deadline class ---
+
+// Has a reservation it hasn't used up
+static inline bool dl_active(const thread_t *t)
+{
+    return t->dl_runtime_us != 0 && !t->dl_throttled;
+}
+
+// Full budget, and a deadline counted from now
+static void dl_new_period(thread_t *t, uint64_t now)
+{
+    t->dl_deadline = now + t->dl_deadline_us * 1000ULL;
+    t->dl_release = now + t->dl_period_us * 1000ULL;
+    t->dl_budget = t->dl_runtime_us * 1000ULL;
+    t->dl_throttled = false;
+    t->dl_missed = false;
+}
+
+// Counted once per deadline, and only while the thread still had budget:
+// one that overran its own reservation wasn't let down by the scheduler
+static void dl_check_miss(runqueue_t *rq, thread_t *t, uint64_t now)
+{
+    if (dl_active(t) && !t->dl_missed && now > t->dl_deadline) {
+        t->dl_missed = true;
+        t->dl_misses++;
+        rq->dl_misses++;
+    }
+}
+
+// Take the time t ran since the last charge off its budget. True if that
+// used it up and t is throttled now.
+static bool dl_charge(runqueue_t *rq, thread_t *t, uint64_t now)
+{
+    uint64_t used = now - t->dl_charged_at;
+    t->dl_charged_at = now;
+    if (!dl_active(t)) {
+        return false;
+    }
+    
+    dl_check_miss(rq, t, now);
+    if (used < t->dl_budget) {
+        t->dl_budget -= used;
+        return false;
+    }
+    t->dl_budget = 0;
+    t->dl_throttled = true;
+    t->dl_throttles++;
+    return true;
+}
+
+// A sleeper keeps its deadline only if the budget it has left fits into the
+// time to it at its reserved rate, so it can't save bandwidth up by
+// sleeping (the constant bandwidth server rule)
+static void dl_wakeup(thread_t *t, uint64_t now)
+{
+    if (t->dl_throttled) {
+        if (now >= t->dl_release) {
+            dl_new_period(t, now);
+        }
+        return;
+    }
+    if (now >= t->dl_deadline ||
+        t->dl_budget * t->dl_deadline_us > (t->dl_deadline - now) * t->dl_runtime_us) {
+        dl_new_period(t, now);
+    }
+}
+
+// --- Run queues ---
+
+static void rq_enqueue(runqueue_t *rq, thread_t *t)
+{
+    rq->count++;
+    if (dl_active(t)) {
+        thread_t **link = &rq->dl_head;
+        while (*link && (*link)->dl_deadline <= t->dl_deadline) {
+            link = &(*link)->next;
+        }
+        t->next = *link;
+        *link = t;
+        rq->dl_count++;
+        return;
+    }
+    
+    t->next = NULL;
+    if (rq->tail) {
+        rq->tail->next = t;
+    } else {
+        rq->head = t;
+    }
+    rq->tail = t;
+}
+
+// Deadline threads first
+static thread_t *rq_dequeue(runqueue_t *rq)
+{
+    thread_t *t = rq->dl_head;
+    if (t) {
+        rq->dl_head = t->next;
+        rq->dl_count--;
+        rq->count--;
+        return t;
+    }
+    
+    t = rq->head;
+    if (t) {
+        rq->head = t->next;
+        if (rq->head == NULL) {
+            rq->tail = NULL;
+        }
+        rq->count--;
+    }
+    return t;
+}
+
+// Take t, which follows prev (NULL if it's first), off the round robin list
+static void rq_unlink(runqueue_t *rq, thread_t *prev, thread_t *t)
+{
+    if (prev) {
+        prev->next = t->next;
+    } else {
+        rq->head = t->next;
+    }
+    if (rq->tail == t) {
+        rq->tail = prev;
+    }
+    rq->count--;
+}
+
+// Next thread for a CPU running prev, NULL to stay with it: a deadline
+// thread only gives way to an earlier deadline
+static thread_t *rq_pick(runqueue_t *rq, const thread_t *prev)
+{
+    if (prev->state == THREAD_RUNNING && dl_active(prev) &&
+        (rq->dl_head == NULL || rq->dl_head->dl_deadline >= prev->dl_deadline)) {
+        return NULL;
+    }
+    return rq_dequeue(rq);
+}
+
+// Whether t, just queued on rq, should take the CPU from the thread running there
+static bool rq_dl_preempts(const runqueue_t *rq, const thread_t *t)
+{
+    const thread_t *curr = rq->current;
+    if (!dl_active(t) || curr == NULL) {
+        return false;
+    }
+    return !dl_active(curr) || t->dl_deadline < curr->dl_deadline;
+}
+
+// Threads that want the CPU: the one running (unless idle) and the waiting ones
+static int rq_load(const runqueue_t *rq)
+{
+    return rq->count + (rq->current != rq->idle);
+}
+
+// Where a thread that may run anywhere starts
+static int rq_least_loaded(void)
+{
+    int best = smp_boot_cpu();
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (runqueues[cpu].online && rq_load(&runqueues[cpu]) < rq_load(&runqueues[best])) {
+            best = cpu;
+        }
+    }
+    return best;
+}
+
+// Called from the tick with rq's lock held: charge the running deadline
+// thread, and move throttled ones whose next period began back up
+static void rq_dl_tick(runqueue_t *rq)
+{
+    uint64_t now = timer_get_ns();
+    thread_t *curr = rq->current;
+    if (curr->dl_runtime_us) {
+        if (dl_charge(rq, curr, now) && rq->count > 0) {
+            rq->need_resched = true;
+        }
+        if (curr->dl_throttled && now >= curr->dl_release) {
+            dl_new_period(curr, now);
+        }
+    }
+    
+    thread_t *prev = NULL;
+    thread_t *t = rq->head;
+    while (t) {
+        thread_t *next = t->next;
+        if (t->dl_throttled && now >= t->dl_release) {
+            rq_unlink(rq, prev, t);
+            dl_new_period(t, now);
+            rq_enqueue(rq, t);
+            if (rq_dl_preempts(rq, t)) {
+                rq->need_resched = true;
+            }
+        } else {
+            prev = t;
+        }
+        t = next;
+    }
+}
+
+// The online queue with the most waiting threads, other than rq
+static runqueue_t *rq_busiest(runqueue_t *rq)
+{
+    runqueue_t *busiest = NULL;
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        runqueue_t *other = &runqueues[cpu];
+        if (other == rq || !other->online || other->count == 0) {
+            continue;
+        }
+        if (busiest == NULL || other->count > busiest->count) {
+            busiest = other;
+        }
+    }
+    return busiest;
+}
+
+// Move up to max threads that may run anywhere from busiest to rq, oldest
+// first: they waited longest and are the least likely to still be cached
+// there. Locks are taken in CPU order, so two CPUs pulling from each other
+// can't deadlock. A thread whose CPU hasn't finished switching away from
+// it stays where it is.
+static int rq_pull(runqueue_t *rq, runqueue_t *busiest, int max)
+{
+    runqueue_t *first = rq < busiest ? rq : busiest;
+    runqueue_t *second = rq < busiest ? busiest : rq;
+    int cpu = (int)(rq - runqueues);
+    int moved = 0;
+    
+    uint64_t flags = spin_lock_irqsave(&first->lock);
+    spin_lock(&second->lock);
+    
+    thread_t *prev = NULL;
+    thread_t *t = busiest->head;
+    while (t && moved < max) {
+        thread_t *next = t->next;
+        if (t->affinity != THREAD_ANY_CPU || t->on_cpu) {
+            prev = t;
+            t = next;
+            continue;
+        }
+        
+        rq_unlink(busiest, prev, t);
+        t->cpu = cpu;
+        t->migrations++;
+        rq_enqueue(rq, t);
+        moved++;
+        t = next;
+    }
+    rq->migrations += moved;
+    
+    spin_unlock(&second->lock);
+    spin_unlock_irqrestore(&first->lock, flags);
+    return moved;
+}
+
+// Periodic: take half the difference when the busiest queue is ahead by two
+static void rq_balance(runqueue_t *rq)
+{
+    rq->balance_runs++;
+    runqueue_t *busiest = rq_busiest(rq);
+    if (busiest == NULL) {
+        return;
+    }
+    
+    int imbalance = rq_load(busiest) - rq_load(rq);
+    if (imbalance >= 2) {
+        rq_pull(rq, busiest, imbalance / 2);
+    }
+}
+
+// t was queued on cpu. An idle CPU has to switch to it now rather than at
+// its next tick, and so does one running a thread with a later deadline
+// (ours at the end of the interrupt, at the latest with the next tick).
+// If cpu is busy and t may move, wake an idle one to pull it.
+static void rq_kick(int cpu, const thread_t *t)
+{
+    runqueue_t *rq = &runqueues[cpu];
+    int self = smp_processor_id();
+    
+    if (rq->current == rq->idle || rq_dl_preempts(rq, t)) {
+        rq->need_resched = true;
+        if (cpu != self) {
+            smp_wake(cpu);
+        }
+        return;
+    }
+    if (t->affinity != THREAD_ANY_CPU) {
+        return;
+    }
+    
+    for (int other = 0; other < APIC_MAX_CPUS; other++) {
+        runqueue_t *idle = &runqueues[other];
+        if (other != cpu && other != self && idle->online && idle->current == idle->idle) {
+            smp_wake(other);
+            return;
+        }
+    }
+}
+
+// --- Threads ---
+
+// Free the stacks of threads that exited and are off their CPU
+static void thread_reap(void)
+{
+    uint64_t flags = spin_lock_irqsave(&thread_lock);
+    for (int i = 0; i < THREAD_MAX; i++) {
+        thread_t *t = &threads[i];
+        if (t->state == THREAD_DEAD && !t->on_cpu) {
+            if (t->stack) {
+                pmm_free_pages(t->stack, THREAD_STACK_PAGES);
+            }
+            t->stack = NULL;
+            t->state = THREAD_UNUSED;
+        }
+    }
+    spin_unlock_irqrestore(&thread_lock, flags);
+}
+
+// First code a new thread runs
+static void thread_start(void)
+{
+    thread_t *self = thread_current();
+    self->entry(self->arg);
+    thread_exit();
+}
+
+// Runs when nobody else can, halting with the tick off until an interrupt
+static void thread_idle(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        softirq_run();
+        thread_reap();
+        
+        // Background device probes still need the tick to be polled
+        if (initcall_poll()) {
+            thread_yield();
+            uint64_t flags = irq_save();
+            irqsoff_end();
+            cpu_idle();
+            irq_restore(flags);
+            continue;
+        }
+        
+        uint64_t flags = irq_save();
+        timer_idle();
+        irq_restore(flags);
+    }
+}
+
+// Called with thread_lock held
+static thread_t *thread_alloc(const char *name, int cpu, int affinity)
+{
+    for (int i = 0; i < THREAD_MAX; i++) {
+        thread_t *t = &threads[i];
+        if (t->state != THREAD_UNUSED) {
+            continue;
+        }
+        
+        memset(t, 0, sizeof(*t));
+        t->id = next_id++;
+        t->cpu = cpu;
+        t->affinity = affinity;
+        strncpy(t->name, name, THREAD_NAME_MAX - 1);
+        t->name[THREAD_NAME_MAX - 1] = '\0';
+        return t;
+    }
+    return NULL;
+}
+
+// Make the flow that called us the running thread of this CPU
+static thread_t *thread_adopt(const char *name)
+{
+    int cpu = smp_processor_id();
+    uint64_t flags = spin_lock_irqsave(&thread_lock);
+    thread_t *t = thread_alloc(name, cpu, cpu);
+    spin_unlock_irqrestore(&thread_lock, flags);
+    if (t == NULL) {
+        return NULL;
+    }
+    
+    t->state = THREAD_RUNNING;
+    t->on_cpu = true;
+    t->switches = 1;
+    t->switched_in = timer_get_cycles();
+    
+    runqueue_t *rq = &runqueues[cpu];
+    rq->current = t;
+    this_cpu()->current = t;
+    rq->slice_start_ms = timer_get_uptime_ms();
+    rq->next_balance_ms = rq->slice_start_ms + THREAD_BALANCE_MS;
+    return t;
+}
+
+// A thread with a fresh stack whose first frame "returns" into thread_start()
+static thread_t *thread_spawn(const char *name, void (*entry)(void *), void *arg,
+                              int cpu, int affinity)
+{
+    void *stack = pmm_alloc_pages(THREAD_STACK_PAGES);
+    if (stack == NULL) {
+        return NULL;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&thread_lock);
+    thread_t *t = thread_alloc(name, cpu, affinity);
+    if (t == NULL) {
+        spin_unlock_irqrestore(&thread_lock, flags);
+        pmm_free_pages(stack, THREAD_STACK_PAGES);
+        return NULL;
+    }
+    
+    t->stack = stack;
+    uint64_t top = thread_stack_top(t);
+    registers_t *frame = (registers_t *)(top - sizeof(registers_t));
+    memset(frame, 0, sizeof(*frame));
+    frame->rip = (uint64_t)thread_start;
+    frame->cs = kernel_cs;
+    frame->rflags = RFLAGS_IF | 0x2;
+    frame->rsp = top - 8;       // As if thread_start() had been called
+    frame->ss = kernel_ss;
+    
+    t->entry = entry;
+    t->arg = arg;
+    t->context = frame;
+    t->state = THREAD_READY;
+    spin_unlock_irqrestore(&thread_lock, flags);
+    return t;
+}
+
+// THREAD_TICK_VECTOR handler
+static void thread_tick_handler(registers_t *regs)
+{
+    (void)regs;
+    thread_tick();
+}
+
+void thread_init(void)
+{
+    __asm__ volatile ("mov %%cs, %0" : "=r"(kernel_cs));
+    __asm__ volatile ("mov %%ss, %0" : "=r"(kernel_ss));
+    
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        spin_lock_init(&runqueues[cpu].lock, "runqueue");
+    }
+    
+    // Whoever called us becomes thread 0, on the boot stack
+    int cpu = smp_processor_id();
+    runqueue_t *rq = &runqueues[cpu];
+    thread_adopt("main");
+    rq->idle = thread_spawn("idle", thread_idle, NULL, cpu, cpu);
+    rq->online = true;
+    
+    irq_install_vector_handler(THREAD_TICK_VECTOR, thread_tick_handler);
+    atomic_store_explicit(&sched_ready, true, memory_order_release);
+}
+INITCALL(INITCALL_MEMORY, thread_init, "smp_init");
+
+// An AP's own tick. Two per slice, so a slice never stretches over two periods.
+static bool rq_tick_start(void)
+{
+    return timer_start_local_tick(THREAD_TICK_VECTOR, THREAD_TIMESLICE_MS / 2);
+}
+
+void thread_ap_init(void)
+{
+    while (!atomic_load_explicit(&sched_ready, memory_order_acquire)) {
+        cpu_relax();
+    }
+    
+    int cpu = smp_processor_id();
+    char name[THREAD_NAME_MAX] = "idle/";
+    itoa(cpu, name + 5, 10);
+    
+    runqueue_t *rq = &runqueues[cpu];
+    rq->idle = thread_adopt(name);
+    if (rq->idle == NULL) {
+        return;
+    }
+    
+    // Without a tick of its own a thread could keep this CPU forever
+    if (rq_tick_start()) {
+        rq->online = true;
+    }
+}
+
+void thread_idle_tick_stop(void)
+{
+    runqueue_t *rq = this_rq();
+    if (rq->online && !rq->tick_stopped && rq->count == 0 &&
+        smp_processor_id() != smp_boot_cpu()) {
+        timer_stop_local_tick();
+        rq->tick_stopped = true;
+    }
+}
+
+thread_t *thread_create_on(const char *name, void (*entry)(void *arg), void *arg, int cpu)
+{
+    if (!sched_ready || entry == NULL) {
+        return NULL;
+    }
+    
+    int affinity = cpu;
+    if (cpu == THREAD_ANY_CPU) {
+        cpu = rq_least_loaded();
+    } else if (cpu < 0 || cpu >= APIC_MAX_CPUS || !runqueues[cpu].online) {
+        return NULL;
+    }
+    
+    thread_reap();
+    thread_t *t = thread_spawn(name, entry, arg, cpu, affinity);
+    if (t == NULL) {
+        return NULL;
+    }
+    
+    runqueue_t *rq = &runqueues[cpu];
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    rq_enqueue(rq, t);
+    spin_unlock_irqrestore(&rq->lock, flags);
+    rq_kick(cpu, t);
+    return t;
+}
+
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg)
+{
+    return thread_create_on(name, entry, arg, smp_boot_cpu());
+}
+
+bool thread_set_deadline(uint32_t runtime_us, uint32_t deadline_us, uint32_t period_us)
+{
+    thread_t *self = thread_current();
+    if (self == NULL || self->affinity == THREAD_ANY_CPU || thread_is_idle()) {
+        return false;
+    }
+    if (runtime_us != 0 && (runtime_us > deadline_us || deadline_us > period_us ||
+                            period_us > THREAD_DL_PERIOD_MAX_US)) {
+        return false;
+    }
+    
+    uint64_t bandwidth = 0;
+    if (runtime_us != 0) {
+        bandwidth = ((uint64_t)runtime_us << DL_SHIFT) / period_us;
+    }
+    
+    // Pinned, so the CPU we're on is the one it reserves
+    runqueue_t *rq = this_rq();
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+    uint64_t reserved = rq->dl_bandwidth - self->dl_bandwidth + bandwidth;
+    if (reserved > ((uint64_t)THREAD_DL_MAX_PERCENT << DL_SHIFT) / 100) {
+        rq->dl_rejected++;
+        spin_unlock_irqrestore(&rq->lock, flags);
+        return false;
+    }
+    
+    rq->dl_bandwidth = reserved;
+    self->dl_bandwidth = bandwidth;
+    self->dl_runtime_us = runtime_us;
+    self->dl_deadline_us = deadline_us;
+    self->dl_period_us = period_us;
+    uint64_t now = timer_get_ns();
+    self->dl_charged_at = now;
+    dl_new_period(self, now);
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return true;
+}
+
+void thread_yield(void)
+{
+    thread_t *self = thread_current();
+    if (self == NULL || softirq_running()) {
+        return;
+    }
+    if (thread_ready_count() == 0 && self->state == THREAD_RUNNING) {
+        return;
+    }
+    __asm__ volatile ("int %0" : : "i"(THREAD_YIELD_VECTOR) : "memory");
+}
+
+// A dead thread is never put back on a run queue, so being preempted
+// between marking it and yielding is fine
+void thread_exit(void)
+{
+    // Its reservation goes back to the CPU
+    if (thread_current()->dl_runtime_us) {
+        thread_set_deadline(0, 0, 0);
+    }
+    
+    thread_current()->state = THREAD_DEAD;
+    thread_yield();
+    for (;;) {
+        __asm__ volatile ("hlt");
+    }
+}
+
+// One load from the per-CPU area, every console write and lock owner check
+// comes through here
+thread_t *thread_current(void)
+{
+    if (!sched_ready) {
+        return NULL;
+    }
+    
+    thread_t *t;
+    __asm__ volatile ("mov %%gs:%c1, %0" : "=r"(t) : "i"(offsetof(percpu_t, current)));
+    return t;
+}
+
+uint64_t thread_stack_top(const thread_t *t)
+{
+    return (uint64_t)t->stack + THREAD_STACK_PAGES * PAGE_SIZE;
+}
+
+bool thread_interrupted(void)
+{
+    thread_t *self = thread_current();
+    return self != NULL && self->interrupted;
+}
+
+bool thread_can_block(void)
+{
+    thread_t *self = thread_current();
+    if (self == NULL || softirq_running()) {
+        return false;
+    }
+    
+    runqueue_t *rq = this_rq();
+    return rq->idle != NULL && self != rq->idle;
+}
+
+bool thread_is_idle(void)
+{
+    thread_t *self = thread_current();
+    return self != NULL && self == this_rq()->idle;
+}
+
+// Wakers take the wait queue's lock before looking at the state, the same
+// one the waiter holds here (see wait.c)
+void thread_block_prepare(void)
+{
+    thread_current()->state = THREAD_BLOCKED;
+}
+
+// The next thread runs with its own flags, which ends the interrupts-off
+// section as far as the tracer is concerned
+void thread_block(void)
+{
+    thread_t *self = thread_current();
+    if (self->state != THREAD_BLOCKED) {
+        return;
+    }
+    self->blocks++;
+    irqsoff_end();
+    __asm__ volatile ("int %0" : : "i"(THREAD_YIELD_VECTOR) : "memory");
+}
+
+void thread_block_cancel(void)
+{
+    thread_t *self = thread_current();
+    if (self->state == THREAD_BLOCKED) {
+        self->state = THREAD_RUNNING;
+    }
+}
+
+void thread_wake(thread_t *t)
+{
+    for (;;) {
+        int cpu = t->cpu;
+        runqueue_t *rq = &runqueues[cpu];
+        uint64_t flags = spin_lock_irqsave(&rq->lock);
+        
+        // Pulled to another queue while we weren't holding this one's lock
+        if (t->cpu != cpu) {
+            spin_unlock_irqrestore(&rq->lock, flags);
+            continue;
+        }
+        
+        bool queued = false;
+        if (t->state == THREAD_BLOCKED) {
+            if (rq->current == t) {
+                // Woken before it got to switch away
+                t->state = THREAD_RUNNING;
+            } else {
+                if (t->dl_runtime_us) {
+                    dl_wakeup(t, timer_get_ns());
+                }
+                t->state = THREAD_READY;
+                rq_enqueue(rq, t);
+                rq->wakeups++;
+                if (cpu != smp_processor_id()) {
+                    rq->remote_wakeups++;
+                }
+                queued = true;
+            }
+        }
+        spin_unlock_irqrestore(&rq->lock, flags);
+        
+        if (queued) {
+            rq_kick(cpu, t);
+        }
+        return;
+    }
+}
+
+int thread_ready_count(void)
+{
+    return sched_ready ? this_rq()->count : 0;
+}
+
+bool thread_pull(void)
+{
+    if (!sched_ready) {
+        return false;
+    }
+    
+    runqueue_t *rq = this_rq();
+    runqueue_t *busiest = rq_busiest(rq);
+    if (!rq->online || busiest == NULL || rq_pull(rq, busiest, 1) == 0) {
+        return false;
+    }
+    rq->idle_pulls++;
+    return true;
+}
+
+void thread_tick(void)
+{
+    if (!sched_ready) {
+        return;
+    }
+    
+    runqueue_t *rq = this_rq();
+    if (rq->current == NULL) {
+        return;
+    }
+    
+    uint64_t now = timer_get_uptime_ms();
+    if (rq->online && now >= rq->next_balance_ms) {
+        rq->next_balance_ms = now + THREAD_BALANCE_MS;
+        rq_balance(rq);
+    }
+    
+    if (rq->dl_bandwidth) {
+        spin_lock(&rq->lock);
+        rq_dl_tick(rq);
+        spin_unlock(&rq->lock);
+    }
+    
+    // A deadline thread has no time slice, it runs until it blocks, its
+    // budget is gone or an earlier deadline comes along
+    if (rq->count == 0 || dl_active(rq->current)) {
+        return;
+    }
+    if (rq->current == rq->idle || rq->dl_count > 0 ||
+        now - rq->slice_start_ms >= THREAD_TIMESLICE_MS) {
+        rq->need_resched = true;
+    }
+}
+
+// Called with interrupts disabled, from the outermost interrupt frame
+registers_t *thread_switch(registers_t *regs)
+{
+    if (!sched_ready) {
+        return regs;
+    }
+    
+    runqueue_t *rq = this_rq();
+    thread_t *prev = rq->current;
+    rq->need_resched = false;
+    if (prev == NULL) {
+        return regs;
+    }
+    
+    // About to run dry: see whether another CPU has a thread to spare
+    if (rq->count == 0 && prev->state != THREAD_RUNNING) {
+        thread_pull();
+    }
+    
+    spin_lock(&rq->lock);
+    uint64_t now_ns = rq->dl_bandwidth ? timer_get_ns() : 0;
+    if (prev->dl_runtime_us) {
+        dl_charge(rq, prev, now_ns);
+    }
+    
+    thread_t *next = rq_pick(rq, prev);
+    if (next == NULL) {
+        if (prev->state == THREAD_RUNNING || rq->idle == NULL) {
+            spin_unlock(&rq->lock);
+            rq->slice_start_ms = timer_get_uptime_ms();
+            return regs;
+        }
+        next = rq->idle;
+    }
+    
+    prev->context = regs;
+    if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_READY;
+        if (prev != rq->idle) {
+            rq_enqueue(rq, prev);
+        }
+    }
+    
+    uint64_t now = timer_get_cycles();
+    prev->run_cycles += now - prev->switched_in;
+    next->switched_in = now;
+    if (next->dl_runtime_us) {
+        next->dl_charged_at = now_ns;
+        dl_check_miss(rq, next, now_ns);
+    }
+    next->state = THREAD_RUNNING;
+    next->on_cpu = true;
+    next->switches++;
+    rq->switches++;
+    rq->prev = prev;
+    rq->current = next;
+    spin_unlock(&rq->lock);
+    
+    // A user thread brings its page tables and has entries from ring 3
+    // land on its own stack. Kernel threads go back to the kernel's tables,
+    // the ones they were on may be about to be freed.
+    if (next->address_space) {
+        paging_switch(next->address_space);
+        smp_set_kernel_stack(thread_stack_top(next));
+    } else if (prev->address_space) {
+        paging_switch(paging_kernel_space());
+    }
+    
+    // The frame decides what this CPU does from here, user or kernel code
+    cputime_switch(cputime_frame_state(next->context));
+    
+    // Whatever woke the halted idle thread, the thread it hands over to
+    // needs the tick to be preempted
+    if (rq->tick_stopped && next != rq->idle) {
+        rq->tick_stopped = false;
+        rq_tick_start();
+    }
+    
+    this_cpu()->current = next;
+    rq->slice_start_ms = timer_get_uptime_ms();
+    return next->context;
+}
+
+void thread_switch_finish(void)
+{
+    runqueue_t *rq = this_rq();
+    thread_t *prev = rq->prev;
+    rq->prev = NULL;
+    if (prev) {
+        atomic_store_explicit(&prev->on_cpu, false, memory_order_release);
+    }
+}
+
+bool thread_need_resched(void)
+{
+    runqueue_t *rq = this_rq();
+    return sched_ready && rq->need_resched && !rq->preempt_off && !softirq_running();
+}
+
+void thread_preempt_disable(void)
+{
+    this_rq()->preempt_off++;
+}
+
+// A switch requested meanwhile happens now
+void thread_preempt_enable(void)
+{
+    runqueue_t *rq = this_rq();
+    if (--rq->preempt_off == 0 && rq->need_resched) {
+        thread_yield();
+    }
+}
+
+registers_t *thread_preempt(registers_t *regs)
+{
+    if (!sched_ready) {
+        return regs;
+    }
+    
+    // Deferred work interrupted by this IRQ has to finish on this stack first
+    runqueue_t *rq = this_rq();
+    if (!rq->need_resched || rq->preempt_off || softirq_running()) {
+        return regs;
+    }
+    
+    thread_t *prev = rq->current;
+    registers_t *next = thread_switch(regs);
+    if (next != regs) {
+        prev->preemptions++;
+    }
+    return next;
+}
+
+const thread_t *thread_get(int index)
+{
+    if (index < 0 || index >= THREAD_MAX || threads[index].state == THREAD_UNUSED) {
+        return NULL;
+    }
+    return &threads[index];
+}
+
+const char *thread_state_name(thread_state_t state)
+{
+    static const char *names[] = { "unused", "ready", "running", "blocked", "dead" };
+    
+    if ((unsigned)state < sizeof(names) / sizeof(names[0])) {
+        return names[state];
+    }
+    return "?";
+}
+
+bool thread_get_rq_stats(int cpu, thread_rq_stats_t *out)
+{
+    if (cpu < 0 || cpu >= APIC_MAX_CPUS || runqueues[cpu].idle == NULL) {
+        return false;
+    }
+    
+    runqueue_t *rq = &runqueues[cpu];
+    out->online = rq->online;
+    out->ready = rq->count;
+    out->current = rq->current;
+    out->switches = rq->switches;
+    out->wakeups = rq->wakeups;
+    out->remote_wakeups = rq->remote_wakeups;
+    out->migrations = rq->migrations;
+    out->balance_runs = rq->balance_runs;
+    out->idle_pulls = rq->idle_pulls;
+    out->dl_ready = rq->dl_count;
+    out->dl_reserved = (uint32_t)((rq->dl_bandwidth * 100) >> DL_SHIFT);
+    out->dl_misses = rq->dl_misses;
+    out->dl_rejected = rq->dl_rejected;
+    return true;
+}
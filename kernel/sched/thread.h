@@ -0,0 +1,204 @@
+// kernel/sched/thread.h - Preemptive kernel threads
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../interrupts/isr.h"
+
+// Limits
+#define THREAD_MAX          32
+#define THREAD_NAME_MAX     16
+#define THREAD_STACK_PAGES  4       // 16KB per thread
+
+// A thread runs this long before the timer hands the CPU to the next one
+#define THREAD_TIMESLICE_MS 10
+
+// Each CPU evens its run queue out with the busiest one this often (and
+// whenever it is about to go idle)
+#define THREAD_BALANCE_MS   100
+
+// Software interrupt thread_yield() uses to get a registers_t frame
+#define THREAD_YIELD_VECTOR 0xF3
+
+// Local APIC timer interrupt that ends time slices on the APs (the boot
+// CPU's come from the system timer)
+#define THREAD_TICK_VECTOR  0xF6
+
+// thread_create_on(): no fixed CPU, the scheduler places and moves it
+#define THREAD_ANY_CPU      (-1)
+
+// Share of a CPU the deadline threads on it may reserve together, the rest
+// stays with round robin. Periods are at most THREAD_DL_PERIOD_MAX_US.
+#define THREAD_DL_MAX_PERCENT   90
+#define THREAD_DL_PERIOD_MAX_US 1000000
+
+typedef enum {
+    THREAD_UNUSED = 0,
+    THREAD_READY,               // On a run queue
+    THREAD_RUNNING,
+    THREAD_BLOCKED,             // On a wait queue
+    THREAD_DEAD,                // Exited, stack freed once it is off its CPU
+} thread_state_t;
+
+typedef struct thread {
+    int id;
+    char name[THREAD_NAME_MAX];
+    thread_state_t state;
+    registers_t *context;       // Saved frame (on its own stack) while not running
+    void *stack;                // NULL for the boot thread
+    void (*entry)(void *arg);
+    void *arg;
+    struct thread *next;        // Run queue link
+    struct thread *wait_next;   // Wait queue link
+    struct wait_queue *waiting_on;
+    volatile bool interrupted;  // Asked to stop (Ctrl+C, kill), see wait_interrupt()
+    struct ring *console;       // Screen output goes here instead (background jobs)
+    uint64_t *address_space;    // User page tables, NULL for kernel only threads
+    struct process *process;    // Set for threads that run a user process
+    int cpu;                    // CPU it runs on or last ran on (where a wakeup queues it)
+    int affinity;               // The only CPU it may run on, or THREAD_ANY_CPU
+    volatile bool on_cpu;       // Frame still in use until the switch away from it completes
+    
+    // Deadline class (thread_set_deadline()), dl_runtime_us 0 for round robin
+    uint32_t dl_runtime_us;     // CPU time it may use per period
+    uint32_t dl_deadline_us;    // ... within this long of the period's start
+    uint32_t dl_period_us;
+    uint64_t dl_bandwidth;      // runtime / period, 20 bit fraction
+    uint64_t dl_deadline;       // Absolute, timer_get_ns()
+    uint64_t dl_release;        // Earliest start of the next period
+    uint64_t dl_budget;         // ns left in this period
+    uint64_t dl_charged_at;     // Running since, for charging the budget
+    bool dl_throttled;          // Budget used up: round robin until dl_release
+    bool dl_missed;             // This deadline's miss is counted
+    uint64_t dl_misses;         // Deadlines passed with budget left and work to do
+    uint64_t dl_throttles;      // Times it used up its budget
+
+    // Accounting
+    uint64_t switches;          // Times it was switched to
+    uint64_t preemptions;       // Times the timer took the CPU away
+    uint64_t blocks;            // Times it went to sleep on a wait queue
+    uint64_t migrations;        // Times it was moved to another CPU's queue
+    uint64_t run_cycles;        // Clocksource cycles spent running
+    uint64_t switched_in;
+} thread_t;
+
+// One CPU's run queue, for listing
+typedef struct {
+    bool online;                // Takes threads (has a tick to end their slices)
+    int ready;
+    const thread_t *current;
+    uint64_t switches;
+    uint64_t wakeups;           // Threads woken onto this queue
+    uint64_t remote_wakeups;    // ... by another CPU
+    uint64_t migrations;        // Threads pulled over from other queues
+    uint64_t balance_runs;      // Periodic looks at the other queues
+    uint64_t idle_pulls;        // Threads pulled when about to go idle
+    int dl_ready;               // ... of ready, on the deadline queue
+    uint32_t dl_reserved;       // Percent of the CPU deadline threads reserved
+    uint64_t dl_misses;
+    uint64_t dl_rejected;       // thread_set_deadline() calls admission turned down
+} thread_rq_stats_t;
+
+// Turn the boot flow into thread 0 ("main") and start the idle thread
+void thread_init(void);
+
+// Called by each AP once it's up: its flow becomes that CPU's idle thread,
+// and with a local tick the CPU starts taking threads
+void thread_ap_init(void);
+
+// Start a thread running entry(arg) on the boot CPU, where the subsystems
+// that only disable interrupts for locking expect kernel threads. Returns
+// NULL if out of slots or memory.
+thread_t *thread_create(const char *name, void (*entry)(void *arg), void *arg);
+
+// Same, on a given CPU or THREAD_ANY_CPU (the least loaded one to start with,
+// after that wherever the balancer puts it)
+thread_t *thread_create_on(const char *name, void (*entry)(void *arg), void *arg, int cpu);
+
+// Make the calling thread a deadline thread: every period_us it may run for
+// runtime_us, and has to get them within deadline_us of the period's start.
+// Ready deadline threads run before round robin ones, earliest deadline
+// first, and one that wakes preempts a thread with a later deadline. Used
+// up budget makes it a round robin thread until its next period. False if
+// the parameters don't make sense, the thread may change CPUs, or its CPU's
+// deadline threads would reserve more than THREAD_DL_MAX_PERCENT of it.
+// runtime_us 0 makes it a round robin thread again.
+bool thread_set_deadline(uint32_t runtime_us, uint32_t deadline_us, uint32_t period_us);
+
+// Give the CPU to the next ready thread (returns right away if there is none)
+void thread_yield(void);
+
+// End the calling thread
+void thread_exit(void) __attribute__((noreturn));
+
+thread_t *thread_current(void);
+
+// Top of a thread's kernel stack (where entries from user mode start)
+uint64_t thread_stack_top(const thread_t *t);
+
+// Whether the calling thread was asked to stop what it's doing
+bool thread_interrupted(void);
+
+// Whether the caller is a thread that may sleep (not idle, not deferred work)
+bool thread_can_block(void);
+
+// Whether the caller is this CPU's idle thread
+bool thread_is_idle(void);
+
+// For wait queues, with interrupts disabled: mark the calling thread as
+// blocked while it links itself in and checks its condition one last time.
+// thread_block() then switches away unless a thread_wake() came in between,
+// thread_block_cancel() makes it running again if the wait is over anyway.
+void thread_block_prepare(void);
+void thread_block(void);
+void thread_block_cancel(void);
+
+// Put a blocked thread back on its CPU's run queue (no-op for any other state)
+void thread_wake(thread_t *t);
+
+// Threads waiting for this CPU
+int thread_ready_count(void);
+
+// Called by an idle CPU: move a waiting thread over from the busiest queue.
+// True if it got one.
+bool thread_pull(void);
+
+// Called by an AP's idle thread with interrupts off, just before it halts:
+// with nothing queued the local tick stops (an idle CPU has nothing to
+// preempt) until the CPU switches to a thread again
+void thread_idle_tick_stop(void);
+
+// Called from the timer interrupt, requests a switch when the slice is used
+// up and balances the run queues every THREAD_BALANCE_MS
+void thread_tick(void);
+
+// Whether the end of the current interrupt should switch threads
+bool thread_need_resched(void);
+
+// Keep interrupts from switching threads on this CPU (nests). The caller
+// must not move to another CPU meanwhile (pinned, or the idle thread) and
+// must not block.
+void thread_preempt_disable(void);
+void thread_preempt_enable(void);
+
+// End of the full IRQ path: the frame to return to (another thread's if a
+// switch was requested and we're not nested in deferred work)
+registers_t *thread_preempt(registers_t *regs);
+
+// THREAD_YIELD_VECTOR handler
+registers_t *thread_switch(registers_t *regs);
+
+// Called by irq_common once it is on the new thread's stack: the previous
+// thread may now be resumed by another CPU
+void thread_switch_finish(void);
+
+// Thread table, for listing
+const thread_t *thread_get(int index);
+const char *thread_state_name(thread_state_t state);
+
+// A CPU's run queue, false if there is no such CPU
+bool thread_get_rq_stats(int cpu, thread_rq_stats_t *out);
+
+#endif // THREAD_H
@@ -0,0 +1,138 @@
+// kernel/sched/wait.c - Wait queues
+//
+// A thread waiting for an event (a key, a timer) links itself into the
+// event's queue and leaves the CPU. The code that makes the event happen
+// calls wake_up() on that queue, so exactly its waiters run again and
+// nobody polls. The queue's lock orders a waiter marking itself blocked
+// against a waker on another CPU: whichever comes second sees the other,
+// so either the waiter finds its condition true or the waker finds it
+// blocked. Wakers take the run queue locks inside this one.
+//
+// A thread's waiting_on only changes under waiting_lock, which
+// wait_interrupt() holds while it uses the queue, so the queue can't go
+// away (a sleeper's stack, a process being freed) while it's in there.
+
+#include "wait.h"
+#include "../drivers/timer.h"
+#include <stddef.h>
+
+static spinlock_t waiting_lock = SPINLOCK_INIT("waiting_on");
+
+void wait_queue_init(wait_queue_t *wq)
+{
+    spin_lock_init(&wq->lock, NULL);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+// Called with wq's lock held, no-op if a wakeup took t off already
+static void wait_unlink(wait_queue_t *wq, thread_t *t)
+{
+    thread_t *prev = NULL;
+    for (thread_t *w = wq->head; w; prev = w, w = w->wait_next) {
+        if (w != t) {
+            continue;
+        }
+        if (prev) {
+            prev->wait_next = t->wait_next;
+        } else {
+            wq->head = t->wait_next;
+        }
+        if (wq->tail == t) {
+            wq->tail = prev;
+        }
+        t->wait_next = NULL;
+        break;
+    }
+}
+
+bool wait_prepare(wait_queue_t *wq)
+{
+    if (!thread_can_block()) {
+        timer_idle();
+        __asm__ volatile ("cli");
+        return false;
+    }
+    
+    thread_t *self = thread_current();
+    spin_lock(&waiting_lock);
+    spin_lock(&wq->lock);
+    self->wait_next = NULL;
+    if (wq->tail) {
+        wq->tail->wait_next = self;
+    } else {
+        wq->head = self;
+    }
+    wq->tail = self;
+    self->waiting_on = wq;
+    thread_block_prepare();
+    spin_unlock(&wq->lock);
+    spin_unlock(&waiting_lock);
+    return true;
+}
+
+void wait_finish(wait_queue_t *wq)
+{
+    thread_t *self = thread_current();
+    spin_lock(&waiting_lock);
+    spin_lock(&wq->lock);
+    wait_unlink(wq, self);
+    thread_block_cancel();
+    spin_unlock(&wq->lock);
+    self->waiting_on = NULL;
+    spin_unlock(&waiting_lock);
+}
+
+// Called with wq's lock held
+static void wake_up_locked(wait_queue_t *wq)
+{
+    thread_t *t = wq->head;
+    wq->head = NULL;
+    wq->tail = NULL;
+    
+    while (t) {
+        thread_t *next = t->wait_next;
+        t->wait_next = NULL;
+        thread_wake(t);
+        t = next;
+    }
+}
+
+void wake_up(wait_queue_t *wq)
+{
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    wake_up_locked(wq);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wake_up_set(wait_queue_t *wq, volatile bool *flag)
+{
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    *flag = true;
+    wake_up_locked(wq);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+// Once we hold the lock, the waker has let go of it for good
+void wait_queue_sync(wait_queue_t *wq)
+{
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wait_interrupt(thread_t *t)
+{
+    // Set before taking the lock: a waiter that links in after we looked
+    // sees it when it checks its condition
+    t->interrupted = true;
+    
+    uint64_t flags = spin_lock_irqsave(&waiting_lock);
+    wait_queue_t *wq = t->waiting_on;
+    if (wq) {
+        spin_lock(&wq->lock);
+        wait_unlink(wq, t);
+        thread_wake(t);
+        spin_unlock(&wq->lock);
+    }
+    spin_unlock_irqrestore(&waiting_lock, flags);
+}
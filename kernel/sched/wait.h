@@ -0,0 +1,80 @@
+// kernel/sched/wait.h - Wait queues
+
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdbool.h>
+#include "thread.h"
+#include "../lib/cpu.h"
+#include "../lib/spinlock.h"
+
+// Threads blocked until something happens, woken in the order they came
+typedef struct wait_queue {
+    spinlock_t lock;
+    thread_t *head;
+    thread_t *tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT("wait_queue"), NULL, NULL }
+
+// Queues on the stack or in memory that gets freed keep out of lockstat
+void wait_queue_init(wait_queue_t *wq);
+
+// Put the calling thread on wq, marked as blocked. Called with interrupts
+// disabled. Where there is nothing to switch to (before threads exist, in
+// an idle thread or in deferred work) it halts until the next interrupt
+// instead and returns false.
+bool wait_prepare(wait_queue_t *wq);
+
+// Take the calling thread off wq again (if a wakeup didn't already) and
+// make it running, whether or not it got to sleep in between
+void wait_finish(wait_queue_t *wq);
+
+// Make every thread waiting on wq runnable again. Safe from softirqs, timer
+// callbacks and other CPUs.
+void wake_up(wait_queue_t *wq);
+
+// Set *flag and wake wq's waiters, both under wq's lock. A waiter that saw
+// the flag and then called wait_queue_sync() may free wq.
+void wake_up_set(wait_queue_t *wq, volatile bool *flag);
+void wait_queue_sync(wait_queue_t *wq);
+
+// Interrupt a thread: set its interrupted flag and, if it sleeps on a wait
+// queue, take it off and let it run. Waits that aren't interruptible just
+// go back to sleep.
+void wait_interrupt(thread_t *t);
+
+// Block until cond is true. cond is checked again once the thread is on the
+// queue, so a wake_up() from an interrupt or another CPU can't slip in
+// between the test and sleeping.
+#define wait_event(wq, cond)                        \
+    do {                                            \
+        uint64_t __wait_flags = irq_save();         \
+        while (!(cond)) {                           \
+            if (wait_prepare(wq)) {                 \
+                if (!(cond)) {                      \
+                    thread_block();                 \
+                }                                   \
+                wait_finish(wq);                    \
+            }                                       \
+        }                                           \
+        irq_restore(__wait_flags);                  \
+    } while (0)
+
+// Same, but also stops waiting once the thread is interrupted. The caller
+// tells the two apart with thread_interrupted().
+#define wait_event_interruptible(wq, cond)          \
+    do {                                            \
+        uint64_t __wait_flags = irq_save();         \
+        while (!(cond) && !thread_interrupted()) {  \
+            if (wait_prepare(wq)) {                 \
+                if (!(cond) && !thread_interrupted()) { \
+                    thread_block();                 \
+                }                                   \
+                wait_finish(wq);                    \
+            }                                       \
+        }                                           \
+        irq_restore(__wait_flags);                  \
+    } while (0)
+
+#endif // WAIT_H
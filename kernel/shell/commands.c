@@ -2,11 +2,34 @@
 
 #include "commands.h"
 #include "../drivers/screen.h"
+#include "../drivers/keyboard.h"
 #include "../lib/string.h"
 #include "../lib/io.h"
 #include "../drivers/timer.h"
+#include "../drivers/clocksource.h"
+#include "../drivers/timerwheel.h"
 #include "../memory/pmm.h"
 #include "../memory/heap.h"
+#include "../kexec.h"
+#include "../smp.h"
+#include "../process.h"
+#include "../initcall.h"
+#include "../drivers/ata.h"
+#include "../drivers/pci.h"
+#include "../interrupts/apic.h"
+#include "../interrupts/isr.h"
+#include "../interrupts/irqstat.h"
+#include "../interrupts/softirq.h"
+#include "../interrupts/irqbalance.h"
+#include "../interrupts/irqsoff.h"
+#include "../sched/thread.h"
+#include "../sched/task.h"
+#include "../sched/cputime.h"
+#include "../sched/idle.h"
+#include "jobs.h"
+#include "../lib/cpu.h"
+#include "../lib/atomic.h"
+#include "../lib/spinlock.h"
 
 // Command registry
 static command_t commands[] = {
@@ -19,11 +42,31 @@ static command_t commands[] = {
     {"sleep", "Sleep for N seconds", cmd_sleep},
     {"benchmark", "Run a simple benchmark", cmd_benchmark},
     {"reboot", "Reboot the system", cmd_reboot},
+    {"kexec", "Warm reboot into the kernel on disk", cmd_kexec},
     {"shutdown", "Shutdown the system", cmd_shutdown},
     {"calc", "Simple calculator (add, sub, mul, div)", cmd_calc},
     {"color", "Change text color", cmd_color},
     {"meminfo", "Display memory information", cmd_meminfo},
-    {"memtest", "Test memory allocation", cmd_memtest}
+    {"memtest", "Test memory allocation", cmd_memtest},
+    {"initcalls", "Show boot initcalls and their durations", cmd_initcalls},
+    {"apic", "Show interrupt controller configuration", cmd_apic},
+    {"irqstat", "Interrupt counts and handler cycles", cmd_irqstat},
+    {"softirqs", "Deferred interrupt work counters", cmd_softirqs},
+    {"irqbench", "Compare full and fast IRQ entry cost", cmd_irqbench},
+    {"lspci", "List PCI devices and their drivers", cmd_lspci},
+    {"irqaffinity", "Show or pin interrupt CPU affinity", cmd_irqaffinity},
+    {"irqsoff", "Longest interrupts-disabled sections", cmd_irqsoff},
+    {"timer", "Timer device, tickless idle and software timers", cmd_timer},
+    {"threads", "List kernel threads", cmd_threads},
+    {"cpus", "List processors and whether they are online", cmd_cpus},
+    {"lockstat", "Lock contention statistics (on/off/reset)", cmd_lockstat},
+    {"jobs", "List background jobs (start one with 'cmd &')", cmd_jobs},
+    {"kill", "Stop a background job", cmd_kill},
+    {"run", "Run a built-in user mode program", cmd_run},
+    {"top", "CPU utilization and the busiest threads", cmd_top},
+    {"syscallbench", "Time system calls and clock reads from user mode", cmd_syscallbench},
+    {"sched", "Per-CPU run queues and deadline threads", cmd_sched},
+    {"schedbench", "Run busy processes on every CPU at once", cmd_schedbench}
 };
 
 // Just use the macro, remove the const int
@@ -68,16 +111,54 @@ int commands_parse(char *input, char **argv, int max_args)
     return argc;
 }
 
-// Execute a command
-bool commands_execute(const char *name, int argc, char **argv)
+// Find a command
+const command_t *commands_find(const char *name)
 {
     for (size_t i = 0; i < COMMAND_COUNT; i++) {  // Changed int to size_t
         if (strcmp(name, commands[i].name) == 0) {
-            commands[i].handler(argc, argv);
-            return true;
+            return &commands[i];
         }
     }
-    return false;
+    return NULL;
+}
+
+// Execute a command
+bool commands_execute(const char *name, int argc, char **argv)
+{
+    const command_t *command = commands_find(name);
+    if (command == NULL) {
+        return false;
+    }
+    command->handler(argc, argv);
+    return true;
+}
+
+// Write a string padded with spaces to a column width
+static void write_padded(const char *str, int width)
+{
+    screen_write(str);
+    for (int i = strlen(str); i < width; i++) {
+        screen_write(" ");
+    }
+}
+
+// Write an unsigned number padded to a column width
+static void write_num_padded(uint64_t value, int width)
+{
+    char num_str[32];
+    ultoa(value, num_str, 10);
+    write_padded(num_str, width);
+}
+
+// Write a hex number with leading zeros
+static void write_hex_padded(uint64_t value, int digits)
+{
+    char num_str[32];
+    ultoa(value, num_str, 16);
+    for (int i = strlen(num_str); i < digits; i++) {
+        screen_write("0");
+    }
+    screen_write(num_str);
 }
 
 // ============================================================================
@@ -179,6 +260,42 @@ void cmd_info(int argc, char **argv)
     screen_write("  Architecture: x86_64\n");
     screen_write("  CPU Mode:     Long Mode (64-bit)\n");
     screen_write("  Author:       Your Name\n");
+    
+    const char *disk_model;
+    uint32_t disk_sectors;
+    if (ata_get_info(&disk_model, &disk_sectors)) {
+        char num_str[32];
+        itoa(disk_sectors / 2, num_str, 10);
+        screen_write("  Disk:         ");
+        screen_write(disk_model);
+        screen_write(" (");
+        screen_write(num_str);
+        screen_write(" KB)\n");
+    }
+    
+    uint32_t warm_boots = kexec_get_warm_boots();
+    screen_write("  Boot:         ");
+    if (warm_boots == 0) {
+        screen_write("cold (BIOS)\n");
+    } else {
+        char num_str[32];
+        itoa(warm_boots, num_str, 10);
+        screen_write("warm (kexec #");
+        screen_write(num_str);
+        screen_write(", ");
+        itoa((int)(kexec_get_restart_cycles() / 1000), num_str, 10);
+        screen_write(num_str);
+        screen_write("K cycles)\n");
+    }
+    
+    uint64_t dropped = keyboard_get_dropped();
+    if (dropped) {
+        char num_str[32];
+        ultoa(dropped, num_str, 10);
+        screen_write("  Keys lost:    ");
+        screen_write(num_str);
+        screen_write(" (input buffer full)\n");
+    }
     screen_write("\n");
 }
 
@@ -231,10 +348,56 @@ void cmd_sleep(int argc, char **argv)
     screen_write(sec_str);
     screen_write(" seconds...");
     
-    timer_sleep(seconds);
+    // Ctrl+C: the shell says so
+    if (!timer_sleep_ms_interruptible(seconds * 1000)) {
+        return;
+    }
     
     screen_write_color(" Done!\n", COLOR_LIGHT_GREEN, COLOR_BLACK);
 }
+
+// Write a clocksource delta in the best unit (ns, us or ms)
+static void write_elapsed(uint64_t cycles)
+{
+    uint64_t ns = timer_cycles_to_ns(cycles);
+    char time_str[32];
+    
+    if (ns < 10000) {
+        ultoa(ns, time_str, 10);
+        screen_write_color(time_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+        screen_write(" ns\n");
+    } else if (ns < 10000000) {
+        ultoa(ns / 1000, time_str, 10);
+        screen_write_color(time_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+        screen_write(" us\n");
+    } else {
+        ultoa(ns / 1000000, time_str, 10);
+        screen_write_color(time_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+        screen_write(" ms\n");
+    }
+}
+
+// Buffer the bulk benchmarks work on (1MB)
+#define BENCH_PAGES 256
+
+// Speedup of a parallel run over the serial one, with the CPU count
+static void write_speedup(uint64_t serial, uint64_t parallel)
+{
+    char num_str[32];
+    uint64_t tenths = parallel ? serial * 10 / parallel : 0;
+    
+    screen_write("        speedup ");
+    ultoa(tenths / 10, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+    screen_write(".");
+    ultoa(tenths % 10, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+    screen_write("x on ");
+    itoa(task_worker_count(), num_str, 10);
+    screen_write(num_str);
+    screen_write(" CPUs\n");
+}
+
 // Benchmark command
 void cmd_benchmark(int argc, char **argv)
 {
@@ -245,22 +408,18 @@ void cmd_benchmark(int argc, char **argv)
     
     // Test 1: Simple loop
     screen_write("Test 1: Integer arithmetic... ");
-    uint64_t start = timer_get_uptime_ms();
+    uint64_t start = timer_get_cycles();
     
     volatile int sum = 0;
     for (volatile int i = 0; i < 1000000; i++) {
         sum += i;
     }
     
-    uint64_t elapsed = timer_get_uptime_ms() - start;
-    char time_str[32];
-    itoa((int)elapsed, time_str, 10);
-    screen_write_color(time_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
-    screen_write(" ms\n");
+    write_elapsed(timer_get_cycles() - start);
     
     // Test 2: String operations
     screen_write("Test 2: String operations... ");
-    start = timer_get_uptime_ms();
+    start = timer_get_cycles();
     
     char buffer[256];
     for (int i = 0; i < 1000; i++) {
@@ -268,24 +427,69 @@ void cmd_benchmark(int argc, char **argv)
         strlen(buffer);
     }
     
-    elapsed = timer_get_uptime_ms() - start;
-    itoa((int)elapsed, time_str, 10);
-    screen_write_color(time_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
-    screen_write(" ms\n");
+    write_elapsed(timer_get_cycles() - start);
     
     // Test 3: Memory operations
     screen_write("Test 3: Memory operations... ");
-    start = timer_get_uptime_ms();
+    start = timer_get_cycles();
     
     char large_buffer[1024];
     for (int i = 0; i < 100; i++) {
         memset(large_buffer, 0, sizeof(large_buffer));
     }
     
-    elapsed = timer_get_uptime_ms() - start;
-    itoa((int)elapsed, time_str, 10);
-    screen_write_color(time_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
-    screen_write(" ms\n");
+    write_elapsed(timer_get_cycles() - start);
+    
+    if (thread_interrupted()) {
+        return;
+    }
+    
+    // Tests 4-5: bulk work on one CPU, then split across all of them
+    void *pages = pmm_alloc_pages(BENCH_PAGES);
+    if (pages) {
+        uint64_t size = (uint64_t)BENCH_PAGES * PAGE_SIZE;
+        uint64_t serial, parallel;
+        
+        screen_write("Test 4: Zero 1MB, one CPU... ");
+        start = timer_get_cycles();
+        memset(pages, 0, size);
+        serial = timer_get_cycles() - start;
+        write_elapsed(serial);
+        screen_write("        all CPUs... ");
+        start = timer_get_cycles();
+        parallel_zero_pages(pages, BENCH_PAGES);
+        parallel = timer_get_cycles() - start;
+        write_elapsed(parallel);
+        write_speedup(serial, parallel);
+        
+        if (thread_interrupted()) {
+            pmm_free_pages(pages, BENCH_PAGES);
+            return;
+        }
+        
+        // Different words everywhere, so a chunk summed twice or left out shows
+        uint32_t *words = (uint32_t *)pages;
+        for (uint64_t i = 0; i < size / 4; i++) {
+            words[i] = (uint32_t)(i * 2654435761u);
+        }
+        
+        screen_write("Test 5: Checksum 1MB, one CPU... ");
+        start = timer_get_cycles();
+        uint64_t sum = memsum(pages, size);
+        serial = timer_get_cycles() - start;
+        write_elapsed(serial);
+        screen_write("        all CPUs... ");
+        start = timer_get_cycles();
+        bool match = parallel_checksum(pages, size) == sum;
+        parallel = timer_get_cycles() - start;
+        write_elapsed(parallel);
+        write_speedup(serial, parallel);
+        if (!match) {
+            screen_write_color("        Checksums differ!\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        }
+        
+        pmm_free_pages(pages, BENCH_PAGES);
+    }
     
     screen_write_color("\nBenchmark complete!\n", COLOR_LIGHT_GREEN, COLOR_BLACK);
 }
@@ -335,6 +539,30 @@ void cmd_reboot(int argc, char **argv)
     __asm__ volatile ("cli; hlt");
 }
 
+// Kexec command - restart into the on-disk kernel without BIOS POST
+void cmd_kexec(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    screen_write("Loading kernel image from disk... ");
+    
+    if (!kexec_load()) {
+        screen_write_color("FAILED\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        screen_write("Use 'reboot' for a full restart.\n");
+        return;
+    }
+    
+    screen_write_color("OK\n", COLOR_LIGHT_GREEN, COLOR_BLACK);
+    screen_write_color("Warm restarting...\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    kexec_execute();
+    
+    // Only get here if the image vanished between load and execute
+    screen_write_color("Error: ", COLOR_LIGHT_RED, COLOR_BLACK);
+    screen_write("kexec failed\n");
+}
+
 // Shutdown command
 void cmd_shutdown(int argc, char **argv)
 {
@@ -496,6 +724,40 @@ void cmd_meminfo(int argc, char **argv)
     screen_write("\n");
 }
 
+// Pages the parallel pattern test covers (1MB)
+#define MEMTEST_PAGES 256
+
+typedef struct {
+    uint64_t *base;
+    volatile uint64_t errors;
+} memtest_job_t;
+
+// Write address-derived patterns over some pages and read them back
+static void memtest_pages(uint64_t start, uint64_t end, void *arg)
+{
+    memtest_job_t *job = (memtest_job_t *)arg;
+    uint64_t words = PAGE_SIZE / sizeof(uint64_t);
+    uint64_t *first = job->base + start * words;
+    uint64_t *last = job->base + end * words;
+    uint64_t errors = 0;
+    
+    static const uint64_t patterns[] = { 0, ~0ULL, 0xAAAAAAAAAAAAAAAAULL, 0x5555555555555555ULL };
+    for (unsigned p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        for (volatile uint64_t *w = first; w < last; w++) {
+            *w = patterns[p] ^ (uint64_t)w;
+        }
+        for (volatile uint64_t *w = first; w < last; w++) {
+            if (*w != (patterns[p] ^ (uint64_t)w)) {
+                errors++;
+            }
+        }
+    }
+    
+    if (errors) {
+        atomic_fetch_add_explicit(&job->errors, errors, memory_order_relaxed);
+    }
+}
+
 // Memory test command
 // Memory test command with debugging
 void cmd_memtest(int argc, char **argv)
@@ -607,6 +869,1354 @@ void cmd_memtest(int argc, char **argv)
         screen_write("        All freed successfully\n");
     }
     
+    if (thread_interrupted()) {
+        return;
+    }
+    
+    // Test 4: pattern test over whole pages, split across the CPUs
+    screen_write("Test 4: Pattern test on 1MB of pages... ");
+    void *pages = pmm_alloc_pages(MEMTEST_PAGES);
+    if (pages) {
+        memtest_job_t job = { (uint64_t *)pages, 0 };
+        uint64_t start = timer_get_cycles();
+        parallel_for(0, MEMTEST_PAGES, 1, memtest_pages, &job);
+        uint64_t cycles = timer_get_cycles() - start;
+        pmm_free_pages(pages, MEMTEST_PAGES);
+        
+        if (job.errors == 0) {
+            screen_write_color("OK", COLOR_LIGHT_GREEN, COLOR_BLACK);
+        } else {
+            ultoa(job.errors, num_str, 10);
+            screen_write_color(num_str, COLOR_LIGHT_RED, COLOR_BLACK);
+            screen_write_color(" bad words", COLOR_LIGHT_RED, COLOR_BLACK);
+        }
+        screen_write(" (");
+        itoa(task_worker_count(), num_str, 10);
+        screen_write(num_str);
+        screen_write(" CPUs) ");
+        write_elapsed(cycles);
+    } else {
+        screen_write_color("FAILED - no pages\n", COLOR_LIGHT_RED, COLOR_BLACK);
+    }
+    
     screen_write("\n");
     screen_write_color("Tests completed!\n", COLOR_LIGHT_GREEN, COLOR_BLACK);
-}
\ No newline at end of file
+}
+
+// Initcalls command - boot init order, state and duration
+void cmd_initcalls(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    static const char *level_names[INITCALL_LEVELS] = {
+        "early", "core", "memory", "console", "device", "late"
+    };
+    
+    screen_write_color("\nInitcalls:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("==========\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    int count;
+    initcall_t **calls = initcall_get_all(&count);
+    char num_str[32];
+    
+    for (int i = 0; i < count; i++) {
+        initcall_t *ic = calls[i];
+        const char *level = level_names[ic->level < INITCALL_LEVELS ? ic->level : INITCALL_LATE];
+        
+        screen_write("  ");
+        screen_write(level);
+        for (int j = strlen(level); j < 9; j++) {
+            screen_write(" ");
+        }
+        
+        screen_write_color(ic->name, COLOR_LIGHT_CYAN, COLOR_BLACK);
+        for (int j = strlen(ic->name); j < 24; j++) {
+            screen_write(" ");
+        }
+        
+        switch (ic->state) {
+            case INITCALL_STATE_DONE:
+                itoa((int)(ic->cycles / 1000), num_str, 10);
+                screen_write_color(num_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+                screen_write("K cycles");
+                break;
+            case INITCALL_STATE_RUNNING:
+                screen_write_color("running", COLOR_YELLOW, COLOR_BLACK);
+                break;
+            case INITCALL_STATE_FAILED:
+                screen_write_color("failed", COLOR_LIGHT_RED, COLOR_BLACK);
+                break;
+            default:
+                screen_write("waiting");
+                break;
+        }
+        
+        if (ic->flags & INITCALL_ASYNC) {
+            screen_write(" (async)");
+        }
+        screen_write("\n");
+    }
+    
+    screen_write("\n");
+}
+
+// APIC command - interrupt controller configuration from the MADT
+void cmd_apic(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    screen_write_color("\nInterrupt Controllers:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("======================\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    if (!apic_is_enabled()) {
+        screen_write("  Mode:     legacy 8259 PIC (no usable MADT)\n\n");
+        return;
+    }
+    
+    char num_str[32];
+    
+    screen_write("  Mode:     LAPIC + IOAPIC\n");
+    screen_write("  LAPIC:    0x");
+    ultoa(apic_get_lapic_address(), num_str, 16);
+    screen_write(num_str);
+    screen_write(" (this CPU: APIC ID ");
+    itoa(lapic_get_id(), num_str, 10);
+    screen_write(num_str);
+    screen_write(")\n");
+    
+    int ioapic_count;
+    const ioapic_t *ioapics = apic_get_ioapics(&ioapic_count);
+    for (int i = 0; i < ioapic_count; i++) {
+        screen_write("  IOAPIC ");
+        itoa(ioapics[i].id, num_str, 10);
+        screen_write(num_str);
+        screen_write(": 0x");
+        ultoa(ioapics[i].address, num_str, 16);
+        screen_write(num_str);
+        screen_write(", GSI ");
+        itoa(ioapics[i].gsi_base, num_str, 10);
+        screen_write(num_str);
+        screen_write("-");
+        itoa(ioapics[i].gsi_base + ioapics[i].gsi_count - 1, num_str, 10);
+        screen_write(num_str);
+        screen_write("\n");
+    }
+    
+    int cpu_count;
+    const apic_cpu_t *cpus = apic_get_cpus(&cpu_count);
+    screen_write("  CPUs:     ");
+    for (int i = 0; i < cpu_count; i++) {
+        itoa(cpus[i].apic_id, num_str, 10);
+        screen_write_color(num_str, cpus[i].enabled ? COLOR_LIGHT_GREEN : COLOR_DARK_GREY, COLOR_BLACK);
+        screen_write(" ");
+    }
+    screen_write("\n");
+    
+    screen_write("  ISA IRQs: ");
+    for (int irq = 0; irq < 16; irq++) {
+        uint32_t gsi = ioapic_isa_to_gsi(irq);
+        if (gsi != (uint32_t)irq && gsi != 0xFFFFFFFF) {
+            itoa(irq, num_str, 10);
+            screen_write(num_str);
+            screen_write("->GSI");
+            itoa(gsi, num_str, 10);
+            screen_write(num_str);
+            screen_write(" ");
+        }
+    }
+    screen_write("(others identity mapped)\n\n");
+}
+
+// IRQ statistics command
+void cmd_irqstat(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        irqstat_reset();
+        screen_write("Interrupt statistics reset.\n");
+        return;
+    }
+    
+    screen_write_color("\nInterrupt Statistics (handler cycles):\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  Vec  Source   CPU  Count       Min     Avg     Max     P99\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    char num_str[32];
+    bool any = false;
+    
+    for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+        const irqstat_t *stat = irqstat_get(vector);
+        if (stat == NULL || (stat->count == 0 && stat->fast_count == 0)) {
+            continue;
+        }
+        any = true;
+        
+        screen_write("  ");
+        write_num_padded(vector, 5);
+        
+        if (vector >= IRQ_BASE_VECTOR && vector < IRQ_BASE_VECTOR + 16) {
+            strcpy(num_str, "IRQ");
+            itoa(vector - IRQ_BASE_VECTOR, num_str + 3, 10);
+        } else if (vector == APIC_SPURIOUS_VECTOR) {
+            strcpy(num_str, "spurious");
+        } else {
+            strcpy(num_str, "vector");
+        }
+        write_padded(num_str, 9);
+        write_num_padded(stat->last_cpu, 5);
+        
+        ultoa(stat->count + stat->fast_count, num_str, 10);
+        screen_write_color(num_str, COLOR_LIGHT_CYAN, COLOR_BLACK);
+        for (int i = strlen(num_str); i < 12; i++) {
+            screen_write(" ");
+        }
+        
+        // Fast-path interrupts are counted but not timed
+        if (stat->count == 0) {
+            screen_write("(fast path)\n");
+            continue;
+        }
+        
+        write_num_padded(stat->min_cycles, 8);
+        write_num_padded(stat->total_cycles / stat->count, 8);
+        write_num_padded(stat->max_cycles, 8);
+        write_num_padded(irqstat_p99(stat), 8);
+        screen_write("\n");
+    }
+    
+    if (!any) {
+        screen_write("  (no interrupts recorded)\n");
+    }
+    screen_write("\nCPU took the latest one. Use 'irqstat reset' to clear the counters.\n\n");
+}
+
+// Softirq statistics command
+void cmd_softirqs(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    screen_write_color("\nSoftirqs:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  Type      Raised      Runs        Avg cycles\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    for (int type = 0; type < SOFTIRQ_COUNT; type++) {
+        const softirq_stat_t *stat = softirq_get_stat(type);
+        
+        screen_write("  ");
+        write_padded(softirq_get_name(type), 10);
+        write_num_padded(stat->raised, 12);
+        write_num_padded(stat->runs, 12);
+        write_num_padded(stat->runs ? stat->cycles / stat->runs : 0, 12);
+        screen_write("\n");
+    }
+    screen_write("\n");
+}
+
+// Vectors reserved for irqbench (software interrupts only, never routed)
+#define IRQBENCH_FULL_VECTOR 0xF0
+#define IRQBENCH_FAST_VECTOR 0xF1
+#define IRQBENCH_BATCH 10000
+#define IRQBENCH_ROUNDS 10
+
+static void irqbench_full_handler(registers_t *regs)
+{
+    (void)regs;
+}
+
+static void irqbench_fast_handler(int vector)
+{
+    (void)vector;
+}
+
+// Best per-batch average cycles for an 'int' round trip through a vector
+static uint64_t irqbench_measure(bool fast)
+{
+    uint64_t best = (uint64_t)-1;
+    
+    for (int round = 0; round < IRQBENCH_ROUNDS; round++) {
+        uint64_t start = rdtsc();
+        if (fast) {
+            for (int i = 0; i < IRQBENCH_BATCH; i++) {
+                __asm__ volatile ("int %0" : : "i"(IRQBENCH_FAST_VECTOR) : "memory");
+            }
+        } else {
+            for (int i = 0; i < IRQBENCH_BATCH; i++) {
+                __asm__ volatile ("int %0" : : "i"(IRQBENCH_FULL_VECTOR) : "memory");
+            }
+        }
+        uint64_t avg = (rdtsc() - start) / IRQBENCH_BATCH;
+        if (avg < best) {
+            best = avg;
+        }
+    }
+    return best;
+}
+
+// IRQ entry/exit benchmark command
+void cmd_irqbench(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    // Software 'int' still goes through EOI; with the APIC a stray EOI is
+    // harmless, the PIC would ack a real in-service line instead
+    if (!apic_is_enabled()) {
+        screen_write("irqbench needs the APIC (PIC EOIs would ack real IRQs).\n");
+        return;
+    }
+    
+    irq_install_vector_handler(IRQBENCH_FULL_VECTOR, irqbench_full_handler);
+    irq_install_fast_handler(IRQBENCH_FAST_VECTOR, irqbench_fast_handler);
+    
+    screen_write("Running ");
+    char num_str[32];
+    itoa(IRQBENCH_ROUNDS, num_str, 10);
+    screen_write(num_str);
+    screen_write(" x ");
+    itoa(IRQBENCH_BATCH, num_str, 10);
+    screen_write(num_str);
+    screen_write(" software interrupts per path...\n");
+    
+    uint64_t full = irqbench_measure(false);
+    uint64_t fast = irqbench_measure(true);
+    
+    irq_install_vector_handler(IRQBENCH_FULL_VECTOR, NULL);
+    irq_install_vector_handler(IRQBENCH_FAST_VECTOR, NULL);
+    
+    screen_write_color("\nIRQ round trip (cycles, best batch average):\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write("  Full path (registers_t): ");
+    ultoa(full, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_CYAN, COLOR_BLACK);
+    screen_write("\n  Fast path (vector only): ");
+    ultoa(fast, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_CYAN, COLOR_BLACK);
+    screen_write("\n");
+    
+    if (fast < full) {
+        screen_write("  Saved per interrupt:     ");
+        ultoa(full - fast, num_str, 10);
+        screen_write(num_str);
+        screen_write(" cycles (");
+        itoa((int)((full - fast) * 100 / full), num_str, 10);
+        screen_write(num_str);
+        screen_write("%)\n");
+    }
+    screen_write("\n");
+}
+
+// PCI device list command
+void cmd_lspci(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    int count;
+    pci_device_t *devices = pci_get_devices(&count);
+    
+    screen_write_color("\nPCI Devices", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color(pci_uses_ecam() ? " (ECAM):\n" : " (port I/O):\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  Slot     ID         Class        IRQ      Driver\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    char num_str[32];
+    
+    for (int i = 0; i < count; i++) {
+        pci_device_t *dev = &devices[i];
+        
+        screen_write("  ");
+        write_hex_padded(dev->bus, 2);
+        screen_write(":");
+        write_hex_padded(dev->device, 2);
+        screen_write(".");
+        itoa(dev->function, num_str, 10);
+        screen_write(num_str);
+        screen_write("  ");
+        
+        write_hex_padded(dev->vendor_id, 4);
+        screen_write(":");
+        write_hex_padded(dev->device_id, 4);
+        screen_write("  ");
+        
+        write_padded(pci_class_name(dev->class_code), 13);
+        
+        // Best interrupt mode the function supports
+        if (dev->msix_cap) {
+            strcpy(num_str, "MSI-X/");
+            itoa(dev->msix_count, num_str + 6, 10);
+        } else if (dev->msi_cap) {
+            strcpy(num_str, "MSI");
+        } else if (dev->irq_line != 0 && dev->irq_line != 0xFF) {
+            strcpy(num_str, "INTx ");
+            itoa(dev->irq_line, num_str + 5, 10);
+        } else {
+            strcpy(num_str, "-");
+        }
+        write_padded(num_str, 9);
+        
+        if (dev->driver) {
+            screen_write_color(dev->driver->name, COLOR_LIGHT_GREEN, COLOR_BLACK);
+        } else {
+            screen_write_color("-", COLOR_DARK_GREY, COLOR_BLACK);
+        }
+        screen_write("\n");
+    }
+    
+    if (count == 0) {
+        screen_write("  (no devices found)\n");
+    }
+    screen_write("\n");
+}
+
+// IRQ affinity command
+void cmd_irqaffinity(int argc, char **argv)
+{
+    char num_str[32];
+    
+    if (argc >= 2 && strcmp(argv[1], "balance") == 0) {
+        int moved = irq_balance_run();
+        screen_write("Balancing pass moved ");
+        itoa(moved, num_str, 10);
+        screen_write(num_str);
+        screen_write(moved == 1 ? " vector.\n" : " vectors.\n");
+        return;
+    }
+    
+    if (argc >= 3) {
+        int vector = atoi(argv[1]);
+        const irq_affinity_t *a = irq_get_affinity(vector);
+        if (a == NULL || !a->steerable) {
+            screen_write_color("Error: vector can't be steered\n", COLOR_LIGHT_RED, COLOR_BLACK);
+            return;
+        }
+        
+        if (strcmp(argv[2], "auto") == 0) {
+            irq_clear_affinity(vector);
+            screen_write("Vector handed back to the balancer.\n");
+        } else if (irq_set_affinity(vector, atoi(argv[2]))) {
+            screen_write("Vector pinned.\n");
+        } else {
+            screen_write_color("Error: CPU is not online\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        }
+        return;
+    }
+    
+    if (argc == 2) {
+        screen_write("Usage: irqaffinity [<vector> <cpu|auto> | balance]\n");
+        return;
+    }
+    
+    screen_write_color("\nInterrupt Affinity:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write("  CPUs taking interrupts: ");
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (irq_cpu_is_online(cpu)) {
+            itoa(cpu, num_str, 10);
+            screen_write(num_str);
+            screen_write(" ");
+        }
+    }
+    screen_write("\n\n");
+    screen_write_color("  Vec  Source   CPU  Mode     Load        Moves\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    bool any = false;
+    for (int vector = 0; vector < IDT_ENTRIES; vector++) {
+        const irq_affinity_t *a = irq_get_affinity(vector);
+        if (!a->steerable) {
+            continue;
+        }
+        any = true;
+        
+        screen_write("  ");
+        write_num_padded(vector, 5);
+        
+        if (vector < IRQ_BASE_VECTOR + 16) {
+            strcpy(num_str, "IRQ");
+            itoa(vector - IRQ_BASE_VECTOR, num_str + 3, 10);
+        } else {
+            strcpy(num_str, "MSI");
+        }
+        write_padded(num_str, 9);
+        write_num_padded(a->cpu, 5);
+        
+        if (a->mode == IRQ_AFFINITY_PINNED) {
+            screen_write_color("pinned   ", COLOR_LIGHT_CYAN, COLOR_BLACK);
+        } else if (a->mode == IRQ_AFFINITY_HINT) {
+            strcpy(num_str, "hint ");
+            itoa(a->hint, num_str + 5, 10);
+            write_padded(num_str, 9);
+        } else {
+            write_padded("auto", 9);
+        }
+        
+        write_num_padded(a->load, 12);
+        write_num_padded(a->moves, 6);
+        screen_write("\n");
+    }
+    
+    if (!any) {
+        screen_write("  (no steerable vectors, legacy PIC mode)\n");
+    }
+    screen_write("\nLoad is handler cycles over the last balancing interval.\n");
+    screen_write("Use 'irqaffinity <vector> <cpu|auto>' or 'irqaffinity balance'.\n\n");
+}
+
+// Worst sections shown by the irqsoff command
+#define IRQSOFF_REPORT 10
+
+// irqsoff tracer command
+void cmd_irqsoff(int argc, char **argv)
+{
+    if (argc >= 2) {
+        if (strcmp(argv[1], "reset") == 0) {
+            irqsoff_reset();
+            screen_write("irqsoff tracer reset.\n");
+        } else if (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0) {
+            irqsoff_set_enabled(strcmp(argv[1], "on") == 0);
+            screen_write(irqsoff_is_enabled() ? "irqsoff tracer on.\n" : "irqsoff tracer off.\n");
+        } else {
+            screen_write("Usage: irqsoff [reset|on|off]\n");
+        }
+        return;
+    }
+    
+    irqsoff_site_t worst[IRQSOFF_REPORT];
+    int count = irqsoff_get_worst(worst, IRQSOFF_REPORT);
+    char num_str[32];
+    
+    screen_write_color("\nLongest interrupts-off sections (cycles):\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write("  Tracer ");
+    screen_write(irqsoff_is_enabled() ? "on, " : "off, ");
+    ultoa(irqsoff_get_sections(), num_str, 10);
+    screen_write(num_str);
+    screen_write(" sections measured\n\n");
+    screen_write_color("  Site                    Count       Avg       Max\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    for (int i = 0; i < count; i++) {
+        screen_write("  ");
+        if (worst[i].vector >= 0) {
+            strcpy(num_str, "irq vector ");
+            itoa(worst[i].vector, num_str + 11, 10);
+            write_padded(num_str, 24);
+        } else {
+            write_padded(worst[i].site, 24);
+        }
+        
+        write_num_padded(worst[i].count, 12);
+        write_num_padded(worst[i].total_cycles / worst[i].count, 10);
+        ultoa(worst[i].max_cycles, num_str, 10);
+        screen_write_color(num_str, i == 0 ? COLOR_LIGHT_RED : COLOR_LIGHT_CYAN, COLOR_BLACK);
+        screen_write("\n");
+    }
+    
+    if (count == 0) {
+        screen_write("  (nothing recorded)\n");
+    }
+    screen_write("\n");
+}
+
+// Timer status command
+void cmd_timer(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "tickless") == 0) {
+        timer_set_tickless(strcmp(argv[2], "on") == 0);
+        screen_write(timer_is_tickless() ? "Tickless idle on.\n" : "Tickless idle off.\n");
+        return;
+    }
+    if (argc >= 3 && strcmp(argv[1], "clockevent") == 0) {
+        if (timer_set_clockevent(argv[2])) {
+            screen_write("Tick now on ");
+            screen_write(timer_get_clockevent());
+            screen_write(".\n");
+        } else {
+            screen_write("No such clock event device: ");
+            screen_write(argv[2]);
+            screen_write("\n");
+        }
+        return;
+    }
+    if (argc >= 2) {
+        screen_write("Usage: timer [tickless on|off] [clockevent <name>]\n");
+        return;
+    }
+    
+    char num_str[32];
+    
+    screen_write_color("\nSystem Timer:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write("  Clock event: ");
+    screen_write_color(timer_get_clockevent(), COLOR_LIGHT_CYAN, COLOR_BLACK);
+    const char *devices[8];
+    int device_count = timer_get_clockevents(devices, 8);
+    screen_write(" (available:");
+    for (int i = 0; i < device_count; i++) {
+        screen_write(" ");
+        screen_write(devices[i]);
+    }
+    screen_write(")");
+    screen_write("\n  Clocksource: ");
+    screen_write_color(timer_get_clocksource(), COLOR_LIGHT_CYAN, COLOR_BLACK);
+    screen_write("\n  TSC:         ");
+    uint64_t khz = timer_get_tsc_khz();
+    if (khz) {
+        ultoa(khz / 1000, num_str, 10);
+        screen_write(num_str);
+        screen_write(clocksource_tsc_invariant() ? " MHz, invariant\n" : " MHz\n");
+    } else {
+        screen_write("not calibrated\n");
+    }
+    
+    screen_write("  Tickless:    ");
+    screen_write(timer_is_tickless() ? "on\n" : "off\n");
+    
+    // Wakeups per second show what tickless idle saves against a 1000 Hz tick
+    uint64_t interrupts = timer_get_interrupts();
+    uint64_t seconds = timer_get_uptime_seconds();
+    screen_write("  Interrupts:  ");
+    ultoa(interrupts, num_str, 10);
+    screen_write(num_str);
+    if (seconds > 0) {
+        screen_write(" (");
+        ultoa(interrupts / seconds, num_str, 10);
+        screen_write(num_str);
+        screen_write("/s, periodic tick would be ");
+        itoa(TIMER_FREQUENCY, num_str, 10);
+        screen_write(num_str);
+        screen_write("/s)");
+    }
+    screen_write("\n");
+    
+    timer_wheel_stats_t wheel;
+    timer_wheel_get_stats(&wheel);
+    screen_write_color("\nSoftware Timers:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write("  Pending:     ");
+    itoa(wheel.pending, num_str, 10);
+    screen_write(num_str);
+    screen_write(" (by level:");
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        screen_write(" ");
+        itoa(wheel.per_level[level], num_str, 10);
+        screen_write(num_str);
+    }
+    screen_write(")\n  Next due:    ");
+    uint64_t next = timer_wheel_next_expiry();
+    if (next == TIMER_NO_EXPIRY) {
+        screen_write("-\n");
+    } else {
+        uint64_t now = timer_get_uptime_ms();
+        ultoa(next > now ? next - now : 0, num_str, 10);
+        screen_write("in ");
+        screen_write(num_str);
+        screen_write(" ms\n");
+    }
+    screen_write("  Added:       ");
+    ultoa(wheel.added, num_str, 10);
+    screen_write(num_str);
+    screen_write(", expired ");
+    ultoa(wheel.expired, num_str, 10);
+    screen_write(num_str);
+    screen_write(", cancelled ");
+    ultoa(wheel.cancelled, num_str, 10);
+    screen_write(num_str);
+    screen_write("\n  Coalesced:   ");
+    ultoa(wheel.coalesced, num_str, 10);
+    screen_write(num_str);
+    screen_write(", cascaded ");
+    ultoa(wheel.cascaded, num_str, 10);
+    screen_write(num_str);
+    screen_write("\n\n");
+}
+
+// Kernel threads
+void cmd_threads(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    char num_str[32];
+    const thread_t *self = thread_current();
+    
+    screen_write_color("\nKernel threads:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  ID  Name            State      CPU  Switches  Preempted  Blocked  Migr   CPU ms\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    for (int i = 0; i < THREAD_MAX; i++) {
+        const thread_t *t = thread_get(i);
+        if (t == NULL) {
+            continue;
+        }
+        
+        // A running thread's time since it was switched in isn't added yet
+        uint64_t cycles = t->run_cycles;
+        if (t->state == THREAD_RUNNING) {
+            cycles += timer_get_cycles() - t->switched_in;
+        }
+        
+        screen_write("  ");
+        write_num_padded(t->id, 4);
+        if (t == self) {
+            screen_write_color(t->name, COLOR_LIGHT_GREEN, COLOR_BLACK);
+            for (int j = strlen(t->name); j < 16; j++) {
+                screen_write(" ");
+            }
+        } else {
+            write_padded(t->name, 16);
+        }
+        write_padded(thread_state_name(t->state), 11);
+        write_num_padded(t->cpu, 5);
+        write_num_padded(t->switches, 10);
+        write_num_padded(t->preemptions, 11);
+        write_num_padded(t->blocks, 9);
+        write_num_padded(t->migrations, 7);
+        ultoa(timer_cycles_to_ns(cycles) / 1000000, num_str, 10);
+        screen_write(num_str);
+        screen_write("\n");
+    }
+    
+    int ready = 0;
+    thread_rq_stats_t rq;
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (thread_get_rq_stats(cpu, &rq)) {
+            ready += rq.ready;
+        }
+    }
+    
+    screen_write("\n  Ready: ");
+    itoa(ready, num_str, 10);
+    screen_write(num_str);
+    screen_write(", time slice ");
+    itoa(THREAD_TIMESLICE_MS, num_str, 10);
+    screen_write(num_str);
+    screen_write(" ms\n\n");
+}
+
+// Processors from the MADT and their per-CPU state
+void cmd_cpus(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    char num_str[32];
+    int count;
+    const apic_cpu_t *cpus = apic_get_cpus(&count);
+    
+    screen_write_color("\nProcessors:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  CPU  APIC ID  State     Stack top   Up at ms Tasks    Stolen\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    // Without a MADT only the boot CPU is known
+    if (count == 0) {
+        count = 1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        const percpu_t *cpu = smp_get_cpu(i);
+        const char *state = "offline";
+        if (cpu && cpu->online) {
+            state = "online";
+        } else if (apic_is_enabled() && !cpus[i].enabled) {
+            state = "disabled";
+        }
+        
+        screen_write("  ");
+        write_num_padded(i, 5);
+        write_num_padded(apic_is_enabled() ? cpus[i].apic_id : 0, 9);
+        screen_write_color(state, cpu && cpu->online ? COLOR_LIGHT_GREEN : COLOR_DARK_GREY, COLOR_BLACK);
+        for (int j = strlen(state); j < 10; j++) {
+            screen_write(" ");
+        }
+        if (cpu) {
+            task_stats_t tasks;
+            task_get_stats(i, &tasks);
+            screen_write("0x");
+            ultoa(cpu->stack_top, num_str, 16);
+            write_padded(num_str, 10);
+            write_num_padded(cpu->online_ns / 1000000, 9);
+            write_num_padded(tasks.executed, 9);
+            write_num_padded(tasks.stolen, 9);
+        }
+        if (i == smp_boot_cpu()) {
+            screen_write("(boot)");
+        }
+        screen_write("\n");
+    }
+    
+    screen_write("\n  Online: ");
+    itoa(smp_online_count(), num_str, 10);
+    screen_write(num_str);
+    screen_write(", taking tasks: ");
+    itoa(task_worker_count(), num_str, 10);
+    screen_write(num_str);
+    screen_write(", this is CPU ");
+    itoa(smp_processor_id(), num_str, 10);
+    screen_write(num_str);
+    screen_write("\n\n");
+}
+
+// Lock contention statistics
+void cmd_lockstat(int argc, char **argv)
+{
+    char num_str[32];
+    
+    if (argc >= 2) {
+        if (strcmp(argv[1], "on") == 0) {
+            lockstat_set_enabled(true);
+        } else if (strcmp(argv[1], "off") == 0) {
+            lockstat_set_enabled(false);
+        } else if (strcmp(argv[1], "reset") == 0) {
+            lockstat_reset();
+        } else {
+            screen_write("Usage: lockstat [on|off|reset]\n");
+            return;
+        }
+    }
+    
+    screen_write_color("\nLock statistics", COLOR_YELLOW, COLOR_BLACK);
+    screen_write(lockstat_is_enabled() ? " (collecting, TSC cycles):\n" : " (off, TSC cycles):\n");
+    screen_write_color("  Name      Type   Acquired  Contended Avg wait Max wait Avg hold Max hold\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    for (const lockstat_t *stat = lockstat_first(); stat; stat = stat->next) {
+        screen_write("  ");
+        write_padded(stat->name, 10);
+        write_padded(stat->type, 7);
+        write_num_padded(stat->acquisitions, 10);
+        write_num_padded(stat->contended, 10);
+        write_num_padded(stat->contended ? stat->wait_cycles / stat->contended : 0, 9);
+        write_num_padded(stat->max_wait_cycles, 9);
+        write_num_padded(stat->acquisitions ? stat->hold_cycles / stat->acquisitions : 0, 9);
+        ultoa(stat->max_hold_cycles, num_str, 10);
+        screen_write(num_str);
+        screen_write("\n");
+    }
+    screen_write("\n");
+}
+
+// Jobs command - background jobs started with '&'
+void cmd_jobs(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    int count = 0;
+    
+    screen_write_color("\n  Job  State    Thread  Time s  Output  Command\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    uint64_t now = timer_get_uptime_ms();
+    for (int i = 0; i < JOB_MAX; i++) {
+        const job_t *job = jobs_get(i);
+        if (job == NULL) {
+            continue;
+        }
+        count++;
+        
+        // Read once, the job may finish while we print
+        thread_t *thread = job->thread;
+        bool running = job->state == JOB_RUNNING;
+        uint64_t end = running ? now : job->finished_ms;
+        
+        screen_write("  ");
+        write_num_padded(job->id, 5);
+        if (running) {
+            screen_write_color("running  ", COLOR_LIGHT_GREEN, COLOR_BLACK);
+        } else {
+            write_padded(job->killed ? "killed" : "done", 9);
+        }
+        if (running && thread) {
+            write_num_padded(thread->id, 8);
+        } else {
+            write_padded("-", 8);
+        }
+        write_num_padded((end - job->started_ms) / 1000, 8);
+        write_num_padded(ring_count(&job->output), 8);
+        screen_write(job->line);
+        screen_write("\n");
+    }
+    
+    if (count == 0) {
+        screen_write("  (none)\n");
+    }
+    screen_write("\n  Output is shown before the next prompt, 'kill <job>' stops one.\n\n");
+}
+
+// Kill command - interrupt a background job
+void cmd_kill(int argc, char **argv)
+{
+    if (argc < 2) {
+        screen_write("Usage: kill <job>\n");
+        return;
+    }
+    
+    const char *arg = argv[1];
+    if (arg[0] == '%') {
+        arg++;
+    }
+    
+    int id = atoi(arg);
+    if (!jobs_kill(id)) {
+        screen_write_color("No such job: ", COLOR_LIGHT_RED, COLOR_BLACK);
+        screen_write(argv[1]);
+        screen_write("\n");
+        return;
+    }
+    screen_write("Job ");
+    screen_write(argv[1]);
+    screen_write(" interrupted, it stops at its next check\n");
+}
+
+// Write a signed number
+static void write_signed(int64_t value)
+{
+    char num_str[32];
+    if (value < 0) {
+        screen_write("-");
+        value = -value;
+    }
+    ultoa((uint64_t)value, num_str, 10);
+    screen_write(num_str);
+}
+
+// Run command - start a user program and wait for it to exit
+void cmd_run(int argc, char **argv)
+{
+    if (argc < 2) {
+        int count;
+        const user_program_t *programs = process_get_programs(&count);
+        
+        screen_write("Usage: run <program> [argument]\n\nPrograms:\n");
+        for (int i = 0; i < count; i++) {
+            screen_write("  ");
+            write_padded(programs[i].name, 16);
+            screen_write(programs[i].description);
+            screen_write("\n");
+        }
+        return;
+    }
+    
+    const user_program_t *program = process_find_program(argv[1]);
+    if (program == NULL) {
+        screen_write_color("No such program: ", COLOR_LIGHT_RED, COLOR_BLACK);
+        screen_write(argv[1]);
+        screen_write("\n");
+        return;
+    }
+    
+    process_t *process = process_spawn(program, argc > 2 ? (uint64_t)atoi(argv[2]) : 0);
+    if (process == NULL) {
+        screen_write_color("Can't start it: out of memory or threads\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        return;
+    }
+    
+    int pid = process->pid;
+    int64_t code = process_wait(process);
+    
+    screen_write("Process ");
+    write_signed(pid);
+    screen_write(" exited with ");
+    write_signed(code);
+    screen_write("\n");
+}
+
+#define SYSCALL_BENCH_ITERATIONS 100000
+
+// Run a benchmark program, TSC cycles per call or 0 if it didn't finish
+static uint64_t syscall_bench_run(const char *name, uint64_t iterations)
+{
+    process_t *process = process_spawn(process_find_program(name), iterations);
+    if (process == NULL) {
+        return 0;
+    }
+    
+    int64_t cycles = process_wait(process);
+    return cycles > 0 ? (uint64_t)cycles / iterations : 0;
+}
+
+static void syscall_bench_write(const char *label, uint64_t cycles)
+{
+    char num_str[32];
+    uint64_t khz = timer_get_tsc_khz();
+    
+    screen_write(label);
+    ultoa(cycles, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+    screen_write(" cycles");
+    if (khz) {
+        screen_write(" (");
+        ultoa(cycles * 1000000 / khz, num_str, 10);
+        screen_write(num_str);
+        screen_write(" ns)");
+    }
+    screen_write("\n");
+}
+
+// Syscall benchmark - getpid round trips from ring 3, SYSCALL vs int
+void cmd_syscallbench(int argc, char **argv)
+{
+    uint64_t iterations = SYSCALL_BENCH_ITERATIONS;
+    if (argc > 1) {
+        int n = atoi(argv[1]);
+        if (n <= 0) {
+            screen_write("Usage: syscallbench [iterations]\n");
+            return;
+        }
+        iterations = n;
+    }
+    
+    char num_str[32];
+    screen_write_color("\nSystem call round trip (getpid, ", COLOR_YELLOW, COLOR_BLACK);
+    ultoa(iterations, num_str, 10);
+    screen_write_color(num_str, COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color(" calls):\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    uint64_t fast = syscall_bench_run("bench-syscall", iterations);
+    if (fast == 0) {
+        screen_write_color("  bench-syscall failed\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        return;
+    }
+    syscall_bench_write("  SYSCALL/SYSRET:   ", fast);
+    
+    uint64_t slow = syscall_bench_run("bench-int", iterations);
+    if (slow == 0) {
+        screen_write_color("  bench-int failed\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        return;
+    }
+    syscall_bench_write("  int/iretq:        ", slow);
+    
+    uint64_t tenths = slow * 10 / fast;
+    screen_write("  SYSCALL is ");
+    ultoa(tenths / 10, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+    screen_write(".");
+    ultoa(tenths % 10, num_str, 10);
+    screen_write_color(num_str, COLOR_LIGHT_GREEN, COLOR_BLACK);
+    screen_write("x faster\n");
+    
+    // Reading the clock, which the time page saves a kernel entry for
+    uint64_t vdso = syscall_bench_run("bench-vdso", iterations);
+    uint64_t clock = syscall_bench_run("bench-clock", iterations);
+    if (vdso == 0 || clock == 0) {
+        screen_write_color(vdso == 0 ? "  bench-vdso failed\n" : "  bench-clock failed\n",
+                           COLOR_LIGHT_RED, COLOR_BLACK);
+        return;
+    }
+    
+    screen_write_color("\nClock read:\n", COLOR_YELLOW, COLOR_BLACK);
+    syscall_bench_write("  Time page:        ", vdso);
+    syscall_bench_write("  SYSCALL:          ", clock);
+}
+
+#define TOP_INTERVAL_MS 1000
+#define TOP_THREADS     5
+
+// A thread's CPU time so far, in clocksource cycles
+static uint64_t top_thread_cycles(const thread_t *t)
+{
+    uint64_t cycles = t->run_cycles;
+    if (t->state == THREAD_RUNNING) {
+        cycles += timer_get_cycles() - t->switched_in;
+    }
+    return cycles;
+}
+
+static void top_write_percent(uint64_t part, uint64_t total, int width)
+{
+    char num_str[32];
+    ultoa(total ? part * 100 / total : 0, num_str, 10);
+    strcat(num_str, "%");
+    write_padded(num_str, width);
+}
+
+// Top command - where the CPUs' time went over an interval
+void cmd_top(int argc, char **argv)
+{
+    int interval = TOP_INTERVAL_MS;
+    if (argc > 1) {
+        interval = atoi(argv[1]);
+        if (interval <= 0) {
+            screen_write("Usage: top [interval ms]\n");
+            return;
+        }
+    }
+    
+    cputime_t before[APIC_MAX_CPUS];
+    int thread_ids[THREAD_MAX];
+    uint64_t thread_before[THREAD_MAX];
+    
+    for (int i = 0; i < APIC_MAX_CPUS; i++) {
+        cputime_get(i, &before[i]);
+    }
+    for (int i = 0; i < THREAD_MAX; i++) {
+        const thread_t *t = thread_get(i);
+        thread_ids[i] = t ? t->id : -1;
+        thread_before[i] = t ? top_thread_cycles(t) : 0;
+    }
+    uint64_t start = timer_get_cycles();
+    
+    if (!timer_sleep_ms_interruptible(interval)) {
+        return;
+    }
+    
+    char num_str[32];
+    screen_write_color("\nCPU time over ", COLOR_YELLOW, COLOR_BLACK);
+    itoa(interval, num_str, 10);
+    screen_write_color(num_str, COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color(" ms (idle with ", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color(cpu_idle_mwait() ? "mwait" : "hlt", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("):\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  CPU  User     Kernel   IRQ      Softirq  Idle     Busy\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    uint64_t all[CPUTIME_STATES] = {0};
+    uint64_t all_total = 0;
+    for (int i = 0; i < APIC_MAX_CPUS; i++) {
+        const percpu_t *cpu = smp_get_cpu(i);
+        if ((cpu == NULL || !cpu->online) && i != smp_processor_id()) {
+            continue;
+        }
+        
+        cputime_t after;
+        cputime_get(i, &after);
+        uint64_t delta[CPUTIME_STATES];
+        uint64_t total = 0;
+        for (int state = 0; state < CPUTIME_STATES; state++) {
+            delta[state] = after.cycles[state] - before[i].cycles[state];
+            total += delta[state];
+            all[state] += delta[state];
+        }
+        all_total += total;
+        
+        screen_write("  ");
+        write_num_padded(i, 5);
+        for (int state = 0; state < CPUTIME_STATES; state++) {
+            top_write_percent(delta[state], total, 9);
+        }
+        top_write_percent(total - delta[CPUTIME_IDLE], total, 9);
+        screen_write("\n");
+    }
+    
+    screen_write("  all  ");
+    for (int state = 0; state < CPUTIME_STATES; state++) {
+        top_write_percent(all[state], all_total, 9);
+    }
+    top_write_percent(all_total - all[CPUTIME_IDLE], all_total, 9);
+    screen_write("\n");
+    
+    // Threads that ran the most, as a share of the interval
+    uint64_t elapsed = timer_get_cycles() - start;
+    uint64_t used[THREAD_MAX];
+    for (int i = 0; i < THREAD_MAX; i++) {
+        const thread_t *t = thread_get(i);
+        used[i] = 0;
+        if (t && t->id == thread_ids[i]) {
+            used[i] = top_thread_cycles(t) - thread_before[i];
+        } else if (t) {
+            used[i] = top_thread_cycles(t);   // Started during the interval
+        }
+    }
+    
+    screen_write_color("\nBusiest threads:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  ID  Name            CPU\n", COLOR_YELLOW, COLOR_BLACK);
+    for (int n = 0; n < TOP_THREADS; n++) {
+        int best = -1;
+        for (int i = 0; i < THREAD_MAX; i++) {
+            if (used[i] && (best < 0 || used[i] > used[best])) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        
+        const thread_t *t = thread_get(best);
+        screen_write("  ");
+        write_num_padded(t->id, 4);
+        write_padded(t->name, 16);
+        top_write_percent(used[best], elapsed, 9);
+        screen_write("\n");
+        used[best] = 0;
+    }
+    screen_write("\n");
+}
+
+// Sched command - every CPU's run queue and how threads moved between them
+void cmd_sched(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    
+    char num_str[32];
+    thread_rq_stats_t rq;
+    
+    screen_write_color("\nRun queues:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  CPU  Running         Ready  Switches   Wakeups    Remote    Pulled  Balance  Idle pulls\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (!thread_get_rq_stats(cpu, &rq)) {
+            continue;
+        }
+        
+        screen_write("  ");
+        write_num_padded(cpu, 5);
+        write_padded(rq.current ? rq.current->name : "-", 16);
+        write_num_padded(rq.ready, 7);
+        write_num_padded(rq.switches, 10);
+        write_num_padded(rq.wakeups, 10);
+        write_num_padded(rq.remote_wakeups, 10);
+        write_num_padded(rq.migrations, 10);
+        write_num_padded(rq.balance_runs, 9);
+        ultoa(rq.idle_pulls, num_str, 10);
+        screen_write(num_str);
+        if (!rq.online) {
+            screen_write_color("  (no tick, tasks only)", COLOR_DARK_GREY, COLOR_BLACK);
+        }
+        screen_write("\n");
+    }
+    
+    screen_write_color("\nDeadline threads (earliest deadline first, before round robin):\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write_color("  ID  Name            CPU  Runtime us  Deadline us  Period us  Misses  Throttled\n", COLOR_YELLOW, COLOR_BLACK);
+    
+    int deadline_threads = 0;
+    for (int i = 0; i < THREAD_MAX; i++) {
+        const thread_t *t = thread_get(i);
+        if (t == NULL || t->dl_runtime_us == 0) {
+            continue;
+        }
+        
+        screen_write("  ");
+        write_num_padded(t->id, 4);
+        write_padded(t->name, 16);
+        write_num_padded(t->cpu, 5);
+        write_num_padded(t->dl_runtime_us, 12);
+        write_num_padded(t->dl_deadline_us, 13);
+        write_num_padded(t->dl_period_us, 11);
+        write_num_padded(t->dl_misses, 8);
+        ultoa(t->dl_throttles, num_str, 10);
+        screen_write(num_str);
+        screen_write("\n");
+        deadline_threads++;
+    }
+    if (deadline_threads == 0) {
+        screen_write("  (none)\n");
+    }
+    
+    // Reservations are per CPU, a deadline thread doesn't move
+    screen_write("\n  Reserved:");
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (!thread_get_rq_stats(cpu, &rq) || (rq.dl_reserved == 0 && rq.dl_rejected == 0)) {
+            continue;
+        }
+        screen_write(" CPU ");
+        itoa(cpu, num_str, 10);
+        screen_write(num_str);
+        screen_write(" ");
+        itoa(rq.dl_reserved, num_str, 10);
+        screen_write(num_str);
+        screen_write("% (");
+        ultoa(rq.dl_misses, num_str, 10);
+        screen_write(num_str);
+        screen_write(" missed, ");
+        ultoa(rq.dl_rejected, num_str, 10);
+        screen_write(num_str);
+        screen_write(" rejected)");
+    }
+    screen_write(", limit ");
+    itoa(THREAD_DL_MAX_PERCENT, num_str, 10);
+    screen_write(num_str);
+    screen_write("% per CPU\n");
+    
+    screen_write("\n  Time slice ");
+    itoa(THREAD_TIMESLICE_MS, num_str, 10);
+    screen_write(num_str);
+    screen_write(" ms, balancing every ");
+    itoa(THREAD_BALANCE_MS, num_str, 10);
+    screen_write(num_str);
+    screen_write(" ms\n\n");
+}
+
+#define SCHEDBENCH_MAX_PROCESSES 16
+#define SCHEDBENCH_SPIN_MILLIONS 100
+
+// Start count spin processes at once and wait for all of them, clocksource
+// cycles taken or 0 if they couldn't all run
+static uint64_t schedbench_run(int count, uint64_t millions)
+{
+    const user_program_t *program = process_find_program("spin");
+    process_t *processes[SCHEDBENCH_MAX_PROCESSES];
+    
+    uint64_t start = timer_get_cycles();
+    int started = 0;
+    while (started < count) {
+        processes[started] = process_spawn(program, millions);
+        if (processes[started] == NULL) {
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        process_wait(processes[i]);
+    }
+    
+    if (started < count || thread_interrupted()) {
+        return 0;
+    }
+    return timer_get_cycles() - start;
+}
+
+// Processes moved so far, across all run queues
+static uint64_t schedbench_migrations(void)
+{
+    uint64_t migrations = 0;
+    thread_rq_stats_t rq;
+    for (int cpu = 0; cpu < APIC_MAX_CPUS; cpu++) {
+        if (thread_get_rq_stats(cpu, &rq)) {
+            migrations += rq.migrations;
+        }
+    }
+    return migrations;
+}
+
+// Schedbench command - the same CPU-bound process alone, then one per CPU
+// (or as many as asked for) at once
+void cmd_schedbench(int argc, char **argv)
+{
+    char num_str[32];
+    int count;
+    if (argc > 1) {
+        count = atoi(argv[1]);
+    } else {
+        // One per CPU: the task workers are the BSP plus every AP that came up
+        count = task_worker_count();
+        if (count < 1) {
+            count = 1;
+        } else if (count > SCHEDBENCH_MAX_PROCESSES) {
+            count = SCHEDBENCH_MAX_PROCESSES;
+        }
+    }
+    if (count < 1 || count > SCHEDBENCH_MAX_PROCESSES) {
+        screen_write("Usage: schedbench [processes, 1-");
+        itoa(SCHEDBENCH_MAX_PROCESSES, num_str, 10);
+        screen_write(num_str);
+        screen_write("]\n");
+        return;
+    }
+    
+    screen_write_color("\nScheduler benchmark:\n", COLOR_YELLOW, COLOR_BLACK);
+    screen_write("  1 process...  ");
+    uint64_t one = schedbench_run(1, SCHEDBENCH_SPIN_MILLIONS);
+    if (one == 0) {
+        screen_write_color("failed\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        return;
+    }
+    write_elapsed(one);
+    
+    uint64_t migrations = schedbench_migrations();
+    screen_write("  ");
+    itoa(count, num_str, 10);
+    screen_write(num_str);
+    screen_write(" at once... ");
+    uint64_t all = schedbench_run(count, SCHEDBENCH_SPIN_MILLIONS);
+    if (all == 0) {
+        screen_write_color("failed\n", COLOR_LIGHT_RED, COLOR_BLACK);
+        return;
+    }
+    write_elapsed(all);
+    
+    // Doing the same work one after the other would take count times as long
+    write_speedup(one * count, all);
+    screen_write("        ");
+    ultoa(schedbench_migrations() - migrations, num_str, 10);
+    screen_write(num_str);
+    screen_write(" migrations\n\n");
+}
@@ -18,6 +18,9 @@ typedef struct {
 // Initialize commands system
 void commands_init(void);
 
+// Look a command up by name, NULL if there is none
+const command_t *commands_find(const char *name);
+
 // Execute a command by name
 bool commands_execute(const char *name, int argc, char **argv);
 
@@ -38,10 +41,30 @@ void cmd_date(int argc, char **argv);
 void cmd_sleep(int argc, char **argv);
 void cmd_benchmark(int argc, char **argv);
 void cmd_reboot(int argc, char **argv);
+void cmd_kexec(int argc, char **argv);
 void cmd_shutdown(int argc, char **argv);
 void cmd_calc(int argc, char **argv);
 void cmd_color(int argc, char **argv);
 void cmd_meminfo(int argc, char **argv);
 void cmd_memtest(int argc, char **argv); 
+void cmd_initcalls(int argc, char **argv);
+void cmd_apic(int argc, char **argv);
+void cmd_irqstat(int argc, char **argv);
+void cmd_softirqs(int argc, char **argv);
+void cmd_irqbench(int argc, char **argv);
+void cmd_lspci(int argc, char **argv);
+void cmd_irqaffinity(int argc, char **argv);
+void cmd_irqsoff(int argc, char **argv);
+void cmd_timer(int argc, char **argv);
+void cmd_threads(int argc, char **argv);
+void cmd_cpus(int argc, char **argv);
+void cmd_lockstat(int argc, char **argv);
+void cmd_jobs(int argc, char **argv);
+void cmd_kill(int argc, char **argv);
+void cmd_run(int argc, char **argv);
+void cmd_syscallbench(int argc, char **argv);
+void cmd_top(int argc, char **argv);
+void cmd_sched(int argc, char **argv);
+void cmd_schedbench(int argc, char **argv);
 
 #endif // COMMANDS_H
\ No newline at end of file
@@ -0,0 +1,349 @@
+// kernel/shell/jobs.c - Background jobs and Ctrl+C for shell commands
+//
+// "cmd &" runs the command on a thread of its own. Its screen output goes
+// into the job's ring instead (thread_t.console) and the shell prints it,
+// a whole line at a time and prefixed with the job number, before the next
+// prompt, or above the line being typed: while there are jobs a wheel timer
+// pokes the shell's wait for a key every JOBS_POLL_MS if they wrote
+// something. A job never writes across the input. Stopping a command is cooperative:
+// Ctrl+C or kill sets the thread's interrupted flag and pulls it out of an
+// interruptible sleep, and long commands check thread_interrupted()
+// between steps. Tearing a thread down at an arbitrary point could leave
+// the heap or the screen locked.
+
+#include "jobs.h"
+#include "commands.h"
+#include "../drivers/screen.h"
+#include "../drivers/keyboard.h"
+#include "../drivers/timer.h"
+#include "../drivers/timerwheel.h"
+#include "../sched/wait.h"
+#include "../lib/string.h"
+#include "../lib/cpu.h"
+#include "../lib/atomic.h"
+
+static job_t jobs[JOB_MAX];
+
+// The shell thread while it runs a foreground command
+static thread_t *volatile foreground = NULL;
+
+// The output poll timer is pending
+static volatile bool poll_armed = false;
+
+static void jobs_poll_arm(void);
+
+// Something for the shell to look at (called from the timer softirq, so
+// only the job's state and the producer's view of its ring)
+static bool jobs_have_output(void)
+{
+    for (int i = 0; i < JOB_MAX; i++) {
+        job_t *job = &jobs[i];
+        if (job->state == JOB_DONE ||
+            (job->state == JOB_RUNNING && !ring_empty(&job->output))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool jobs_active(void)
+{
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Wheel timer, runs while there are jobs. The armed flag is dropped before
+// looking at the jobs, so a job started meanwhile either sees it clear and
+// arms the timer itself, or is seen here.
+static void jobs_poll(void *arg)
+{
+    (void)arg;
+    if (jobs_have_output()) {
+        keyboard_poke();
+    }
+    
+    atomic_store(&poll_armed, false);
+    if (jobs_active()) {
+        jobs_poll_arm();
+    }
+}
+
+static void jobs_poll_arm(void)
+{
+    if (!atomic_exchange(&poll_armed, true)) {
+        timer_add(timer_get_uptime_ms() + JOBS_POLL_MS, jobs_poll, NULL);
+    }
+}
+
+// Ctrl+C, from the keyboard tasklet
+static void jobs_break(void)
+{
+    thread_t *t = foreground;
+    if (t) {
+        wait_interrupt(t);
+    }
+}
+
+void jobs_init(void)
+{
+    keyboard_set_break_handler(jobs_break);
+}
+
+static void job_run(void *arg)
+{
+    job_t *job = arg;
+    thread_t *self = thread_current();
+    self->console = &job->output;
+    
+    commands_execute(job->argv[0], job->argc, job->argv);
+    
+    // The shell may hand the slot out again as soon as it sees JOB_DONE
+    uint64_t flags = irq_save();
+    self->console = NULL;
+    job->killed = self->interrupted;
+    job->finished_ms = timer_get_uptime_ms();
+    job->thread = NULL;
+    job->state = JOB_DONE;
+    irq_restore(flags);
+}
+
+// Keep a private copy of the arguments, the shell reuses its buffer
+static void job_copy_args(job_t *job, int argc, char **argv)
+{
+    char *args = job->args;
+    size_t left = sizeof(job->args);
+    
+    job->argc = 0;
+    job->line[0] = '\0';
+    for (int i = 0; i < argc && i < JOB_ARGS_MAX; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        if (len > left) {
+            break;
+        }
+        memcpy(args, argv[i], len);
+        job->argv[job->argc++] = args;
+        args += len;
+        left -= len;
+        
+        if (i > 0) {
+            strcat(job->line, " ");
+        }
+        strcat(job->line, argv[i]);
+    }
+}
+
+const job_t *jobs_start(int argc, char **argv)
+{
+    job_t *job = NULL;
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state == JOB_FREE) {
+            job = &jobs[i];
+            job->id = i + 1;
+            break;
+        }
+    }
+    if (job == NULL || argc == 0) {
+        return NULL;
+    }
+    
+    job_copy_args(job, argc, argv);
+    ring_init(&job->output, job->output_buffer, JOB_OUTPUT_SIZE, 1);
+    job->partial_len = 0;
+    job->dropped_reported = 0;
+    job->killed = false;
+    job->started_ms = timer_get_uptime_ms();
+    job->state = JOB_RUNNING;
+    
+    // The new thread can't run (and finish) before we know it
+    uint64_t flags = irq_save();
+    job->thread = thread_create(job->argv[0], job_run, job);
+    if (job->thread == NULL) {
+        job->state = JOB_FREE;
+        job = NULL;
+    }
+    irq_restore(flags);
+    
+    if (job) {
+        jobs_poll_arm();
+    }
+    return job;
+}
+
+void jobs_foreground_begin(void)
+{
+    thread_t *self = thread_current();
+    if (self) {
+        self->interrupted = false;
+    }
+    foreground = self;
+}
+
+bool jobs_foreground_end(void)
+{
+    foreground = NULL;
+    
+    thread_t *self = thread_current();
+    if (self == NULL) {
+        return false;
+    }
+    bool interrupted = self->interrupted;
+    self->interrupted = false;
+    return interrupted;
+}
+
+bool jobs_kill(int id)
+{
+    if (id < 1 || id > JOB_MAX) {
+        return false;
+    }
+    
+    uint64_t flags = irq_save();
+    job_t *job = &jobs[id - 1];
+    bool running = job->state == JOB_RUNNING && job->thread;
+    if (running) {
+        wait_interrupt(job->thread);
+    }
+    irq_restore(flags);
+    return running;
+}
+
+static void job_write_prefix(const job_t *job)
+{
+    char num_str[16];
+    itoa(job->id, num_str, 10);
+    screen_write_color("[", COLOR_DARK_GREY, COLOR_BLACK);
+    screen_write_color(num_str, COLOR_DARK_GREY, COLOR_BLACK);
+    screen_write_color("] ", COLOR_DARK_GREY, COLOR_BLACK);
+}
+
+// Move what the job wrote since the last look behind its partial line
+static void job_collect(job_t *job)
+{
+    job->partial_len += ring_pop_batch(&job->output, job->partial + job->partial_len,
+                                       JOB_LINE_MAX - job->partial_len);
+}
+
+// Length of the first complete line (without its newline), -1 if there is none
+static int job_line_length(const job_t *job)
+{
+    for (uint32_t i = 0; i < job->partial_len; i++) {
+        if (job->partial[i] == '\n') {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Print the complete lines taken so far. A line longer than JOB_LINE_MAX
+// goes out in pieces, and with last set so does what's left of the final one.
+static void job_print_lines(job_t *job, bool last)
+{
+    for (;;) {
+        int len = job_line_length(job);
+        uint32_t used = len + 1;
+        if (len < 0) {
+            if (job->partial_len == 0 || (job->partial_len < JOB_LINE_MAX && !last)) {
+                return;
+            }
+            len = job->partial_len;
+            used = len;
+        }
+        
+        job_write_prefix(job);
+        for (int i = 0; i < len; i++) {
+            screen_putchar(job->partial[i]);
+        }
+        screen_putchar('\n');
+        
+        job->partial_len -= used;
+        memmove(job->partial, job->partial + used, job->partial_len);
+    }
+}
+
+bool jobs_output_pending(void)
+{
+    for (int i = 0; i < JOB_MAX; i++) {
+        job_t *job = &jobs[i];
+        if (job->state == JOB_FREE) {
+            continue;
+        }
+        if (job->state == JOB_DONE || job->output.dropped != job->dropped_reported) {
+            return true;
+        }
+        
+        job_collect(job);
+        if (job->partial_len == JOB_LINE_MAX || job_line_length(job) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void jobs_flush(void)
+{
+    char num_str[32];
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        job_t *job = &jobs[i];
+        if (job->state == JOB_FREE) {
+            continue;
+        }
+        
+        // Read the state first: whatever it wrote before finishing is in the ring then
+        bool done = job->state == JOB_DONE;
+        
+        // Each round frees room in the partial line or empties the ring
+        do {
+            job_collect(job);
+            job_print_lines(job, false);
+        } while (!ring_empty(&job->output));
+        
+        uint64_t dropped = job->output.dropped;
+        if (dropped != job->dropped_reported) {
+            job_write_prefix(job);
+            ultoa(dropped - job->dropped_reported, num_str, 10);
+            screen_write_color("(", COLOR_LIGHT_RED, COLOR_BLACK);
+            screen_write_color(num_str, COLOR_LIGHT_RED, COLOR_BLACK);
+            screen_write_color(" characters of output lost)\n", COLOR_LIGHT_RED, COLOR_BLACK);
+            job->dropped_reported = dropped;
+        }
+        
+        if (!done) {
+            continue;
+        }
+        job_print_lines(job, true);
+        
+        job_write_prefix(job);
+        if (job->killed) {
+            screen_write_color("Killed  ", COLOR_LIGHT_RED, COLOR_BLACK);
+        } else {
+            screen_write_color("Done    ", COLOR_LIGHT_GREEN, COLOR_BLACK);
+        }
+        screen_write(job->line);
+        screen_write(" (");
+        ultoa(job->finished_ms - job->started_ms, num_str, 10);
+        screen_write(num_str);
+        screen_write(" ms");
+        if (dropped) {
+            screen_write(", ");
+            ultoa(dropped, num_str, 10);
+            screen_write(num_str);
+            screen_write(" characters of output lost");
+        }
+        screen_write(")\n");
+        
+        job->state = JOB_FREE;
+    }
+}
+
+const job_t *jobs_get(int index)
+{
+    if (index < 0 || index >= JOB_MAX || jobs[index].state == JOB_FREE) {
+        return NULL;
+    }
+    return &jobs[index];
+}
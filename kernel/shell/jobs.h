@@ -0,0 +1,70 @@
+// kernel/shell/jobs.h - Background jobs and Ctrl+C for shell commands
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "shell.h"
+#include "../sched/thread.h"
+#include "../lib/ring.h"
+
+#define JOB_MAX          8
+#define JOB_ARGS_MAX     32
+#define JOB_OUTPUT_SIZE  4096   // Screen output the shell hasn't taken yet (power of two)
+#define JOB_LINE_MAX     256    // Longest line held back until its newline comes
+#define JOBS_POLL_MS     100    // How often the shell looks at job output while waiting for a key
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_RUNNING,
+    JOB_DONE,                   // Finished, not reported yet
+} job_state_t;
+
+typedef struct {
+    int id;                     // Shown as [id], 1-based
+    job_state_t state;
+    bool killed;
+    thread_t *thread;           // Only while running
+    uint64_t started_ms;
+    uint64_t finished_ms;
+    char line[SHELL_INPUT_MAX];
+    char args[SHELL_INPUT_MAX]; // argv points in here
+    char *argv[JOB_ARGS_MAX];
+    int argc;
+    
+    ring_t output;
+    char output_buffer[JOB_OUTPUT_SIZE];
+    char partial[JOB_LINE_MAX]; // Taken from output, printed once the line is complete
+    uint32_t partial_len;
+    uint64_t dropped_reported;  // Part of output.dropped already reported
+} job_t;
+
+// Take Ctrl+C from the keyboard
+void jobs_init(void);
+
+// Run a command on its own thread (the arguments are copied). NULL if
+// there is no free job slot or thread.
+const job_t *jobs_start(int argc, char **argv);
+
+// Foreground commands run on the shell thread, these bracket one so Ctrl+C
+// interrupts it. jobs_foreground_end() returns true if it was interrupted.
+void jobs_foreground_begin(void);
+bool jobs_foreground_end(void);
+
+// Interrupt a background job. False if there is no such running job.
+bool jobs_kill(int id);
+
+// Whether jobs_flush() has whole lines, lost output or a finished job to
+// report (the line editor makes room for them)
+bool jobs_output_pending(void);
+
+// Print what background jobs wrote and report finished ones (before the
+// prompt, or above the line being typed). Lines are only printed once
+// complete, so they never show up in pieces.
+void jobs_flush(void);
+
+// Job table, for listing
+const job_t *jobs_get(int index);
+
+#endif // JOBS_H
@@ -2,8 +2,10 @@
 
 #include "shell.h"
 #include "commands.h"
+#include "jobs.h"
 #include "../drivers/screen.h"
 #include "../drivers/keyboard.h"
+#include "../sched/thread.h"
 #include "../lib/string.h"
 #include "../drivers/screen.h"
 
@@ -15,6 +17,13 @@ static char history[SHELL_HISTORY_SIZE][SHELL_INPUT_MAX];
 static int history_count = 0;  // Total number of commands stored
 static int history_write_pos = 0;  // Where to write next command
 
+// Background output that came in while typing, then the prompt again
+static void shell_print_jobs(void)
+{
+    jobs_flush();
+    shell_print_prompt();
+}
+
 // Initialize shell
 void shell_init(void)
 {
@@ -26,6 +35,8 @@ void shell_init(void)
     history_write_pos = 0;
     
     commands_init();
+    jobs_init();
+    keyboard_set_output_handler(jobs_output_pending, shell_print_jobs);
     
     // Print welcome banner
     screen_write_color("================================\n", COLOR_LIGHT_CYAN, COLOR_BLACK);
@@ -35,6 +46,7 @@ void shell_init(void)
     
     screen_write("Type 'help' for a list of commands.\n");
     screen_write("Use UP/DOWN arrows to navigate command history.\n");
+    screen_write("End a command with '&' to run it in the background, Ctrl+C stops it.\n");
     screen_write("\n");
 }
 
@@ -71,6 +83,33 @@ void shell_print_prompt(void)
     screen_write_color(SHELL_PROMPT, SHELL_COLOR_PROMPT, COLOR_BLACK);
 }
 
+// Remove a trailing '&' (and the spaces around it), true if there was one
+static bool shell_strip_background(char *line)
+{
+    int len = strlen(line);
+    while (len > 0 && line[len - 1] == ' ') {
+        len--;
+    }
+    if (len == 0 || line[len - 1] != '&') {
+        return false;
+    }
+    
+    len--;
+    while (len > 0 && line[len - 1] == ' ') {
+        len--;
+    }
+    line[len] = '\0';
+    return true;
+}
+
+static void shell_unknown_command(const char *name)
+{
+    screen_write_color("Unknown command: ", SHELL_COLOR_ERROR, COLOR_BLACK);
+    screen_write(name);
+    screen_write("\n");
+    screen_write("Type 'help' for a list of commands.\n");
+}
+
 // Execute a command
 void shell_execute(const char *input)
 {
@@ -86,6 +125,7 @@ void shell_execute(const char *input)
     char input_copy[SHELL_INPUT_MAX];
     strncpy(input_copy, input, SHELL_INPUT_MAX - 1);
     input_copy[SHELL_INPUT_MAX - 1] = '\0';
+    bool background = shell_strip_background(input_copy);
     
     char *argv[32];
     int argc = commands_parse(input_copy, argv, 32);
@@ -121,18 +161,47 @@ void shell_execute(const char *input)
         return;
     }
     
-    // Execute command
-    if (!commands_execute(argv[0], argc, argv)) {
-        screen_write_color("Unknown command: ", SHELL_COLOR_ERROR, COLOR_BLACK);
-        screen_write(argv[0]);
+    if (background) {
+        if (commands_find(argv[0]) == NULL) {
+            shell_unknown_command(argv[0]);
+            return;
+        }
+        
+        const job_t *job = jobs_start(argc, argv);
+        if (job == NULL) {
+            screen_write_color("Can't start job: ", SHELL_COLOR_ERROR, COLOR_BLACK);
+            screen_write("too many jobs running\n");
+            return;
+        }
+        
+        char num_str[16];
+        itoa(job->id, num_str, 10);
+        screen_write_color("[", SHELL_COLOR_INFO, COLOR_BLACK);
+        screen_write_color(num_str, SHELL_COLOR_INFO, COLOR_BLACK);
+        screen_write_color("] ", SHELL_COLOR_INFO, COLOR_BLACK);
+        screen_write(job->line);
         screen_write("\n");
-        screen_write("Type 'help' for a list of commands.\n");
+        return;
+    }
+    
+    // Execute command, Ctrl+C interrupts it
+    jobs_foreground_begin();
+    bool found = commands_execute(argv[0], argc, argv);
+    if (jobs_foreground_end()) {
+        screen_write_color("^C\n", SHELL_COLOR_ERROR, COLOR_BLACK);
+    }
+    
+    if (!found) {
+        shell_unknown_command(argv[0]);
     }
 }
 
 // Main shell loop
 void shell_run(void)
 {
+    // A long command just uses up the budget and carries on round robin
+    thread_set_deadline(SHELL_DL_RUNTIME_US, SHELL_DL_DEADLINE_US, SHELL_DL_PERIOD_US);
+    
     while (1) {
         // Check if we're scrolled up
         if (!screen_is_at_bottom()) {
@@ -141,6 +210,9 @@ void shell_run(void)
             vga[79] = '^' | 0x0E00;  // Yellow up arrow in corner
         }
         
+        // Background output and finished jobs; while typing, readline makes room for them
+        jobs_flush();
+        
         shell_print_prompt();
         keyboard_readline_history(input_buffer, SHELL_INPUT_MAX,
                                   history, SHELL_HISTORY_SIZE, history_count, &history_write_pos);
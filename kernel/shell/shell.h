@@ -8,6 +8,12 @@
 #define SHELL_INPUT_MAX 256
 #define SHELL_HISTORY_SIZE 20  // Store last 20 commands
 
+// Deadline reservation of the shell thread, so echo, the prompt and job
+// output keep up while benchmarks load its CPU (10% of it, within 10 ms)
+#define SHELL_DL_RUNTIME_US  2000
+#define SHELL_DL_DEADLINE_US 10000
+#define SHELL_DL_PERIOD_US   20000
+
 // Shell colors
 #define SHELL_COLOR_PROMPT COLOR_LIGHT_CYAN
 #define SHELL_COLOR_INPUT COLOR_WHITE
@@ -0,0 +1,84 @@
+; kernel/smp.asm - Startup code for the application processors
+
+[bits 16]
+
+%define SMP_TRAMPOLINE_ADDR 0x8000
+
+; Address of a label once the trampoline is copied to SMP_TRAMPOLINE_ADDR
+%define TRAMP(label) (SMP_TRAMPOLINE_ADDR + (label) - smp_trampoline)
+
+global smp_trampoline
+global smp_trampoline_data
+global smp_trampoline_end
+
+; Copied to SMP_TRAMPOLINE_ADDR, where the startup IPI starts each AP in real
+; mode (CS:IP = 0800:0000). Takes the same steps as boot32.asm into long mode
+; with the GDT, CR4, page tables and EFER the BSP put in smp_trampoline_data.
+smp_trampoline:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+
+    o32 lgdt [TRAMP(tramp_gdtr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:TRAMP(tramp32)
+
+[bits 32]
+tramp32:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    mov eax, [TRAMP(tramp_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMP(tramp_cr3)]
+    mov cr3, eax
+
+    ; Long mode enable (and whatever else the BSP has on in EFER)
+    mov ecx, 0xC0000080
+    mov eax, [TRAMP(tramp_efer)]
+    mov edx, [TRAMP(tramp_efer) + 4]
+    wrmsr
+
+    mov eax, cr0
+    or eax, 1 << 31
+    mov cr0, eax
+    jmp 0x18:TRAMP(tramp64)
+
+[bits 64]
+tramp64:
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Own stack, then smp_ap_main(percpu) which never returns
+    mov rsp, [TRAMP(tramp_stack)]
+    xor rbp, rbp
+    mov rdi, [TRAMP(tramp_arg)]
+    mov rax, [TRAMP(tramp_entry)]
+    call rax
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; Filled in by smp.c (smp_trampoline_data_t) before each startup IPI
+align 8
+smp_trampoline_data:
+tramp_gdtr:  dw 0
+             dd 0
+             dw 0
+tramp_cr3:   dq 0
+tramp_cr4:   dq 0
+tramp_efer:  dq 0
+tramp_stack: dq 0
+tramp_entry: dq 0
+tramp_arg:   dq 0
+smp_trampoline_end:
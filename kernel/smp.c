@@ -0,0 +1,297 @@
+// kernel/smp.c - Application processor bring-up and per-CPU data
+//
+// The BSP copies the startup code (smp.asm) below 1MB and wakes each AP
+// listed in the MADT with INIT, then two startup IPIs pointing at it. The AP
+// comes up in real mode and walks into long mode with the BSP's GDT, CR4,
+// page tables and EFER, then jumps to smp_ap_main() on its own stack. Every
+// CPU ends up with its own GDT and TSS, and GS_BASE pointing at its percpu_t.
+// APs then take threads from their own run queue (sched/thread.c) and run
+// tasks (sched/task.c) when there are none.
+
+#include "smp.h"
+#include "initcall.h"
+#include "drivers/timer.h"
+#include "interrupts/idt.h"
+#include "interrupts/irqbalance.h"
+#include "memory/pmm.h"
+#include "sched/task.h"
+#include "sched/idle.h"
+#include "sched/thread.h"
+#include "syscall.h"
+#include "lib/cpu.h"
+#include "lib/atomic.h"
+#include "lib/string.h"
+#include <stddef.h>
+
+// Boot stack the BSP keeps running on (boot32.asm)
+#define SMP_BOOT_STACK_TOP 0x90000
+
+// Segment base MSRs
+#define MSR_EFER            0xC0000080
+#define MSR_GS_BASE         0xC0000101
+#define MSR_KERNEL_GS_BASE  0xC0000102
+
+#define EFER_LMA            (1ULL << 10)    // Set by the CPU, not by us
+
+// Flat descriptors, the same boot32.asm uses
+#define GDT_DESC_CODE32     0x00CF9A000000FFFFULL
+#define GDT_DESC_DATA32     0x00CF92000000FFFFULL
+#define GDT_DESC_CODE64     0x00AF9A000000FFFFULL
+#define GDT_DESC_DATA64     0x00AF92000000FFFFULL
+#define GDT_DESC_USER_DATA  0x00CFF2000000FFFFULL   // DPL 3
+#define GDT_DESC_USER_CODE  0x00AFFA000000FFFFULL
+#define GDT_DESC_TSS        0x89ULL         // Present, 64-bit TSS (available)
+
+// Delays of the INIT-SIPI-SIPI sequence
+#define SMP_INIT_DELAY_US   10000
+#define SMP_SIPI_DELAY_US   200
+
+// Startup code (smp.asm) and the block it reads its settings from
+extern uint8_t smp_trampoline[];
+extern uint8_t smp_trampoline_data[];
+extern uint8_t smp_trampoline_end[];
+
+typedef struct {
+    uint16_t gdt_limit;
+    uint32_t gdt_base;
+    uint16_t pad;
+    uint64_t cr3;
+    uint64_t cr4;
+    uint64_t efer;
+    uint64_t stack;
+    uint64_t entry;
+    uint64_t arg;
+} __attribute__((packed)) smp_trampoline_data_t;
+
+typedef struct {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+static percpu_t percpu[APIC_MAX_CPUS];
+static int boot_cpu = 0;
+static bool smp_ready = false;
+
+// Fill in a CPU's GDT and TSS, load them and point GS at its per-CPU area
+static void smp_cpu_setup(percpu_t *cpu)
+{
+    cpu->self = cpu;
+    cpu->kernel_rsp = cpu->stack_top;
+    
+    memset(&cpu->tss, 0, sizeof(cpu->tss));
+    cpu->tss.rsp[0] = cpu->stack_top;
+    cpu->tss.iomap_base = sizeof(tss_t);    // No I/O permission bitmap
+    
+    uint64_t base = (uint64_t)&cpu->tss;
+    uint64_t limit = sizeof(tss_t) - 1;
+    cpu->gdt[0] = 0;
+    cpu->gdt[1] = GDT_DESC_CODE32;
+    cpu->gdt[2] = GDT_DESC_DATA32;
+    cpu->gdt[3] = GDT_DESC_CODE64;
+    cpu->gdt[4] = GDT_DESC_DATA64;
+    cpu->gdt[5] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) | (GDT_DESC_TSS << 40) |
+                  (((limit >> 16) & 0xF) << 48) | (((base >> 24) & 0xFF) << 56);
+    cpu->gdt[6] = base >> 32;
+    cpu->gdt[7] = GDT_DESC_USER_DATA;
+    cpu->gdt[8] = GDT_DESC_USER_CODE;
+    
+    gdt_ptr_t gdtr = { sizeof(cpu->gdt) - 1, (uint64_t)cpu->gdt };
+    
+    // New GDT, then a far return to reload CS from it
+    __asm__ volatile (
+        "lgdt %0\n"
+        "pushq %1\n"
+        "leaq 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        : : "m"(gdtr), "i"(GDT_KERNEL_CODE) : "rax", "memory");
+    __asm__ volatile ("ltr %w0" : : "r"((uint16_t)GDT_TSS));
+    
+    // The kernel always runs with GS on the per-CPU area, entries from user
+    // mode swapgs the user's (initially 0) out of the way
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+    
+    syscall_cpu_init();
+}
+
+// Where an AP lands in long mode, on its own stack
+static void smp_ap_main(percpu_t *cpu)
+{
+    smp_cpu_setup(cpu);
+    idt_load();
+    lapic_enable();
+    
+    cpu->online_ns = timer_get_ns();
+    atomic_store_explicit(&cpu->online, true, memory_order_release);
+    
+    // Threads run here once the scheduler is up, tasks whenever there is no
+    // thread to run. From then on the balancer may send device interrupts
+    // here too (they come in once task_worker() enables interrupts).
+    thread_ap_init();
+    irq_cpu_set_online(cpu->cpu, true);
+    task_worker();
+}
+
+static void smp_delay_us(uint64_t us)
+{
+    uint64_t end = timer_get_ns() + us * 1000;
+    while (timer_get_ns() < end) {
+        cpu_relax();
+    }
+}
+
+// Wait for an AP to set its online flag
+static bool smp_wait_online(percpu_t *cpu, uint64_t us)
+{
+    uint64_t end = timer_get_ns() + us * 1000;
+    while (!atomic_load_explicit(&cpu->online, memory_order_acquire)) {
+        if (timer_get_ns() >= end) {
+            return false;
+        }
+        cpu_relax();
+    }
+    return true;
+}
+
+// INIT-SIPI-SIPI one AP and wait until it reports in
+static bool smp_start_ap(int index, uint8_t apic_id, smp_trampoline_data_t *data)
+{
+    percpu_t *cpu = &percpu[index];
+    cpu->cpu = index;
+    cpu->apic_id = apic_id;
+    cpu->stack = pmm_alloc_pages(SMP_STACK_PAGES);
+    if (cpu->stack == NULL) {
+        return false;
+    }
+    cpu->stack_top = (uint64_t)cpu->stack + SMP_STACK_PAGES * PAGE_SIZE;
+    
+    data->stack = cpu->stack_top;
+    data->arg = (uint64_t)cpu;
+    
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    smp_delay_us(SMP_INIT_DELAY_US);
+    
+    // The second startup IPI is only for CPUs that missed the first
+    uint32_t sipi = LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> 12);
+    lapic_send_ipi(apic_id, sipi);
+    if (!smp_wait_online(cpu, SMP_SIPI_DELAY_US)) {
+        lapic_send_ipi(apic_id, sipi);
+        if (!smp_wait_online(cpu, SMP_START_TIMEOUT_MS * 1000)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void smp_init(void)
+{
+    int count;
+    const apic_cpu_t *cpus = apic_get_cpus(&count);
+    
+    // Without a MADT there is only us
+    if (apic_is_enabled()) {
+        int index = apic_cpu_index(lapic_get_id());
+        boot_cpu = index >= 0 ? index : 0;
+    }
+    
+    percpu_t *boot = &percpu[boot_cpu];
+    boot->cpu = boot_cpu;
+    boot->apic_id = apic_is_enabled() ? lapic_get_id() : 0;
+    boot->stack_top = SMP_BOOT_STACK_TOP;
+    smp_cpu_setup(boot);
+    boot->online = true;
+    boot->online_ns = timer_get_ns();
+    smp_ready = true;
+    
+    if (!apic_is_enabled() || count < 2) {
+        return;
+    }
+    
+    uint32_t size = (uint32_t)(smp_trampoline_end - smp_trampoline);
+    memcpy((void *)SMP_TRAMPOLINE_ADDR, smp_trampoline, size);
+    
+    smp_trampoline_data_t *data = (smp_trampoline_data_t *)
+        (SMP_TRAMPOLINE_ADDR + (smp_trampoline_data - smp_trampoline));
+    uint64_t cr3, cr4;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    
+    // APs borrow the BSP's GDT until they load their own
+    data->gdt_limit = sizeof(boot->gdt) - 1;
+    data->gdt_base = (uint32_t)(uint64_t)boot->gdt;
+    data->cr3 = cr3;
+    data->cr4 = cr4;
+    data->efer = rdmsr(MSR_EFER) & ~EFER_LMA;
+    data->entry = (uint64_t)smp_ap_main;
+    
+    for (int i = 0; i < count; i++) {
+        if (i == boot_cpu || !cpus[i].enabled) {
+            continue;
+        }
+        
+        // A late AP would pick up the next one's stack, so stop at the first
+        // failure (and keep its stack, it may still show up)
+        if (!smp_start_ap(i, cpus[i].apic_id, data)) {
+            break;
+        }
+    }
+}
+INITCALL(INITCALL_MEMORY, smp_init, "memory_init");
+
+int smp_processor_id(void)
+{
+    return smp_ready ? this_cpu()->cpu : 0;
+}
+
+int smp_online_count(void)
+{
+    int online = 0;
+    for (int i = 0; i < APIC_MAX_CPUS; i++) {
+        if (percpu[i].online) {
+            online++;
+        }
+    }
+    return online;
+}
+
+const percpu_t *smp_get_cpu(int cpu)
+{
+    if (cpu < 0 || cpu >= APIC_MAX_CPUS || percpu[cpu].self == NULL) {
+        return NULL;
+    }
+    return &percpu[cpu];
+}
+
+int smp_boot_cpu(void)
+{
+    return boot_cpu;
+}
+
+void smp_set_kernel_stack(uint64_t top)
+{
+    percpu_t *cpu = this_cpu();
+    cpu->tss.rsp[0] = top;
+    cpu->kernel_rsp = top;
+}
+
+void smp_wake(int cpu)
+{
+    if (cpu >= 0 && cpu < APIC_MAX_CPUS && percpu[cpu].online && !cpu_idle_wake(cpu)) {
+        lapic_send_ipi(percpu[cpu].apic_id, SMP_WAKE_VECTOR);
+    }
+}
+
+void smp_stop_aps(void)
+{
+    for (int i = 0; i < APIC_MAX_CPUS; i++) {
+        percpu_t *cpu = &percpu[i];
+        if (i == boot_cpu || !cpu->online) {
+            continue;
+        }
+        irq_cpu_set_online(i, false);
+        lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+        cpu->online = false;
+    }
+}
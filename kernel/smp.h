@@ -0,0 +1,97 @@
+// kernel/smp.h - Application processor bring-up and per-CPU data
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "interrupts/apic.h"
+
+// Low memory the AP startup code runs from (startup IPI vector 0x08)
+#define SMP_TRAMPOLINE_ADDR 0x8000
+
+#define SMP_STACK_PAGES     4       // 16KB kernel stack per AP
+
+// IPI that gets a halted AP out of hlt, or has a busy CPU look at its run
+// queue (a thread with an earlier deadline was woken onto it)
+#define SMP_WAKE_VECTOR     0xF4
+
+// How long an AP gets to report in after its startup IPIs
+#define SMP_START_TIMEOUT_MS 100
+
+// GDT selectors, the same layout boot32.asm set up
+#define GDT_KERNEL_CODE32   0x08
+#define GDT_KERNEL_DATA32   0x10
+#define GDT_KERNEL_CODE     0x18
+#define GDT_KERNEL_DATA     0x20
+#define GDT_TSS             0x28    // 16-byte system descriptor
+#define GDT_USER_DATA       0x38
+#define GDT_USER_CODE       0x40    // SYSRET wants it right after the user data
+#define GDT_ENTRIES         9
+
+// Requested privilege level for ring 3 selectors
+#define GDT_RPL_USER        3
+
+// 64-bit task state segment
+typedef struct {
+    uint32_t reserved0;
+    uint64_t rsp[3];            // Stack for interrupts from ring 0-2
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+// One per CPU, found through GS_BASE
+typedef struct percpu {
+    struct percpu *self;        // %gs:0, so this_cpu() is a single load
+    uint64_t kernel_rsp;        // %gs:8, stack SYSCALL switches to (syscall.asm)
+    uint64_t user_rsp;          // %gs:16, user stack while that happens
+    struct thread *current;     // %gs:24, thread running here (thread_current())
+    int cpu;                    // Index into apic_get_cpus()
+    uint8_t apic_id;
+    volatile bool online;
+    void *stack;                // NULL for the BSP (boot stack)
+    uint64_t stack_top;
+    uint64_t online_ns;         // Uptime when it reported in
+    uint64_t gdt[GDT_ENTRIES] __attribute__((aligned(16)));
+    tss_t tss __attribute__((aligned(16)));
+} percpu_t;
+
+// Give the BSP its per-CPU area, then start every other enabled CPU in the MADT
+void smp_init(void);
+
+// The calling CPU's per-CPU area (only after smp_init())
+static inline percpu_t *this_cpu(void)
+{
+    percpu_t *cpu;
+    __asm__ volatile ("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Index of the calling CPU (0 before smp_init())
+int smp_processor_id(void);
+
+// CPUs that are up, the BSP included
+int smp_online_count(void);
+
+// Per-CPU area of a CPU by index, NULL if it was never set up
+const percpu_t *smp_get_cpu(int cpu);
+
+// Index of the CPU that booted the machine
+int smp_boot_cpu(void);
+
+// Kernel stack for entries from user mode on this CPU (TSS rsp0 and SYSCALL)
+void smp_set_kernel_stack(uint64_t top);
+
+// Get a CPU out of cpu_idle(): a store to the line it's MWAITing on if it
+// is, SMP_WAKE_VECTOR otherwise (which also makes a busy CPU reschedule if
+// its need_resched is set)
+void smp_wake(int cpu);
+
+// Send every AP back to waiting for a startup IPI (before handing the
+// machine to another kernel: they run threads and take their own ticks)
+void smp_stop_aps(void);
+
+#endif // SMP_H
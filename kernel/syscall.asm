@@ -0,0 +1,77 @@
+; kernel/syscall.asm - SYSCALL entry and the first switch to user mode
+
+[bits 64]
+
+global syscall_entry
+global syscall_enter_user
+extern syscall_dispatch
+
+; Per-CPU fields syscall_entry uses (percpu_t in smp.h)
+PERCPU_KERNEL_RSP equ 8
+PERCPU_USER_RSP   equ 16
+
+; RFLAGS a program starts with: IF and the always-set bit 1
+USER_RFLAGS       equ 0x202
+
+; The CPU put the user rip in rcx and rflags in r11 and masked IF, but
+; left rsp on the user stack. GS is still the user's.
+syscall_entry:
+    swapgs
+    mov [gs:PERCPU_USER_RSP], rsp
+    mov rsp, [gs:PERCPU_KERNEL_RSP]
+    
+    ; Everything needed to return sits on this thread's kernel stack, so
+    ; being preempted once interrupts are back on is fine
+    push qword [gs:PERCPU_USER_RSP]
+    push rcx
+    push r11
+    push rdi
+    push rsi
+    push rdx
+    push r10
+    push r8
+    push r9
+    sub rsp, 8                      ; 10 slots, keeps the 16 byte alignment
+    
+    ; syscall_dispatch(rdi, rsi, rdx, r10, r8, number) turns interrupts
+    ; back on once it has accounted for the switch, and off again
+    mov rcx, r10
+    mov r9, rax
+    call syscall_dispatch
+    
+    add rsp, 8
+    pop r9
+    pop r8
+    pop r10
+    pop rdx
+    pop rsi
+    pop rdi
+    pop r11
+    pop rcx
+    pop rsp
+    swapgs
+    o64 sysret
+
+; rdi = user rip, rsi = user stack, rdx = argument for the program (rdi)
+syscall_enter_user:
+    cli
+    mov rcx, rdi
+    mov rsp, rsi
+    mov rdi, rdx
+    mov r11, USER_RFLAGS
+    
+    ; No kernel values left behind in registers the program can see
+    xor eax, eax
+    xor ebx, ebx
+    xor edx, edx
+    xor esi, esi
+    xor ebp, ebp
+    xor r8d, r8d
+    xor r9d, r9d
+    xor r10d, r10d
+    xor r12d, r12d
+    xor r13d, r13d
+    xor r14d, r14d
+    xor r15d, r15d
+    swapgs
+    o64 sysret
@@ -0,0 +1,152 @@
+// kernel/syscall.c - System calls from user mode (SYSCALL/SYSRET)
+//
+// SYSCALL jumps straight to LSTAR with the selectors from STAR, no gate
+// descriptor or stack frame to fetch, and SYSRET undoes it the same way.
+// That makes a round trip a fraction of what an int/iretq pair costs.
+// SYSCALL_INT_VECTOR takes the same calls through the IDT so `syscallbench`
+// can show the difference.
+
+#include "syscall.h"
+#include "process.h"
+#include "smp.h"
+#include "drivers/screen.h"
+#include "drivers/timer.h"
+#include "interrupts/idt.h"
+#include "memory/paging.h"
+#include "memory/pmm.h"
+#include "sched/thread.h"
+#include "sched/cputime.h"
+#include "lib/cpu.h"
+#include "lib/string.h"
+
+#define MSR_EFER    0xC0000080
+#define MSR_STAR    0xC0000081
+#define MSR_LSTAR   0xC0000082
+#define MSR_SFMASK  0xC0000084
+
+#define EFER_SCE    (1ULL << 0)
+
+// Flags cleared on entry: IF, TF, DF, NT and AC
+#define SYSCALL_RFLAGS_MASK 0x44700ULL
+
+// SYSCALL loads CS from STAR[47:32] (SS is +8). SYSRET loads SS from
+// STAR[63:48] + 8 and CS from + 16, both with RPL 3.
+#define STAR_KERNEL_BASE    GDT_KERNEL_CODE
+#define STAR_USER_BASE      (GDT_USER_DATA - 8)
+
+// Entry stubs (syscall.asm, isr.asm)
+extern void syscall_entry(void);
+extern uint64_t isr_stub_table[];
+
+typedef uint64_t (*syscall_fn_t)(uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                                 uint64_t arg3, uint64_t arg4);
+
+void syscall_cpu_init(void)
+{
+    wrmsr(MSR_STAR, ((uint64_t)(STAR_USER_BASE | GDT_RPL_USER) << 48) |
+                    ((uint64_t)STAR_KERNEL_BASE << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(MSR_SFMASK, SYSCALL_RFLAGS_MASK);
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+    
+    // Interrupt gate user code may use (DPL 3)
+    idt_set_gate(SYSCALL_INT_VECTOR, isr_stub_table[SYSCALL_INT_VECTOR], GDT_KERNEL_CODE, 0xEE);
+}
+
+static uint64_t sys_exit(uint64_t code, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+    (void)a1; (void)a2; (void)a3; (void)a4;
+    process_exit((int64_t)code);
+}
+
+// Copied out a piece at a time, the buffer may cross pages
+static uint64_t sys_write(uint64_t buffer, uint64_t length, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+    (void)a2; (void)a3; (void)a4;
+    
+    process_t *process = process_current();
+    if (length > SYSCALL_WRITE_MAX) {
+        return SYS_ERROR;
+    }
+    
+    char chunk[128];
+    uint64_t done = 0;
+    while (done < length) {
+        uint64_t addr = buffer + done;
+        uint64_t phys = paging_user_phys(process->pml4, addr);
+        if (phys == 0) {
+            return SYS_ERROR;
+        }
+        
+        uint64_t count = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+        if (count > length - done) {
+            count = length - done;
+        }
+        if (count > sizeof(chunk) - 1) {
+            count = sizeof(chunk) - 1;
+        }
+        memcpy(chunk, (const void *)phys, count);
+        chunk[count] = '\0';
+        screen_write(chunk);
+        done += count;
+    }
+    return length;
+}
+
+static uint64_t sys_getpid(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+    (void)a0; (void)a1; (void)a2; (void)a3; (void)a4;
+    return process_current()->pid;
+}
+
+static uint64_t sys_yield(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+    (void)a0; (void)a1; (void)a2; (void)a3; (void)a4;
+    thread_yield();
+    return 0;
+}
+
+static uint64_t sys_uptime(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+    (void)a0; (void)a1; (void)a2; (void)a3; (void)a4;
+    return timer_get_uptime_ms();
+}
+
+static uint64_t sys_clock(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4)
+{
+    (void)a0; (void)a1; (void)a2; (void)a3; (void)a4;
+    return timer_get_ns();
+}
+
+static const syscall_fn_t syscall_table[SYS_COUNT] = {
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_GETPID] = sys_getpid,
+    [SYS_YIELD] = sys_yield,
+    [SYS_UPTIME] = sys_uptime,
+    [SYS_CLOCK] = sys_clock,
+};
+
+// Entered with interrupts disabled from either path, so the switch from
+// user time is charged before anything can interrupt it
+uint64_t syscall_dispatch(uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                          uint64_t arg3, uint64_t arg4, uint64_t number)
+{
+    cputime_switch(CPUTIME_KERNEL);
+    __asm__ volatile ("sti");
+    
+    process_t *process = process_current();
+    if (process->killed) {
+        process_exit(PROCESS_EXIT_KILLED);
+    }
+    process->syscalls++;
+    
+    uint64_t result = SYS_ERROR;
+    if (number < SYS_COUNT) {
+        result = syscall_table[number](arg0, arg1, arg2, arg3, arg4);
+    }
+    
+    __asm__ volatile ("cli");
+    cputime_switch(CPUTIME_USER);
+    return result;
+}
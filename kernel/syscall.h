@@ -0,0 +1,38 @@
+// kernel/syscall.h - System calls from user mode (SYSCALL/SYSRET)
+
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+
+// Number in rax, arguments in rdi, rsi, rdx, r10, r8; result in rax.
+// rcx and r11 are clobbered, everything else is preserved.
+#define SYS_EXIT    0   // exit(code)
+#define SYS_WRITE   1   // write(buffer, length) to the console
+#define SYS_GETPID  2
+#define SYS_YIELD   3
+#define SYS_UPTIME  4   // Milliseconds since boot
+#define SYS_CLOCK   5   // Nanoseconds since boot (the time page is cheaper, see vdso.h)
+#define SYS_COUNT   6
+
+// Returned for a bad number or bad arguments
+#define SYS_ERROR   ((uint64_t)-1)
+
+// The same calls through a software interrupt, kept to compare against
+#define SYSCALL_INT_VECTOR 0xF5
+
+// Longest single write
+#define SYSCALL_WRITE_MAX 4096
+
+// Enable SYSCALL and point it at syscall_entry (on every CPU)
+void syscall_cpu_init(void);
+
+// Run system call 'number', called from syscall_entry (syscall.asm) and
+// the interrupt gate with interrupts disabled. Returns with them disabled.
+uint64_t syscall_dispatch(uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                          uint64_t arg3, uint64_t arg4, uint64_t number);
+
+// Switch to ring 3 at rip with the given stack and rdi = arg (syscall.asm)
+void syscall_enter_user(uint64_t rip, uint64_t rsp, uint64_t arg) __attribute__((noreturn));
+
+#endif // SYSCALL_H
@@ -0,0 +1,174 @@
+; kernel/user.asm - Programs that run in user mode
+;
+; Copied to USER_CODE_BASE of a fresh address space and entered with
+; rdi = argument. Only position independent code and no kernel symbols:
+; all they can do is make system calls (see syscall.h) and read the time
+; page (vdso.h).
+
+[bits 64]
+
+SYS_EXIT    equ 0
+SYS_WRITE   equ 1
+SYS_GETPID  equ 2
+SYS_CLOCK   equ 5
+
+SYSCALL_INT_VECTOR equ 0xF5
+
+global user_hello
+global user_hello_end
+global user_bench_syscall
+global user_bench_syscall_end
+global user_bench_int
+global user_bench_int_end
+global user_fault
+global user_fault_end
+global user_clock
+global user_clock_end
+global user_bench_vdso
+global user_bench_vdso_end
+global user_bench_clock
+global user_bench_clock_end
+global user_spin
+global user_spin_end
+
+; Time page, mapped at USER_VDSO_BASE (vdso_data_t in vdso.h)
+USER_VDSO_BASE  equ 0x8000200000
+VDSO_SEQ        equ 0
+VDSO_CLOCK      equ 4
+VDSO_TSC_BASE   equ 8
+VDSO_BASE_NS    equ 16
+VDSO_MULT       equ 24
+VDSO_SHIFT      equ 32
+VDSO_CLOCK_TSC  equ 1
+
+; rax = nanoseconds since boot, without entering the kernel when the time
+; page says the TSC keeps time. Retries while the kernel is rewriting it.
+; Clobbers rcx, rdx, rsi, r8 and r11.
+%macro VDSO_CLOCK_NS 0
+    mov rsi, USER_VDSO_BASE
+%%retry:
+    mov r8d, [rsi + VDSO_SEQ]
+    test r8d, 1
+    jnz %%busy
+    cmp dword [rsi + VDSO_CLOCK], VDSO_CLOCK_TSC
+    jne %%syscall
+    lfence                          ; Don't let rdtsc run ahead of the seq read
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    sub rax, [rsi + VDSO_TSC_BASE]
+    mul qword [rsi + VDSO_MULT]
+    mov ecx, [rsi + VDSO_SHIFT]
+    shrd rax, rdx, cl
+    add rax, [rsi + VDSO_BASE_NS]
+    cmp r8d, [rsi + VDSO_SEQ]
+    jne %%retry
+    jmp %%done
+%%busy:
+    pause
+    jmp %%retry
+%%syscall:
+    mov eax, SYS_CLOCK
+    syscall
+%%done:
+%endmacro
+
+; Print a greeting and exit with the pid
+user_hello:
+    lea rdi, [rel .message]
+    mov esi, .message_end - .message
+    mov eax, SYS_WRITE
+    syscall
+    mov eax, SYS_GETPID
+    syscall
+    mov rdi, rax
+    mov eax, SYS_EXIT
+    syscall
+.message:
+    db "Hello from ring 3", 10
+.message_end:
+user_hello_end:
+
+; rdi = iterations of %1 (one system call or clock read), exits with the
+; TSC cycles they took
+%macro USER_BENCH 1
+    mov r12, rdi
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    mov r13, rax
+%%loop:
+    %1
+    dec r12
+    jnz %%loop
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    sub rax, r13
+    mov rdi, rax
+    mov eax, SYS_EXIT
+    syscall
+%endmacro
+
+%macro GETPID_SYSCALL 0
+    mov eax, SYS_GETPID
+    syscall
+%endmacro
+
+%macro GETPID_INT 0
+    mov eax, SYS_GETPID
+    int SYSCALL_INT_VECTOR
+%endmacro
+
+%macro CLOCK_SYSCALL 0
+    mov eax, SYS_CLOCK
+    syscall
+%endmacro
+
+%macro SPIN_MILLION 0
+    mov ecx, 1000000
+%%spin:
+    dec ecx
+    jnz %%spin
+%endmacro
+
+user_bench_syscall:
+    USER_BENCH GETPID_SYSCALL
+user_bench_syscall_end:
+
+user_bench_int:
+    USER_BENCH GETPID_INT
+user_bench_int_end:
+
+; Read kernel memory, which must fault
+user_fault:
+    mov rax, 0x100000
+    mov rax, [rax]
+    mov rdi, rax
+    mov eax, SYS_EXIT
+    syscall
+user_fault_end:
+
+; Exit with the uptime in milliseconds, read from the time page
+user_clock:
+    VDSO_CLOCK_NS
+    xor edx, edx
+    mov ecx, 1000000
+    div rcx
+    mov rdi, rax
+    mov eax, SYS_EXIT
+    syscall
+user_clock_end:
+
+user_bench_vdso:
+    USER_BENCH VDSO_CLOCK_NS
+user_bench_vdso_end:
+
+user_bench_clock:
+    USER_BENCH CLOCK_SYSCALL
+user_bench_clock_end:
+
+; Burn the CPU for rdi million loop iterations, never blocking
+user_spin:
+    USER_BENCH SPIN_MILLION
+user_spin_end:
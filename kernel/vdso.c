@@ -0,0 +1,80 @@
+// kernel/vdso.c - Time page shared read-only with every user process
+//
+// Asking the kernel for the time costs a system call round trip, more
+// than the timestamp is worth inside a hot loop. Instead every process
+// gets this page mapped read-only, with what it takes to turn its own
+// rdtsc into nanoseconds the same way the kernel's clocksource does. The
+// timer tick rewrites it under a seqlock: the sequence is odd while the
+// fields are inconsistent, so a reader that saw an odd or changed
+// sequence simply reads again. It never waits on the kernel.
+
+#include "vdso.h"
+#include "drivers/clocksource.h"
+#include "drivers/timer.h"
+#include "memory/pmm.h"
+#include "lib/atomic.h"
+#include "lib/cpu.h"
+#include "lib/string.h"
+#include "initcall.h"
+#include <stddef.h>
+
+static vdso_data_t *vdso = NULL;
+
+void vdso_init(void)
+{
+    vdso_data_t *page = pmm_alloc_page();
+    if (page == NULL) {
+        return;
+    }
+    memset(page, 0, PAGE_SIZE);
+    
+    uint64_t flags = irq_save();
+    vdso = page;
+    vdso_update();
+    irq_restore(flags);
+}
+INITCALL(INITCALL_MEMORY, vdso_init, "memory_init");
+
+// Called with interrupts disabled, so only a reader can be in the middle.
+// base_ns is computed from the same TSC read the reader will scale from,
+// which keeps the two clocks identical.
+void vdso_update(void)
+{
+    if (vdso == NULL) {
+        return;
+    }
+    
+    atomic_store_explicit(&vdso->seq, vdso->seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    const clocksource_t *cs = clocksource_get();
+    if (clocksource_is_tsc()) {
+        uint64_t tsc = rdtsc();
+        vdso->clock = VDSO_CLOCK_TSC;
+        vdso->tsc_base = tsc;
+        vdso->base_ns = clocksource_ns_at(tsc);
+        vdso->mult = cs->mult;
+        vdso->shift = CLOCKSOURCE_SHIFT;
+    } else {
+        vdso->clock = VDSO_CLOCK_NONE;
+        vdso->base_ns = clocksource_ns();
+    }
+    vdso->ticks = timer_get_interrupts();
+    vdso->tsc_khz = timer_get_tsc_khz();
+    
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&vdso->seq, vdso->seq + 1, memory_order_relaxed);
+}
+
+bool vdso_map(uint64_t *pml4)
+{
+    if (vdso == NULL) {
+        return false;
+    }
+    return paging_map_user(pml4, USER_VDSO_BASE, (uint64_t)vdso, PTE_SHARED);
+}
+
+const vdso_data_t *vdso_get(void)
+{
+    return vdso;
+}
@@ -0,0 +1,44 @@
+// kernel/vdso.h - Time page shared read-only with every user process
+
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory/paging.h"
+
+// Where it is mapped in every address space
+#define USER_VDSO_BASE      (USER_SPACE_START + 0x200000ULL)
+
+// How user code should read the time
+#define VDSO_CLOCK_NONE     0       // Ask the kernel (SYS_CLOCK)
+#define VDSO_CLOCK_TSC      1       // rdtsc and scale it
+
+// Layout user.asm reads, the offsets are in there too. To read it: wait
+// for seq to be even, read the fields, start over if seq changed.
+//   ns = base_ns + ((rdtsc - tsc_base) * mult) >> shift
+typedef struct {
+    volatile uint32_t seq;      // Odd while the kernel is writing
+    uint32_t clock;             // VDSO_CLOCK_*
+    uint64_t tsc_base;          // TSC value at base_ns
+    uint64_t base_ns;           // Nanoseconds since boot, as of the last tick
+    uint64_t mult;
+    uint32_t shift;
+    uint32_t reserved;
+    uint64_t ticks;             // Timer interrupts since boot
+    uint64_t tsc_khz;
+} vdso_data_t;
+
+// Allocate the page and fill it in
+void vdso_init(void);
+
+// Refresh the page, called on every timer tick
+void vdso_update(void);
+
+// Map the page read-only into a user address space
+bool vdso_map(uint64_t *pml4);
+
+// The page as the kernel sees it (NULL before vdso_init)
+const vdso_data_t *vdso_get(void);
+
+#endif // VDSO_H